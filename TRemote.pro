@@ -1,27 +1,75 @@
-#-------------------------------------------------
-#
-# Project created by QtCreator 2017-10-26T10:45:17
-#
-#-------------------------------------------------
-
-
-QT += core
-QT += gui
-QT += websockets
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-TARGET = TRemote
-TEMPLATE = app
-
-
-SOURCES += main.cpp
-SOURCES += serverdiscoverer.cpp
-SOURCES += utility.cpp
-SOURCES += tremote.cpp
-
-HEADERS += utility.h
-HEADERS += serverdiscoverer.h
-HEADERS += tremote.h
-
-FORMS   += tremote.ui
+#-------------------------------------------------
+#
+# Project created by QtCreator 2017-10-26T10:45:17
+#
+#-------------------------------------------------
+
+
+QT += core
+QT += gui
+QT += network
+QT += concurrent
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = TRemote
+TEMPLATE = app
+
+
+SOURCES += main.cpp
+SOURCES += serverdiscoverer.cpp
+SOURCES += utility.cpp
+SOURCES += tremote.cpp
+SOURCES += setpointramp.cpp
+SOURCES += commandtracker.cpp
+SOURCES += connectionmanager.cpp
+SOURCES += networkmonitor.cpp
+SOURCES += binarylog.cpp
+SOURCES += tracer.cpp
+SOURCES += metrics.cpp
+SOURCES += livenessdetector.cpp
+SOURCES += commandjournal.cpp
+SOURCES += tlspolicy.cpp
+SOURCES += transport.cpp
+SOURCES += websocketcodec.cpp
+SOURCES += clocksync.cpp
+SOURCES += groupbroadcaster.cpp
+SOURCES += streamingstats.cpp
+SOURCES += allocstats.cpp
+SOURCES += readbackhistory.cpp
+SOURCES += stallwatchdog.cpp
+SOURCES += startupprofile.cpp
+
+HEADERS += utility.h
+HEADERS += serverdiscoverer.h
+HEADERS += tremote.h
+HEADERS += setpointramp.h
+HEADERS += commandtracker.h
+HEADERS += connectionmanager.h
+HEADERS += networkmonitor.h
+HEADERS += binarylog.h
+HEADERS += tracer.h
+HEADERS += metrics.h
+HEADERS += livenessdetector.h
+HEADERS += commandjournal.h
+HEADERS += tlspolicy.h
+HEADERS += transport.h
+HEADERS += websocketcodec.h
+HEADERS += clocksync.h
+HEADERS += groupbroadcaster.h
+HEADERS += streamingstats.h
+HEADERS += allocstats.h
+HEADERS += readbackhistory.h
+HEADERS += stallwatchdog.h
+HEADERS += startupprofile.h
+
+FORMS   += tremote.ui
+
+# qmake CONFIG+=alloc_stats: count the heap allocations made in the
+# ALLOC_REGION() scopes (see allocstats.h)
+alloc_stats {
+    DEFINES += TREMOTE_ALLOC_STATS
+}
+
+# Function names in the stacks sampled by the stall watchdog
+linux: QMAKE_LFLAGS += -rdynamic
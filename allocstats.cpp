@@ -0,0 +1,183 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <new>
+#include <stdlib.h>
+
+#include "allocstats.h"
+#include "metrics.h"
+
+
+namespace {
+
+// Plain integers: usable from operator new before main() and without
+// any allocation of their own
+thread_local quint64 nThreadAllocations = 0;
+thread_local quint64 nThreadBytes       = 0;
+
+std::atomic<AllocRegionStats*> pFirstRegion(Q_NULLPTR);
+
+}
+
+
+#ifdef TREMOTE_ALLOC_STATS
+
+void*
+operator new(std::size_t size) {
+    nThreadAllocations++;
+    nThreadBytes += size;
+    void *p = malloc(size ? size : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+
+void*
+operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+
+void*
+operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    nThreadAllocations++;
+    nThreadBytes += size;
+    return malloc(size ? size : 1);
+}
+
+
+void*
+operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+
+void
+operator delete(void *p) noexcept {
+    free(p);
+}
+
+
+void
+operator delete[](void *p) noexcept {
+    free(p);
+}
+
+
+void
+operator delete(void *p, const std::nothrow_t&) noexcept {
+    free(p);
+}
+
+
+void
+operator delete[](void *p, const std::nothrow_t&) noexcept {
+    free(p);
+}
+
+
+void
+operator delete(void *p, std::size_t) noexcept {
+    free(p);
+}
+
+
+void
+operator delete[](void *p, std::size_t) noexcept {
+    free(p);
+}
+
+#endif // TREMOTE_ALLOC_STATS
+
+
+// Constructed once per region, before its first entry: the metrics
+// registration is not charged to the region
+AllocRegionStats::AllocRegionStats(const char *_name)
+    : name(_name)
+    , nEntries(0)
+    , nAllocations(0)
+    , nBytes(0)
+    , pNext(Q_NULLPTR)
+{
+    QByteArray prefix = QByteArray("tremote_alloc_") + name;
+    pEntries     = &Metrics::counter((prefix+"_entries_total").constData(),
+                                     "Times the region has been entered");
+    pAllocations = &Metrics::counter((prefix+"_allocations_total").constData(),
+                                     "Heap allocations made inside the region");
+    pBytes       = &Metrics::counter((prefix+"_allocated_bytes_total").constData(),
+                                     "Bytes allocated inside the region");
+    pNext = pFirstRegion.load(std::memory_order_relaxed);
+    while(!pFirstRegion.compare_exchange_weak(pNext, this, std::memory_order_release))
+        ;
+}
+
+
+void
+AllocRegionStats::add(quint64 allocations, quint64 bytes) {
+    nEntries.fetch_add(1, std::memory_order_relaxed);
+    nAllocations.fetch_add(allocations, std::memory_order_relaxed);
+    nBytes.fetch_add(bytes, std::memory_order_relaxed);
+    pEntries->inc();
+    pAllocations->inc(allocations);
+    pBytes->inc(bytes);
+}
+
+
+bool
+AllocStats::isEnabled() {
+#ifdef TREMOTE_ALLOC_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+quint64
+AllocStats::threadAllocations() {
+    return nThreadAllocations;
+}
+
+
+quint64
+AllocStats::threadBytes() {
+    return nThreadBytes;
+}
+
+
+QString
+AllocStats::summary() {
+    QString sSummary;
+    for(AllocRegionStats *pRegion = pFirstRegion.load(std::memory_order_acquire);
+        pRegion;
+        pRegion = pRegion->pNext)
+    {
+        quint64 entries = pRegion->nEntries.load(std::memory_order_relaxed);
+        if(entries == 0)
+            continue;
+        if(!sSummary.isEmpty())
+            sSummary += QString("; ");
+        sSummary += QString("%1: %2 entries, %3 allocations (%4 bytes) per entry")
+                    .arg(pRegion->name)
+                    .arg(entries)
+                    .arg(double(pRegion->nAllocations.load(std::memory_order_relaxed))/entries, 0, 'f', 2)
+                    .arg(double(pRegion->nBytes.load(std::memory_order_relaxed))/entries, 0, 'f', 1);
+    }
+    return sSummary.isEmpty() ? QString("no region entered") : sSummary;
+}
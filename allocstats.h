@@ -0,0 +1,96 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include <QString>
+#include <atomic>
+
+class MetricCounter;
+
+
+// Heap allocation accounting. Built with "qmake CONFIG+=alloc_stats"
+// the global operator new/delete count the allocations of every thread
+// and ALLOC_REGION("name") charges what is allocated until the end of
+// the enclosing scope to a named region. Regions are reported in the
+// log (summary()) and as tremote_alloc_<name>_* counters, so that the
+// allocations per message are allocations_total / entries_total.
+// Region names must be string literals made of [a-z_].
+class AllocRegionStats
+{
+public:
+    explicit AllocRegionStats(const char *_name);
+    void add(quint64 allocations, quint64 bytes);
+
+    const char           *name;
+    std::atomic<quint64>  nEntries;
+    std::atomic<quint64>  nAllocations;
+    std::atomic<quint64>  nBytes;
+    AllocRegionStats     *pNext;
+
+private:
+    MetricCounter *pEntries;
+    MetricCounter *pAllocations;
+    MetricCounter *pBytes;
+};
+
+
+class AllocStats
+{
+public:
+    static bool    isEnabled();
+    static quint64 threadAllocations();
+    static quint64 threadBytes();
+    static QString summary();
+};
+
+
+class AllocRegion
+{
+public:
+    explicit AllocRegion(AllocRegionStats &_stats)
+        : stats(_stats)
+        , allocations0(AllocStats::threadAllocations())
+        , bytes0(AllocStats::threadBytes())
+    {
+    }
+    ~AllocRegion() {
+        stats.add(AllocStats::threadAllocations()-allocations0,
+                  AllocStats::threadBytes()-bytes0);
+    }
+
+private:
+    AllocRegionStats &stats;
+    quint64           allocations0;
+    quint64           bytes0;
+};
+
+
+#define ALLOC_CONCAT_(a, b) a##b
+#define ALLOC_CONCAT(a, b)  ALLOC_CONCAT_(a, b)
+
+#ifdef TREMOTE_ALLOC_STATS
+#define ALLOC_REGION(name)                                                  \
+    static AllocRegionStats ALLOC_CONCAT(_allocStats, __LINE__)(name);      \
+    AllocRegion ALLOC_CONCAT(_allocRegion, __LINE__)(ALLOC_CONCAT(_allocStats, __LINE__))
+#else
+#define ALLOC_REGION(name) do {} while(0)
+#endif
+
+#endif // ALLOCSTATS_H
@@ -0,0 +1,303 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QVector>
+#include <QDateTime>
+#include <QThread>
+#include <QtEndian>
+#include <string.h>
+
+#include "binarylog.h"
+
+
+#define BUFFER_SIZE      65536
+#define FLUSH_TIME       1000 // ms at most between an event and its write
+
+
+namespace {
+
+struct CallSite {
+    QByteArray file;
+    int        line;
+    QByteArray function;
+    QByteArray format;
+    int        level;
+};
+
+QVector<CallSite>&
+siteTable() {
+    static QVector<CallSite> table;
+    return table;
+}
+
+QMutex&
+siteMutex() {
+    static QMutex mutex;
+    return mutex;
+}
+
+}
+
+
+// Writes what is buffered at least once per FLUSH_TIME, so that an
+// idle log is not left behind and a crash loses one second at most
+class BinaryLogFlusher : public QThread
+{
+public:
+    explicit BinaryLogFlusher(BinaryLog *_pLog)
+        : pLog(_pLog)
+    {
+    }
+
+protected:
+    void run() { pLog->runFlusher(); }
+
+private:
+    BinaryLog *pLog;
+};
+
+
+std::atomic<bool> BinaryLog::bOpen(false);
+
+
+BinaryLog::BinaryLog()
+    : pFlusher(Q_NULLPTR)
+    , bStopFlusher(false)
+    , lastEventNs(0)
+{
+    buffer.reserve(2*BUFFER_SIZE);
+}
+
+
+BinaryLog::~BinaryLog() {
+    closeFile();
+}
+
+
+BinaryLog&
+BinaryLog::instance() {
+    static BinaryLog log;
+    return log;
+}
+
+
+bool
+BinaryLog::open(const QString &sFileName) {
+    BinaryLog& log = instance();
+    log.closeFile();
+    // Same locking order as internSite()
+    QMutexLocker siteLocker(&siteMutex());
+    QMutexLocker locker(&log.mutex);
+    log.file.setFileName(sFileName);
+    if(!log.file.open(QIODevice::WriteOnly))
+        return false;
+    log.buffer.resize(0);
+    log.buffer.append(BINARY_LOG_MAGIC);
+    log.buffer.append(char(BINARY_LOG_VERSION));
+    log.appendVarint(quint64(QDateTime::currentMSecsSinceEpoch()));
+    log.clock.start();
+    log.lastEventNs = 0;
+    for(int i=0; i<siteTable().count(); i++)
+        log.writeSite(quint32(i));
+    log.bStopFlusher = false;
+    log.pFlusher = new BinaryLogFlusher(&log);
+    log.pFlusher->start(QThread::LowPriority);
+    bOpen.store(true, std::memory_order_release);
+    return true;
+}
+
+
+void
+BinaryLog::close() {
+    instance().closeFile();
+}
+
+
+// The writers that have already seen isOpen() find the file closed
+void
+BinaryLog::closeFile() {
+    bOpen.store(false, std::memory_order_release);
+    if(pFlusher) {
+        {
+            QMutexLocker locker(&mutex);
+            bStopFlusher = true;
+            flushCondition.wakeAll();
+        }
+        pFlusher->wait();
+        delete pFlusher;
+        pFlusher = Q_NULLPTR;
+    }
+    QMutexLocker locker(&mutex);
+    if(!file.isOpen())
+        return;
+    if(!buffer.isEmpty())
+        flushBuffer();
+    file.close();
+}
+
+
+void
+BinaryLog::runFlusher() {
+    QMutexLocker locker(&mutex);
+    while(!bStopFlusher) {
+        flushCondition.wait(&mutex, FLUSH_TIME);
+        if(!buffer.isEmpty())
+            flushBuffer();
+    }
+}
+
+
+// With the mutex held
+void
+BinaryLog::flushBuffer() {
+    file.write(buffer);
+    file.flush();
+    buffer.resize(0);// The reserved capacity is kept
+}
+
+
+quint32
+BinaryLog::internSite(const char *file, int line, const char *function, const char *format, int level) {
+    QMutexLocker siteLocker(&siteMutex());
+    CallSite site;
+    site.file     = QByteArray(file);
+    site.line     = line;
+    site.function = QByteArray(function);
+    site.format   = QByteArray(format);
+    site.level    = level;
+    quint32 id = quint32(siteTable().count());
+    siteTable().append(site);
+    BinaryLog& log = instance();
+    QMutexLocker locker(&log.mutex);
+    if(log.file.isOpen())
+        log.writeSite(id);
+    return id;
+}
+
+
+void
+BinaryLog::writeSite(quint32 id) {
+    const CallSite& site = siteTable().at(int(id));
+    buffer.append(char(SiteRecord));
+    appendVarint(id);
+    appendString(site.file.constData(), site.file.size());
+    appendVarint(quint64(site.line));
+    appendString(site.function.constData(), site.function.size());
+    appendString(site.format.constData(), site.format.size());
+    buffer.append(char(site.level));
+}
+
+
+void
+BinaryLog::beginEvent(quint32 site, int argc) {
+    qint64 now = clock.nsecsElapsed();
+    buffer.append(char(EventRecord));
+    appendVarint(quint64(now - lastEventNs));
+    lastEventNs = now;
+    appendVarint(site);
+    buffer.append(char(argc));
+}
+
+
+// The time bound is kept by the flusher thread
+void
+BinaryLog::endEvent() {
+    if(buffer.size() >= BUFFER_SIZE)
+        flushBuffer();
+}
+
+
+void
+BinaryLog::appendVarint(quint64 value) {
+    while(value >= 0x80) {
+        buffer.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    buffer.append(char(value));
+}
+
+
+void
+BinaryLog::appendString(const char *pData, int length) {
+    appendVarint(quint64(length));
+    buffer.append(pData, length);
+}
+
+
+void
+BinaryLog::appendSigned(qint64 value) {
+    buffer.append(char(ArgInt));
+    appendVarint((quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+
+void
+BinaryLog::appendUnsigned(quint64 value) {
+    buffer.append(char(ArgUInt));
+    appendVarint(value);
+}
+
+
+void
+BinaryLog::appendArg(bool value) {
+    buffer.append(char(ArgBool));
+    buffer.append(char(value ? 1 : 0));
+}
+
+
+void
+BinaryLog::appendArg(double value) {
+    quint64 bits;
+    memcpy(&bits, &value, sizeof(double));
+    uchar bytes[sizeof(double)];
+    qToLittleEndian(bits, bytes);
+    buffer.append(char(ArgDouble));
+    buffer.append(reinterpret_cast<const char*>(bytes), int(sizeof(double)));
+}
+
+
+void
+BinaryLog::appendArg(const char *value) {
+    buffer.append(char(ArgUtf8));
+    appendString(value, int(strlen(value)));
+}
+
+
+// No conversion to UTF-8: the UTF-16 code units are stored as they
+// are on little endian hosts
+void
+BinaryLog::appendArg(const QString &value) {
+    buffer.append(char(ArgUtf16));
+    appendVarint(quint64(value.size()));
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    buffer.append(reinterpret_cast<const char*>(value.constData()), value.size()*2);
+#else
+    for(int i=0; i<value.size(); i++) {
+        uchar unit[2];
+        qToLittleEndian(value.at(i).unicode(), unit);
+        buffer.append(reinterpret_cast<const char*>(unit), 2);
+    }
+#endif
+}
+
+
+void
+BinaryLog::appendArg(const QByteArray &value) {
+    buffer.append(char(ArgUtf8));
+    appendString(value.constData(), value.size());
+}
@@ -0,0 +1,128 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef BINARYLOG_H
+#define BINARYLOG_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <atomic>
+
+QT_FORWARD_DECLARE_CLASS(QThread)
+
+// File layout (all integers are LEB128 varints unless stated otherwise):
+//   header : "TRBL" <version:u8> <wall clock ms at open:varint>
+//   record : <SiteRecord>  <id> <file> <line> <function> <format> <level:u8>
+//          | <EventRecord> <ns since previous event> <site id> <argc:u8> <arg>...
+//   arg    : <type:u8> <value>   (strings are <length> <bytes>)
+// Decoded offline by tools/tlogdecode.
+// Records are written through the LOG_xxx macros of utility.h and
+// reach the file when 64 KiB are buffered or, at the latest, one
+// second later. The single instance lives until the process exits:
+// close() only closes the file, so that a thread that has just seen
+// isOpen() never writes to a deleted object.
+
+#define BINARY_LOG_MAGIC    "TRBL"
+#define BINARY_LOG_VERSION  2
+
+
+class BinaryLog
+{
+public:
+    enum RecordType {
+        SiteRecord  = 1,
+        EventRecord = 2
+    };
+    enum ArgType {
+        ArgInt    = 'i', // zig-zag varint
+        ArgUInt   = 'u', // varint
+        ArgDouble = 'd', // 8 bytes little endian
+        ArgBool   = 'b', // 1 byte
+        ArgUtf8   = 's', // <length> UTF-8 bytes
+        ArgUtf16  = 'S'  // <length in chars> UTF-16LE
+    };
+
+    static bool    open(const QString &sFileName);
+    static void    close();
+    static bool    isOpen() { return bOpen.load(std::memory_order_acquire); }
+    static quint32 internSite(const char *file, int line,
+                              const char *function, const char *format,
+                              int level);
+
+    template<typename... Args>
+    static void write(quint32 site, const Args&... args) {
+        BinaryLog& log = instance();
+        QMutexLocker locker(&log.mutex);
+        if(!log.file.isOpen())
+            return;
+        log.beginEvent(site, int(sizeof...(args)));
+        log.appendArgs(args...);
+        log.endEvent();
+    }
+
+private:
+    BinaryLog();
+    ~BinaryLog();
+    static BinaryLog& instance();
+    void closeFile();
+    void flushBuffer();
+    void runFlusher();
+    void beginEvent(quint32 site, int argc);
+    void endEvent();
+    void writeSite(quint32 id);
+    void appendVarint(quint64 value);
+    void appendString(const char *pData, int length);
+
+    void appendArgs() {}
+    template<typename T, typename... Rest>
+    void appendArgs(const T &first, const Rest&... rest) {
+        appendArg(first);
+        appendArgs(rest...);
+    }
+    void appendArg(bool value);
+    void appendArg(int value)                { appendSigned(value); }
+    void appendArg(long value)               { appendSigned(value); }
+    void appendArg(long long value)          { appendSigned(value); }
+    void appendArg(unsigned value)           { appendUnsigned(value); }
+    void appendArg(unsigned long value)      { appendUnsigned(value); }
+    void appendArg(unsigned long long value) { appendUnsigned(value); }
+    void appendArg(double value);
+    void appendArg(const char *value);
+    void appendArg(const QString &value);
+    void appendArg(const QByteArray &value);
+    void appendSigned(qint64 value);
+    void appendUnsigned(quint64 value);
+
+private:
+    friend class BinaryLogFlusher;
+    static std::atomic<bool> bOpen;
+    QMutex         mutex;
+    QWaitCondition flushCondition; // Wakes the flusher before its time
+    QThread       *pFlusher;
+    bool           bStopFlusher;
+    QFile          file;
+    QByteArray     buffer;
+    QElapsedTimer  clock;
+    qint64         lastEventNs;
+};
+
+#endif // BINARYLOG_H
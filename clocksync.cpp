@@ -0,0 +1,216 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QStringList>
+
+#include "clocksync.h"
+#include "metrics.h"
+
+
+#define BURST_SIZE        8      // Exchanges per burst
+#define BURST_SPACING     250    // ms between the exchanges of a burst
+#define BURST_PERIOD      30000  // ms between bursts
+#define MAX_SAMPLES       32     // Bursts retained for the fit
+#define MIN_FIT_SPAN      60     // s of samples needed to estimate the drift
+#define MAX_UNANSWERED    (3*BURST_SIZE)
+
+
+namespace {
+
+QElapsedTimer
+startedClock() {
+    QElapsedTimer clock;
+    clock.start();
+    return clock;
+}
+
+}
+
+
+ClockSync::ClockSync(QFile *_logFile, QObject *parent)
+    : QObject(parent)
+    , logFile(_logFile)
+    , nExchanges(0)
+    , nUnanswered(0)
+    , bValid(false)
+    , referenceNs(0)
+    , offset(0.0)
+    , drift(0.0)
+{
+    connect(&exchangeTimer, SIGNAL(timeout()),
+            this, SLOT(onTimeToExchange()));
+}
+
+
+// Monotonic, but anchored to the wall clock at the first call.
+// Also called from the ramp thread: initialized once, then only read
+qint64
+ClockSync::localNs() {
+    static const qint64 epochNs = QDateTime::currentMSecsSinceEpoch()*1000000;
+    static const QElapsedTimer clock = startedClock();
+    return epochNs + clock.nsecsElapsed();
+}
+
+
+// A different server may answer after a reconnection: restart from scratch
+void
+ClockSync::start() {
+    burst.clear();
+    samples.clear();
+    outstanding.clear();
+    bValid      = false;
+    nExchanges  = 0;
+    nUnanswered = 0;
+    referenceNs = 0;
+    offset      = 0.0;
+    drift       = 0.0;
+    onTimeToExchange();
+}
+
+
+void
+ClockSync::stop() {
+    exchangeTimer.stop();
+}
+
+
+void
+ClockSync::onTimeToExchange() {
+    if(nUnanswered >= MAX_UNANSWERED) {
+        LOG_INFO(logFile, "The server does not answer time requests");
+        exchangeTimer.stop();
+        return;
+    }
+    // Late answers of the previous burst are not waited for
+    if(nExchanges % BURST_SIZE == 0) {
+        outstanding.clear();
+        if(!burst.isEmpty())
+            closeBurst();
+    }
+    nExchanges++;
+    nUnanswered++;
+    exchangeTimer.start(nExchanges % BURST_SIZE ? BURST_SPACING : BURST_PERIOD);
+    qint64 t1 = localNs();
+    outstanding.append(t1);
+    emit timeRequest(QString("<timeReq>%1</timeReq>").arg(t1));
+}
+
+
+void
+ClockSync::responseReceived(QString sToken) {
+    qint64 t4 = localNs();
+    QStringList fields = sToken.split(QChar(';'));
+    if(fields.count() != 3)
+        return;
+    bool ok1, ok2, ok3;
+    qint64 t1 = fields.at(0).toLongLong(&ok1);
+    qint64 t2 = fields.at(1).toLongLong(&ok2);
+    qint64 t3 = fields.at(2).toLongLong(&ok3);
+    if(!ok1 || !ok2 || !ok3)
+        return;
+    // Only answers to our own pending requests, each one once: a
+    // duplicate, a late one or one meant for a previous connection
+    // would put a false round trip in the burst
+    int index = outstanding.indexOf(t1);
+    if(index < 0) {
+        LOG_DEBUG(logFile, "Time response to an unknown request %1", t1);
+        return;
+    }
+    outstanding.remove(index);
+    nUnanswered = 0;
+    Sample sample;
+    sample.delayNs  = (t4-t1) - (t3-t2);
+    sample.offsetNs = (double(t2-t1) + double(t3-t4))/2.0;
+    sample.localNs  = t1 + (t4-t1)/2;
+    burst.append(sample);
+    if(burst.count() == BURST_SIZE)
+        closeBurst();
+}
+
+
+// The exchange least delayed is the least affected by asymmetry
+void
+ClockSync::closeBurst() {
+    int best = 0;
+    for(int i=1; i<burst.count(); i++) {
+        if(burst.at(i).delayNs < burst.at(best).delayNs)
+            best = i;
+    }
+    samples.append(burst.at(best));
+    burst.clear();
+    if(samples.count() > MAX_SAMPLES)
+        samples.remove(0);
+    fit();
+}
+
+
+void
+ClockSync::fit() {
+    int n = samples.count();
+    referenceNs = samples.last().localNs;
+    if(n < 3 || double(referenceNs-samples.first().localNs) < MIN_FIT_SPAN*1.0e9) {
+        offset = samples.last().offsetNs;
+    }
+    else {
+        double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+        for(int i=0; i<n; i++) {
+            double x = double(samples.at(i).localNs-referenceNs);
+            double y = samples.at(i).offsetNs;
+            sx  += x;
+            sy  += y;
+            sxx += x*x;
+            sxy += x*y;
+        }
+        double denominator = n*sxx - sx*sx;
+        if(denominator > 0.0)
+            drift = (n*sxy - sx*sy)/denominator;
+        offset = (sy - drift*sx)/n;
+    }
+    bValid = true;
+    static MetricGauge& offsetGauge = Metrics::gauge("tremote_clock_offset_seconds",
+                                                     "Server minus client clock");
+    static MetricGauge& driftGauge = Metrics::gauge("tremote_clock_drift_ppm",
+                                                    "Server clock drift relative to the client");
+    static MetricHistogram& syncDelay = Metrics::histogram("tremote_clock_sync_delay_seconds",
+                                                           "Round trip of the retained time exchanges");
+    offsetGauge.set(offset*1.0e-9);
+    driftGauge.set(driftPpm());
+    syncDelay.observe(samples.last().delayNs);
+    LOG_DEBUG(logFile,
+              "Clock offset %1 us, drift %2 ppm, delay %3 us",
+              offset/1000.0,
+              driftPpm(),
+              double(samples.last().delayNs)/1000.0);
+}
+
+
+qint64
+ClockSync::toServerNs(qint64 localTimeNs) const {
+    double dt = double(localTimeNs-referenceNs);
+    return localTimeNs + qint64(offset + drift*dt);
+}
+
+
+qint64
+ClockSync::toLocalNs(qint64 serverTimeNs) const {
+    // First order inverse: the drift is a few ppm at most
+    qint64 approx = serverTimeNs - qint64(offset);
+    return serverTimeNs - qint64(offset + drift*double(approx-referenceNs));
+}
@@ -0,0 +1,85 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+
+#include "utility.h"
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+
+// NTP style estimation of the server clock.
+// The client sends <timeReq>t1</timeReq> and the server answers
+// <timeResp>t1;t2;t3</timeResp>, t2 and t3 being its receive and send
+// times, in ns since the epoch. Of every burst of exchanges only the
+// one with the smallest round trip is kept; the offset and the drift
+// come from a least squares fit of the retained samples.
+// Servers may then add <ts>serverNs</ts> to readbacks and acks.
+class ClockSync : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ClockSync(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
+
+    static qint64 localNs();
+    bool   isValid() const { return bValid; }
+    qint64 toServerNs(qint64 localTimeNs) const;
+    qint64 toLocalNs(qint64 serverTimeNs) const;
+    double offsetNs() const { return offset; }
+    double driftPpm() const { return drift*1.0e6; }
+    void   responseReceived(QString sToken);
+
+public slots:
+    void start();
+    void stop();
+
+signals:
+    void timeRequest(QString sMessage);
+
+private slots:
+    void onTimeToExchange();
+
+private:
+    void closeBurst();
+    void fit();
+
+private:
+    struct Sample {
+        qint64 localNs;  // Midpoint of the exchange
+        double offsetNs;
+        qint64 delayNs;
+    };
+    QFile          *logFile;
+    QTimer          exchangeTimer;
+    QVector<Sample> burst;       // Exchanges of the current burst
+    QVector<Sample> samples;     // Best exchange of each burst
+    QVector<qint64> outstanding; // t1 of the requests not answered yet
+    int             nExchanges;
+    int             nUnanswered;
+    bool            bValid;
+    qint64          referenceNs; // Local time the fit is centered on
+    double          offset;      // Server - local at referenceNs
+    double          drift;       // Seconds per second
+};
+
+#endif // CLOCKSYNC_H
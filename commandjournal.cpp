@@ -0,0 +1,220 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "commandjournal.h"
+#include "metrics.h"
+
+#include <QDateTime>
+#include <QSaveFile>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+#define SET_RECORD     'S'
+#define COMMIT_RECORD  'C'
+
+
+namespace {
+
+// QFile::flush() only hands the data to the kernel
+bool
+syncToDisk(QFile &file) {
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+}
+
+
+CommandJournal::CommandJournal(QFile *_logFile, QObject *parent)
+    : QObject(parent)
+    , logFile(_logFile)
+{
+}
+
+
+CommandJournal::~CommandJournal() {
+    if(journalFile.isOpen())
+        journalFile.close();
+}
+
+
+// Restores the commands left pending by a previous session, unless
+// too old to be of any use
+bool
+CommandJournal::open(QString sFileName, int maxAge) {
+    journalFile.setFileName(sFileName);
+    if(!journalFile.open(QIODevice::ReadWrite | QIODevice::Text)) {
+        LOG_ERROR(logFile, "Unable to open %1: %2", sFileName, journalFile.errorString());
+        return false;
+    }
+    QMap<QString, Entry> fromFile;
+    while(!journalFile.atEnd()) {
+        QString sLine = QString::fromUtf8(journalFile.readLine()).trimmed();
+        QStringList fields = sLine.split(QChar('\t'));
+        if(fields.count() < 3 || fields.count() > 4 || fields.at(0).length() != 1)
+            continue;// Torn write at the end of the file
+        Entry entry;
+        entry.value  = fields.at(2);
+        // Records without a time come from older versions: expired
+        entry.timeMs = fields.count() == 4 ? fields.at(3).toLongLong() : 0;
+        if(fields.at(0) == QString(QChar(SET_RECORD)))
+            fromFile.insert(fields.at(1), entry);
+        else if(fields.at(0) == QString(QChar(COMMIT_RECORD)) && fromFile.value(fields.at(1)).value == entry.value)
+            fromFile.remove(fields.at(1));
+    }
+    restored.clear();
+    qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+    QMap<QString, Entry>::const_iterator it;
+    for(it=fromFile.constBegin(); it!=fromFile.constEnd(); ++it) {
+        // Commands recorded before the journal was opened are the newest
+        if(pending.contains(it.key()))
+            continue;
+        if(nowMs-it.value().timeMs > qint64(maxAge)*1000) {
+            LOG_INFO(logFile, "Forgetting %1=%2: left pending too long ago", it.key(), it.value().value);
+            continue;
+        }
+        restored.insert(it.key(), it.value());
+    }
+    compact();
+    if(!restored.isEmpty())
+        LOG_INFO(logFile, "%1 commands left pending by the previous session", restored.count());
+    return true;
+}
+
+
+QMap<QString, QString>
+CommandJournal::pendingCommands() const {
+    QMap<QString, QString> commands;
+    QMap<QString, Entry>::const_iterator it;
+    for(it=pending.constBegin(); it!=pending.constEnd(); ++it)
+        commands.insert(it.key(), it.value().value);
+    return commands;
+}
+
+
+// Called before the command is sent, whatever the connection state
+void
+CommandJournal::record(QString sTag, QString sValue) {
+    Entry entry;
+    entry.value  = sValue;
+    entry.timeMs = QDateTime::currentMSecsSinceEpoch();
+    pending.insert(sTag, entry);
+    if(restored.remove(sTag) > 0)
+        compact();
+    else
+        append(SET_RECORD, sTag, entry);
+}
+
+
+// The server has read back the value: it is no more pending
+void
+CommandJournal::committed(QString sTag, QString sValue) {
+    if(!pending.contains(sTag))
+        return;
+    bool ok;
+    double dValue = sValue.toDouble(&ok);
+    Entry entry = pending.value(sTag);
+    bool bMatch = ok ? qAbs(entry.value.toDouble()-dValue) < 1.0e-6
+                     : entry.value == sValue;
+    if(!bMatch)
+        return;
+    pending.remove(sTag);
+    if(!pending.isEmpty() || !restored.isEmpty()) {
+        append(COMMIT_RECORD, sTag, entry);
+        return;
+    }
+    compact();
+    if(replayClock.isValid()) {
+        static MetricHistogram& replaySeconds = Metrics::histogram("tremote_journal_replay_seconds",
+                                                                   "Time from reconnection to the readback of the replayed commands");
+        replaySeconds.observe(replayClock.nsecsElapsed());
+        LOG_INFO(logFile,
+                 "Journal replayed in %1 ms",
+                 QString::number(double(replayClock.nsecsElapsed())/1.0e6, 'f', 1));
+        replayClock.invalidate();
+    }
+}
+
+
+void
+CommandJournal::replayStarted() {
+    if(pending.isEmpty())
+        return;
+    static MetricCounter& replayed = Metrics::counter("tremote_journal_replayed_total",
+                                                      "Commands replayed from the journal");
+    replayed.inc(quint64(pending.count()));
+    replayClock.start();
+}
+
+
+QByteArray
+CommandJournal::encode(char kind, const QString &sTag, const Entry &entry) {
+    return QString("%1\t%2\t%3\t%4\n")
+           .arg(QChar(kind)).arg(sTag).arg(entry.value).arg(entry.timeMs).toUtf8();
+}
+
+
+// The record is on disk before the command is sent
+bool
+CommandJournal::append(char kind, const QString &sTag, const Entry &entry) {
+    if(!journalFile.isOpen())
+        return false;
+    QByteArray record = encode(kind, sTag, entry);
+    if(journalFile.write(record) != record.size() ||
+       !journalFile.flush() ||
+       !syncToDisk(journalFile))
+    {
+        LOG_WARNING(logFile, "Unable to write the command journal: %1", journalFile.errorString());
+        return false;
+    }
+    return true;
+}
+
+
+// Replaces the file with the pending and the restored commands only.
+// Written aside and renamed over the journal: a crash leaves either
+// the old file or the new one, never a truncated one.
+void
+CommandJournal::compact() {
+    if(!journalFile.isOpen())
+        return;
+    QSaveFile compacted(journalFile.fileName());
+    if(!compacted.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        LOG_WARNING(logFile, "Unable to compact the command journal: %1", compacted.errorString());
+        return;
+    }
+    QMap<QString, Entry>::const_iterator it;
+    for(it=restored.constBegin(); it!=restored.constEnd(); ++it)
+        compacted.write(encode(SET_RECORD, it.key(), it.value()));
+    for(it=pending.constBegin(); it!=pending.constEnd(); ++it)
+        compacted.write(encode(SET_RECORD, it.key(), it.value()));
+    // Closed first: Windows cannot rename over an open file. The new
+    // file is synced to disk before the rename
+    journalFile.close();
+    if(!compacted.commit())
+        LOG_WARNING(logFile, "Unable to compact the command journal: %1", compacted.errorString());
+    if(!journalFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        LOG_ERROR(logFile, "Unable to reopen %1: %2", journalFile.fileName(), journalFile.errorString());
+}
@@ -0,0 +1,74 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef COMMANDJOURNAL_H
+#define COMMANDJOURNAL_H
+
+#include <QObject>
+#include <QFile>
+#include <QMap>
+#include <QElapsedTimer>
+
+#include "utility.h"
+
+
+// Write-ahead journal of the commands issued by the operator. Every
+// command is appended to a small file before being sent; only the
+// last value of each channel (tag) is kept pending until the server
+// reads it back, so a reconnection replays the minimal final state.
+// The file survives a restart and is replaced by an empty one, through
+// a rename, once nothing is pending.
+// The commands left pending by a previous session are never replayed
+// on their own: they are only restored, for the operator to confirm
+// by issuing them again, and forgotten once older than maxAge seconds.
+class CommandJournal : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CommandJournal(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
+    ~CommandJournal();
+
+    bool    open(QString sFileName, int maxAge);
+    void    record(QString sTag, QString sValue);
+    void    committed(QString sTag, QString sValue);
+    bool    isPending(QString sTag) const { return pending.contains(sTag); }
+    QMap<QString, QString> pendingCommands() const;
+    bool    isRestored(QString sTag) const { return restored.contains(sTag); }
+    QString restoredValue(QString sTag) const { return restored.value(sTag).value; }
+    qint64  restoredTime(QString sTag) const { return restored.value(sTag).timeMs; }
+    void    replayStarted();
+
+private:
+    struct Entry {
+        Entry() : timeMs(0) {}
+        QString value;
+        qint64  timeMs; // When recorded, ms since the epoch
+    };
+    static QByteArray encode(char kind, const QString &sTag, const Entry &entry);
+    bool    append(char kind, const QString &sTag, const Entry &entry);
+    void    compact();
+
+private:
+    QFile                  *logFile;
+    QFile                   journalFile;
+    QMap<QString, Entry>    pending;    // Tag -> last value
+    QMap<QString, Entry>    restored;   // Left by the previous session
+    QElapsedTimer           replayClock;
+};
+
+#endif // COMMANDJOURNAL_H
@@ -0,0 +1,299 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QFile>
+#include <QMutexLocker>
+
+#include "commandtracker.h"
+#include "metrics.h"
+#include "clocksync.h"
+
+
+#define IN_FLIGHT_WINDOW      16    // Max number of unacknowledged commands
+#define ACK_TIMEOUT           1000  // ms before a command is retransmitted
+#define READBACK_TIMEOUT      5000  // ms to wait for the matching readback
+#define MAX_RETRIES           3
+#define DEADLINE_CHECK_TIME   50
+
+
+CommandTracker::CommandTracker(QFile *_logFile, QObject *parent)
+    : QObject(parent)
+    , logFile(_logFile)
+    , mutex(QMutex::Recursive)
+    , pClockSync(Q_NULLPTR)
+    , lastSeq(0)
+    , bConnected(false)
+    , bAckSeen(false)
+{
+    clock.start();
+    connect(&deadlineTimer, SIGNAL(timeout()),
+            this, SLOT(onTimeToCheckDeadlines()));
+}
+
+
+CommandTracker::~CommandTracker() {
+    deadlineTimer.stop();
+    LOG_DEBUG(logFile, "Ack latency: %1", ackLatencySummary());
+}
+
+
+bool
+CommandTracker::isWindowFull() const {
+    QMutexLocker locker(&mutex);
+    int nPending = 0;
+    for(int i=0; i<inFlight.count(); i++) {
+        if(!inFlight.at(i).bAcked)
+            nPending++;
+    }
+    return nPending >= IN_FLIGHT_WINDOW;
+}
+
+
+bool
+CommandTracker::isInFlight(QString sTag, QString sValue) const {
+    QMutexLocker locker(&mutex);
+    for(int i=0; i<inFlight.count(); i++) {
+        if(inFlight.at(i).sTag == sTag && inFlight.at(i).sValue == sValue)
+            return true;
+    }
+    return false;
+}
+
+
+// Returns the message to be sent
+QString
+CommandTracker::track(QString sTag, QString sValue) {
+    QMutexLocker locker(&mutex);
+    Command command;
+    command.seq         = ++lastSeq;
+    command.sTag        = sTag;
+    command.sValue      = sValue;
+    command.sMessage    = QString("<%1>%2</%1><seq>%3</seq>")
+                          .arg(sTag)
+                          .arg(sValue)
+                          .arg(command.seq);
+    command.sentNs      = clock.nsecsElapsed();
+    command.sentLocalNs = ClockSync::localNs();
+    command.deadlineNs  = command.sentNs + qint64(ACK_TIMEOUT)*1000000;
+    command.nRetries    = 0;
+    command.bAcked      = false;
+    inFlight.append(command);
+    updateInFlightGauge();
+    // The timer can only be started from its own thread
+    QMetaObject::invokeMethod(this, "armDeadlines");
+    return command.sMessage;
+}
+
+
+void
+CommandTracker::armDeadlines() {
+    QMutexLocker locker(&mutex);
+    if(bConnected && !inFlight.isEmpty() && !deadlineTimer.isActive())
+        deadlineTimer.start(DEADLINE_CHECK_TIME);
+}
+
+
+void
+CommandTracker::acknowledged(quint32 seq, qint64 serverNs) {
+    QMutexLocker locker(&mutex);
+    qint64 now = clock.nsecsElapsed();
+    bAckSeen = true;
+    for(int i=0; i<inFlight.count(); i++) {
+        Command& command = inFlight[i];
+        if(command.seq != seq)
+            continue;
+        if(!command.bAcked) {
+            static MetricHistogram& ackSeconds = Metrics::histogram("tremote_ack_latency_seconds",
+                                                                    "Time from command to acknowledgment");
+            ackSeconds.observe(now - command.sentNs);
+            ackLatency.add(now - command.sentNs);
+            static MetricHistogram& ackOneWay = Metrics::histogram("tremote_ack_one_way_seconds",
+                                                                   "Time from command to its reception by the server");
+            recordOneWay(command, serverNs, ackOneWay);
+            command.bAcked     = true;
+            command.deadlineNs = now + qint64(READBACK_TIMEOUT)*1000000;
+        }
+        return;
+    }
+}
+
+
+// The server echoes the applied setpoint: the oldest acknowledged
+// command with the same value is the one that has been applied. Until
+// its ack the server may still be reporting an older, equal value;
+// servers that never acknowledge are matched by value alone.
+void
+CommandTracker::readbackReceived(QString sTag, QString sValue, qint64 serverNs) {
+    QMutexLocker locker(&mutex);
+    qint64 now = clock.nsecsElapsed();
+    bool ok;
+    double dValue = sValue.toDouble(&ok);
+    for(int i=0; i<inFlight.count(); i++) {
+        const Command& command = inFlight.at(i);
+        if(command.sTag != sTag)
+            continue;
+        if(bAckSeen && !command.bAcked)
+            continue;
+        bool bMatch = ok ? qAbs(command.sValue.toDouble()-dValue) < 1.0e-6
+                         : command.sValue == sValue;
+        if(!bMatch)
+            continue;
+        static MetricHistogram& readbackSeconds = Metrics::histogram("tremote_readback_latency_seconds",
+                                                                     "Time from command to matching readback");
+        readbackSeconds.observe(now - command.sentNs);
+        readbackLatency.add(now - command.sentNs);
+        static MetricHistogram& applyOneWay = Metrics::histogram("tremote_apply_one_way_seconds",
+                                                                 "Time from command to its application by the server");
+        recordOneWay(command, serverNs, applyOneWay);
+        // Older commands of the same kind have been overridden
+        for(int j=i; j>=0; j--) {
+            if(inFlight.at(j).sTag == sTag)
+                forget(j, false);
+        }
+        return;
+    }
+}
+
+
+void
+CommandTracker::connectionLost() {
+    QMutexLocker locker(&mutex);
+    bConnected = false;
+    deadlineTimer.stop();
+    // No readback can arrive from a closed connection
+    for(int i=inFlight.count()-1; i>=0; i--) {
+        if(inFlight.at(i).bAcked)
+            forget(i, false);
+    }
+    LOG_DEBUG(logFile,
+              "%1 commands pending. Ack latency: %2 - Readback latency: %3",
+              inFlight.count(),
+              ackLatencySummary(),
+              readbackLatencySummary());
+}
+
+
+void
+CommandTracker::connectionRestored() {
+    QMutexLocker locker(&mutex);
+    bConnected = true;
+    bAckSeen   = false;// A different server could be on the other side
+    for(int i=inFlight.count()-1; i>=0; i--) {
+        bool bSuperseded = false;
+        for(int j=i+1; j<inFlight.count(); j++) {
+            if(inFlight.at(j).sTag == inFlight.at(i).sTag)
+                bSuperseded = true;
+        }
+        if(bSuperseded)
+            forget(i, false);
+    }
+    for(int i=0; i<inFlight.count(); i++)
+        resend(inFlight[i]);
+    if(!inFlight.isEmpty())
+        deadlineTimer.start(DEADLINE_CHECK_TIME);
+}
+
+
+void
+CommandTracker::resend(Command &command) {
+    static MetricCounter& retransmissions = Metrics::counter("tremote_retransmissions_total",
+                                                             "Commands sent again");
+    retransmissions.inc();
+    command.deadlineNs = clock.nsecsElapsed() + qint64(ACK_TIMEOUT)*1000000;
+    emit retransmit(command.sMessage);
+}
+
+
+void
+CommandTracker::forget(int index, bool bLost) {
+    Command command = inFlight.takeAt(index);
+    updateInFlightGauge();
+    if(bLost) {
+        static MetricCounter& commandsLost = Metrics::counter("tremote_commands_lost_total",
+                                                              "Commands given up after the last retry");
+        commandsLost.inc();
+        LOG_WARNING(logFile, "Command lost: %1", command.sMessage);
+        emit commandLost(command.seq, command.sMessage);
+    }
+    if(inFlight.isEmpty())
+        deadlineTimer.stop();
+}
+
+
+// Needs the server timestamp of the event and a synchronized clock
+void
+CommandTracker::recordOneWay(const Command &command, qint64 serverNs, MetricHistogram &histogram) {
+    if(serverNs <= 0 || !pClockSync || !pClockSync->isValid())
+        return;
+    qint64 oneWayNs = serverNs - pClockSync->toServerNs(command.sentLocalNs);
+    if(oneWayNs < 0)
+        return;// Within the synchronization error
+    histogram.observe(oneWayNs);
+    LOG_DEBUG(logFile, "#%1 one way latency %2 us", command.seq, double(oneWayNs)/1000.0);
+}
+
+
+void
+CommandTracker::updateInFlightGauge() {
+    static MetricGauge& inFlightGauge = Metrics::gauge("tremote_commands_in_flight",
+                                                       "Commands awaiting acknowledgment or readback");
+    inFlightGauge.set(double(inFlight.count()));
+}
+
+
+void
+CommandTracker::onTimeToCheckDeadlines() {
+    QMutexLocker locker(&mutex);
+    qint64 now = clock.nsecsElapsed();
+    for(int i=inFlight.count()-1; i>=0; i--) {
+        Command& command = inFlight[i];
+        if(command.deadlineNs > now)
+            continue;
+        bool bSuperseded = false;
+        for(int j=i+1; j<inFlight.count(); j++) {
+            if(inFlight.at(j).sTag == command.sTag)
+                bSuperseded = true;
+        }
+        if(command.bAcked || bSuperseded || !bAckSeen) {
+            // Readback never arrived, a newer command has been issued
+            // or the server does not acknowledge at all
+            forget(i, false);
+        }
+        else if(command.nRetries < MAX_RETRIES) {
+            command.nRetries++;
+            resend(command);
+        }
+        else {
+            forget(i, true);
+        }
+    }
+}
+
+
+QString
+CommandTracker::ackLatencySummary() const {
+    QMutexLocker locker(&mutex);
+    return ackLatency.summary();
+}
+
+
+QString
+CommandTracker::readbackLatencySummary() const {
+    QMutexLocker locker(&mutex);
+    return readbackLatency.summary();
+}
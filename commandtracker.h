@@ -0,0 +1,97 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef COMMANDTRACKER_H
+#define COMMANDTRACKER_H
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QMutex>
+
+#include "utility.h"
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(ClockSync)
+QT_FORWARD_DECLARE_CLASS(MetricHistogram)
+
+
+// Every outbound command carries a <seq> tag that the server echoes
+// back as <ack>. The tracker keeps a bounded window of the commands
+// still in flight, each with its own deadline.
+// Commands may be tracked from any thread (the setpoint ramp tracks
+// its own); the deadlines are checked in the tracker's thread.
+class CommandTracker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CommandTracker(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
+    ~CommandTracker();
+
+    bool    isWindowFull() const;
+    bool    isInFlight(QString sTag, QString sValue) const;
+    QString track(QString sTag, QString sValue);
+    void    setClockSync(const ClockSync *_pClockSync) { pClockSync = _pClockSync; }
+    void    acknowledged(quint32 seq, qint64 serverNs=-1);
+    void    readbackReceived(QString sTag, QString sValue, qint64 serverNs=-1);
+    void    connectionLost();
+    void    connectionRestored();
+    QString ackLatencySummary() const;
+    QString readbackLatencySummary() const;
+
+signals:
+    void retransmit(QString sMessage);
+    void commandLost(quint32 seq, QString sMessage);
+
+private slots:
+    void onTimeToCheckDeadlines();
+    void armDeadlines();
+
+private:
+    struct Command {
+        quint32 seq;
+        QString sTag;
+        QString sValue;
+        QString sMessage;
+        qint64  sentNs;
+        qint64  sentLocalNs;  // ClockSync time base
+        qint64  deadlineNs;
+        int     nRetries;
+        bool    bAcked;
+    };
+    void resend(Command &command);
+    void forget(int index, bool bLost);
+    void updateInFlightGauge();
+    void recordOneWay(const Command &command, qint64 serverNs, MetricHistogram &histogram);
+
+private:
+    QFile          *logFile;
+    mutable QMutex  mutex;         // Recursive: held while signalling
+    const ClockSync *pClockSync;
+    QList<Command>  inFlight;
+    QTimer          deadlineTimer;
+    QElapsedTimer   clock;
+    quint32         lastSeq;
+    bool            bConnected;
+    bool            bAckSeen;
+    TimingStats     ackLatency;
+    TimingStats     readbackLatency;
+};
+
+#endif // COMMANDTRACKER_H
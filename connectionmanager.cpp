@@ -0,0 +1,788 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QUrl>
+#include <QThread>
+#include <QMutexLocker>
+
+#include "connectionmanager.h"
+#include "serverdiscoverer.h"
+#include "livenessdetector.h"
+#include "transport.h"
+#include "tracer.h"
+#include "metrics.h"
+
+
+#define CONNECTION_TIME      3000// Not to be set too low for coping with slow networks
+#define FIRST_DISCOVERY_RETRY 250 // Doubled up to CONNECTION_TIME
+#define LAST_SERVER_TIMEOUT  2000
+#define CONNECT_TIMEOUT      10000
+#define PRIMARY_IDLE_PERIOD  1000
+#define STANDBY_IDLE_PERIOD  5000 // The standby link only needs light heartbeats
+#define STANDBY_RETRY_TIME   10000
+
+
+namespace {
+
+// Bytes of the UTF-8 encoding, without building it
+quint64
+utf8Size(const QString &sText) {
+    quint64 size = 0;
+    const QChar *p = sText.constData();
+    for(int i=0; i<sText.size(); i++) {
+        ushort c = p[i].unicode();
+        if(c < 0x80)
+            size += 1;
+        else if(c < 0x800)
+            size += 2;
+        else if(QChar::isSurrogate(c))
+            size += 2; // 4 bytes per surrogate pair
+        else
+            size += 3;
+    }
+    return size;
+}
+
+}
+
+
+ConnectionManager::ConnectionManager(QFile *_logFile, QObject *parent)
+    : QObject(parent)
+    , logFile(_logFile)
+    , pTlsPolicy(&TlsPolicy::shared(_logFile))
+    , bSecure(false)
+    , pStandby(Q_NULLPTR)
+    , pStandbyLiveness(Q_NULLPTR)
+    , bHotStandby(false)
+    , bStandbyReady(false)
+    , standbyRetryTimer(this) // The timers follow the manager to its thread
+    , currentState(Idle)
+    , bAutoReconnect(false)
+    , connectionTimer(this)
+    , connectTimeoutTimer(this)
+    , publishedState(Idle)
+    , nMerged(0)
+    , nRefused(0)
+    , nAttempts(0)
+    , discoveryRetry(FIRST_DISCOVERY_RETRY)
+    , bRetryLastServer(false)
+    , bDirectAttempt(false)
+{
+    // The interfaces are enumerated in a thread of its own, started
+    // by the first discovery
+    pNetworkMonitor = new NetworkMonitor(this);
+    connect(pNetworkMonitor, SIGNAL(onlineChanged(bool)),
+            this, SLOT(onOnlineStateChanged(bool)));
+
+    // Creating a periodic Server Discovery Service
+    pServerDiscoverer = new ServerDiscoverer(logFile, this);
+    connect(pServerDiscoverer, SIGNAL(serverFound(QString)),
+            this, SLOT(onServerFound(QString)));
+
+    // The transport is reused for every connection to the same kind of URL
+    pSocket = Transport::create(QUrl(QString("ws://")), pTlsPolicy, this);
+    // Pings only an idle link and times out according to the RTT
+    pLiveness = new LivenessDetector(logFile, this);
+    attachPrimary();
+
+    // Looks for a standby server while none is connected
+    standbyRetryTimer.setSingleShot(true);
+    connect(&standbyRetryTimer, SIGNAL(timeout()),
+            this, SLOT(onTimeToFindStandby()));
+
+    // This timer allow retrying connection attempts
+    connect(&connectionTimer, SIGNAL(timeout()),
+            this, SLOT(onConnectionTimerElapsed()));
+
+    // This timer bounds the time spent in the Connecting state
+    connectTimeoutTimer.setSingleShot(true);
+    connect(&connectTimeoutTimer, SIGNAL(timeout()),
+            this, SLOT(onConnectTimeout()));
+
+    stateClock.start();
+}
+
+
+ConnectionManager::~ConnectionManager() {
+    disconnect(pSocket, 0, this, 0);
+    pSocket->abort();
+    if(pStandby) {
+        disconnect(pStandby, 0, this, 0);
+        pStandby->abort();
+    }
+    LOG_DEBUG(logFile, "%1", transitionSummary());
+}
+
+
+QString
+ConnectionManager::stateName(State aState) {
+    switch(aState) {
+    case Idle:        return QString("Idle");
+    case Discovering: return QString("Discovering");
+    case Connecting:  return QString("Connecting");
+    case Connected:   return QString("Connected");
+    case Draining:    return QString("Draining");
+    }
+    return QString("Unknown");
+}
+
+
+// The primary and the standby sockets exchange their roles on failover
+void
+ConnectionManager::attachPrimary() {
+    disconnect(pSocket, 0, this, 0);
+    disconnect(pSocket, 0, pLiveness, 0);
+    disconnect(pLiveness, 0, this, 0);
+    connect(pSocket, SIGNAL(connected()),
+            this, SLOT(onSocketConnected()));
+    connect(pSocket, SIGNAL(disconnected()),
+            this, SLOT(onSocketDisconnected()));
+    connect(pSocket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(onSocketError(QAbstractSocket::SocketError)));
+    connect(pSocket, SIGNAL(textMessageReceived(QString)),
+            this, SLOT(onSocketTextMessage(QString)));
+    connect(pSocket, SIGNAL(binaryMessageReceived(QByteArray)),
+            this, SLOT(onSocketBinaryMessage(QByteArray)));
+    connect(pSocket, SIGNAL(pong(quint64,QByteArray)),
+            pLiveness, SLOT(pongReceived()));
+    connect(pLiveness, SIGNAL(pingDue()),
+            this, SLOT(onTimeToPing()));
+    connect(pLiveness, SIGNAL(linkDead()),
+            this, SLOT(onLinkDead()));
+    pLiveness->setIdlePeriod(PRIMARY_IDLE_PERIOD);
+}
+
+
+void
+ConnectionManager::attachStandby() {
+    disconnect(pStandby, 0, this, 0);
+    disconnect(pStandby, 0, pStandbyLiveness, 0);
+    disconnect(pStandbyLiveness, 0, this, 0);
+    connect(pStandby, SIGNAL(connected()),
+            this, SLOT(onStandbyConnected()));
+    connect(pStandby, SIGNAL(disconnected()),
+            this, SLOT(onStandbyLost()));
+    connect(pStandby, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(onStandbyError(QAbstractSocket::SocketError)));
+    // Whatever the standby server sends only proves it alive
+    connect(pStandby, SIGNAL(textMessageReceived(QString)),
+            pStandbyLiveness, SLOT(frameReceived()));
+    connect(pStandby, SIGNAL(binaryMessageReceived(QByteArray)),
+            pStandbyLiveness, SLOT(frameReceived()));
+    connect(pStandby, SIGNAL(pong(quint64,QByteArray)),
+            pStandbyLiveness, SLOT(pongReceived()));
+    connect(pStandbyLiveness, SIGNAL(pingDue()),
+            this, SLOT(onTimeToPingStandby()));
+    connect(pStandbyLiveness, SIGNAL(linkDead()),
+            this, SLOT(onStandbyLost()));
+    pStandbyLiveness->setIdlePeriod(STANDBY_IDLE_PERIOD);
+}
+
+
+ConnectionManager::State
+ConnectionManager::state() const {
+    QMutexLocker locker(&publishedMutex);
+    return publishedState;
+}
+
+
+QString
+ConnectionManager::serverUrl() const {
+    QMutexLocker locker(&publishedMutex);
+    return sPublishedUrl;
+}
+
+
+QHostAddress
+ConnectionManager::peerAddress() const {
+    QMutexLocker locker(&publishedMutex);
+    return publishedPeer;
+}
+
+
+// Called after every change of the state or of the server
+void
+ConnectionManager::publish() {
+    QMutexLocker locker(&publishedMutex);
+    publishedState = currentState;
+    sPublishedUrl  = sServerUrl;
+    publishedPeer  = currentState == Connected ? pSocket->peerAddress() : QHostAddress();
+}
+
+
+qint64
+ConnectionManager::sendTextMessage(const QString &sMessage) {
+    // Written by the thread of the socket, the caller waits for it
+    if(QThread::currentThread() != thread()) {
+        qint64 bytesSent = -1;
+        QMetaObject::invokeMethod(this, "sendTextMessage", Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(qint64, bytesSent),
+                                  Q_ARG(QString, sMessage));
+        return bytesSent;
+    }
+    static MetricCounter& messagesOut = Metrics::counter("tremote_messages_sent_total",
+                                                         "Text messages sent to the server");
+    static MetricCounter& bytesOut = Metrics::counter("tremote_bytes_sent_total",
+                                                      "Bytes sent to the server");
+    static MetricCounter& sendFailures = Metrics::counter("tremote_send_failures_total",
+                                                          "Messages not entirely written to the socket");
+    if(currentState != Connected) {
+        sendFailures.inc();
+        return -1;
+    }
+    qint64 bytesSent = pSocket->sendTextMessage(sMessage);
+    messagesOut.inc();
+    bytesOut.inc(quint64(qMax(bytesSent, qint64(0))));
+    if(bytesSent != sMessage.length())
+        sendFailures.inc();
+    return bytesSent;
+}
+
+
+void
+ConnectionManager::onSocketTextMessage(const QString &sMessage) {
+    static MetricCounter& messagesIn = Metrics::counter("tremote_messages_received_total",
+                                                        "Messages received from the server");
+    static MetricCounter& bytesIn = Metrics::counter("tremote_bytes_received_total",
+                                                     "Bytes received from the server");
+    messagesIn.inc();
+    bytesIn.inc(utf8Size(sMessage));
+    pLiveness->frameReceived();
+    if(failoverClock.isValid()) {
+        static MetricHistogram& failoverSeconds = Metrics::histogram("tremote_failover_seconds",
+                                                                     "Time from primary failure to the first message of the standby");
+        failoverSeconds.observe(failoverClock.nsecsElapsed());
+        LOG_INFO(logFile,
+                 "Control restored %1 ms after the failover",
+                 QString::number(double(failoverClock.nsecsElapsed())/1.0e6, 'f', 1));
+        failoverClock.invalidate();
+    }
+    emit textMessageReceived(sMessage);
+}
+
+
+void
+ConnectionManager::onSocketBinaryMessage(const QByteArray &baMessage) {
+    static MetricCounter& messagesIn = Metrics::counter("tremote_messages_received_total",
+                                                        "Messages received from the server");
+    static MetricCounter& bytesIn = Metrics::counter("tremote_bytes_received_total",
+                                                     "Bytes received from the server");
+    messagesIn.inc();
+    bytesIn.inc(quint64(baMessage.size()));
+    pLiveness->frameReceived();
+    emit binaryMessageReceived(baMessage);
+}
+
+
+QString
+ConnectionManager::transitionSummary() const {
+    QString sSummary;
+    for(int i=0; i<nStates; i++) {
+        sSummary += QString("%1: %2 - ")
+                    .arg(stateName(State(i)))
+                    .arg(dwellTime[i].summary());
+    }
+    sSummary += QString("Reconnect: %1 - Merged requests: %2 - Refused requests: %3")
+                .arg(reconnectTime.summary())
+                .arg(nMerged)
+                .arg(nRefused);
+    return sSummary;
+}
+
+
+void
+ConnectionManager::setState(State newState) {
+    if(newState == currentState)
+        return;
+    qint64 dwell = stateClock.nsecsElapsed();
+    dwellTime[currentState].add(dwell);
+    stateClock.restart();
+    LOG_DEBUG(logFile, "State %1 -> %2 after %3 ns", int(currentState), int(newState), dwell);
+    currentState = newState;
+    publish();
+    static const char *stateNames[nStates] = {
+        "Idle", "Discovering", "Connecting", "Connected", "Draining"
+    };
+    TRACE_INSTANT(stateNames[newState], "state");
+    static MetricGauge& stateGauge = Metrics::gauge("tremote_connection_state",
+                                                    "0 Idle, 1 Discovering, 2 Connecting, 3 Connected, 4 Draining");
+    stateGauge.set(double(newState));
+    emit stateChanged(newState);
+}
+
+
+void
+ConnectionManager::startDiscovery() {
+    if(QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "startDiscovery", Qt::BlockingQueuedConnection);
+        return;
+    }
+    bAutoReconnect = true;
+    if(currentState == Connecting || currentState == Connected) {
+        nRefused++;
+        LOG_DEBUG(logFile, "Refused: already %1", stateName(currentState));
+        return;
+    }
+    if(currentState == Draining) {
+        // Discovery will restart as soon as the socket is released
+        sNextUrl.clear();
+        nMerged++;
+        return;
+    }
+    if(!workflowClock.isValid())
+        workflowClock.start();
+    discoveryRetry = FIRST_DISCOVERY_RETRY;
+    setState(Discovering);
+    discover();
+}
+
+
+// Where the network monitor reads the interfaces: tools replace
+// QNetworkInterface to fake outages. Only before the first discovery.
+void
+ConnectionManager::setInterfaceSource(NetworkMonitor::InterfaceSource source) {
+    pNetworkMonitor->setInterfaceSource(source);
+}
+
+
+// Where the discovery requests are sent: tools/netimpair relays them
+void
+ConnectionManager::setDiscoveryPort(quint16 port) {
+    pServerDiscoverer->setDiscoveryPort(port);
+}
+
+
+void
+ConnectionManager::discover() {
+    pNetworkMonitor->start();
+    // Is the network available ?
+    if(pNetworkMonitor->isOnline()) {// Yes. Start the Connection Attempts
+        pServerDiscoverer->Discover(pNetworkMonitor->interfaces());
+        // Lost datagrams are retried soon, silent networks less and less often
+        int connectionTime = int(discoveryRetry * (1.0 + 0.5*(double(qrand())/double(RAND_MAX))));
+        connectionTimer.start(scaledMs(connectionTime));
+        discoveryRetry = qMin(2*discoveryRetry, CONNECTION_TIME);
+    }
+    else {// No. Resumed by onOnlineStateChanged()
+        connectionTimer.stop();
+        LOG_DEBUG(logFile, "Waiting for network...");
+    }
+}
+
+
+// Reported by the monitor thread as soon as a scan sees the network
+// come or go: a discovery waiting for it starts at once
+void
+ConnectionManager::onOnlineStateChanged(bool bOnline) {
+    LOG_DEBUG(logFile, "Network available: %1", bOnline ? "true" : "false");
+    emit networkStatus(bOnline);
+    if(bOnline && currentState == Discovering && !connectionTimer.isActive()) {
+        discoveryRetry = FIRST_DISCOVERY_RETRY;
+        discover();
+    }
+}
+
+
+void
+ConnectionManager::onConnectionTimerElapsed() {
+    if(currentState != Discovering) {
+        connectionTimer.stop();
+        return;
+    }
+    LOG_DEBUG(logFile, "Connection time out... retrying");
+    discover();
+}
+
+
+void
+ConnectionManager::onServerFound(QString sUrl) {
+    TRACE_INSTANT("serverFound", "discovery");
+    // A different server may become the hot standby: not another
+    // address of the primary one, which would give no redundancy
+    if(bHotStandby &&
+       (currentState == Connecting || currentState == Connected) &&
+       !isPrimaryServer(sUrl) &&
+       sStandbyUrl.isEmpty())
+    {
+        if(currentState == Connected)
+            openStandby(sUrl);
+        else
+            sStandbyCandidate = sUrl;
+        return;
+    }
+    // Only acted upon while discovering: the discovery sockets outlive
+    // the rounds and a late answer must not reconnect a client that
+    // the operator has disconnected meanwhile. Many interfaces may
+    // answer the same discovery: the first one ends it.
+    if(currentState != Discovering) {
+        LOG_DEBUG(logFile, "Ignored %1 found while %2", sUrl, stateName(currentState));
+        return;
+    }
+    connectToServer(sUrl);
+}
+
+
+bool
+ConnectionManager::connectToServer(QString sUrl) {
+    if(QThread::currentThread() != thread()) {
+        bool bAccepted = false;
+        QMetaObject::invokeMethod(this, "connectToServer", Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(bool, bAccepted),
+                                  Q_ARG(QString, sUrl));
+        return bAccepted;
+    }
+    bAutoReconnect = true;
+    if(currentState == Connecting || currentState == Connected) {
+        if(isPrimaryServer(sUrl)) {
+            nMerged++;
+            return true;
+        }
+        nRefused++;
+        LOG_INFO(logFile,
+                 "Refused %1: already %2 to %3",
+                 sUrl,
+                 stateName(currentState),
+                 sServerUrl);
+        return false;
+    }
+    if(currentState == Draining) {
+        // The most recent request wins
+        sNextUrl = sUrl;
+        nMerged++;
+        return true;
+    }
+    connectionTimer.stop();
+    sServerUrl = sUrl;
+    if(!workflowClock.isValid())
+        workflowClock.start();
+    setState(Connecting);
+    connectTimeoutTimer.start(scaledMs(bDirectAttempt ? LAST_SERVER_TIMEOUT : CONNECT_TIMEOUT));
+    nAttempts++;
+    static MetricCounter& connectAttempts = Metrics::counter("tremote_connect_attempts_total",
+                                                             "Connection attempts");
+    connectAttempts.inc();
+    TRACE_ASYNC_BEGIN("connect", "socket", nAttempts);
+    TRACE_SPAN("socket open", "socket");
+    connectClock.start();
+    if(Transport::kindOf(QUrl(sServerUrl)) != pSocket->kind()) {
+        disconnect(pSocket, 0, this, 0);
+        disconnect(pSocket, 0, pLiveness, 0);
+        pSocket->deleteLater();
+        pSocket = Transport::create(QUrl(sServerUrl), pTlsPolicy, this);
+        attachPrimary();
+    }
+    pSocket->open(QUrl(sServerUrl));
+    return true;
+}
+
+
+void
+ConnectionManager::disconnectFromServer() {
+    if(QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "disconnectFromServer", Qt::BlockingQueuedConnection);
+        return;
+    }
+    bAutoReconnect   = false;
+    bRetryLastServer = false;
+    workflowClock.invalidate();
+    closeStandby();
+    sNextUrl.clear();
+    connectionTimer.stop();
+    if(currentState == Connecting || currentState == Connected)
+        drain();
+    else if(currentState == Discovering)
+        setState(Idle);
+}
+
+
+void
+ConnectionManager::onSocketConnected() {
+    if(currentState != Connecting)
+        return;
+    connectTimeoutTimer.stop();
+    static MetricHistogram& connectSeconds = Metrics::histogram("tremote_connect_seconds",
+                                                                "Time to open the socket, TLS handshake included");
+    connectSeconds.observe(connectClock.nsecsElapsed());
+    static MetricHistogram& workflowSeconds = Metrics::histogram("tremote_connect_workflow_seconds",
+                                                                 "Time from a connection request to the connection, discovery included");
+    workflowSeconds.observe(workflowClock.nsecsElapsed());
+    workflowClock.invalidate();
+    bDirectAttempt = false;
+    if(outageClock.isValid()) {
+        static MetricCounter& reconnects = Metrics::counter("tremote_reconnects_total",
+                                                            "Connections restored after an outage");
+        static MetricHistogram& reconnectSeconds = Metrics::histogram("tremote_reconnect_seconds",
+                                                                      "Time from connection loss to reconnection");
+        reconnects.inc();
+        reconnectSeconds.observe(outageClock.nsecsElapsed());
+        reconnectTime.add(outageClock.nsecsElapsed());
+        LOG_DEBUG(logFile,
+                  "Reconnected after %1 ms",
+                  QString::number(double(outageClock.nsecsElapsed())/1.0e6, 'f', 1));
+        outageClock.invalidate();
+    }
+    TRACE_ASYNC_END("connect", "socket", nAttempts);
+    setState(Connected);
+    pLiveness->start();
+    emit connected();
+    if(bHotStandby)
+        findStandby();
+}
+
+
+void
+ConnectionManager::onSocketDisconnected() {
+    if(currentState == Connecting || currentState == Connected)
+        drain();
+}
+
+
+void
+ConnectionManager::onSocketError(QAbstractSocket::SocketError error) {
+    LOG_WARNING(logFile, "%1 %2 Error %3", sServerUrl, pSocket->errorString(), error);
+    if(currentState == Connecting || currentState == Connected)
+        drain();
+}
+
+
+void
+ConnectionManager::onTimeToPing() {
+    if(currentState == Connected)
+        pSocket->ping();
+}
+
+
+void
+ConnectionManager::onLinkDead() {
+    LOG_WARNING(logFile, "%1 is not answering. Disconnecting !", sServerUrl);
+    if(currentState == Connected)
+        drain();
+}
+
+
+void
+ConnectionManager::setSecure(bool bEnable) {
+    bSecure = bEnable;
+    pServerDiscoverer->setScheme(scheme());
+}
+
+
+void
+ConnectionManager::onConnectTimeout() {
+    LOG_WARNING(logFile, "Unable to connect to %1", sServerUrl);
+    if(currentState == Connecting)
+        drain();
+}
+
+
+// Releases the socket. The next state is chosen in a queued call
+// so that a single failure, reported both as an error and as a
+// disconnection, is handled only once.
+void
+ConnectionManager::drain() {
+    if(currentState == Connected && bStandbyReady) {
+        failover();
+        return;
+    }
+    closeStandby();
+    bool bWasConnected = (currentState == Connected);
+    if(currentState == Connecting)
+        TRACE_ASYNC_END("connect", "socket", nAttempts);
+    connectTimeoutTimer.stop();
+    pLiveness->stop();
+    if(bWasConnected)
+        outageClock.start();
+    // A lost server is likely to come back at the same address
+    bRetryLastServer = bWasConnected && bAutoReconnect;
+    bDirectAttempt   = false;
+    setState(Draining);
+    if(bWasConnected)
+        emit disconnected();
+    pSocket->abort();
+    QMetaObject::invokeMethod(this, "onDrained", Qt::QueuedConnection);
+}
+
+
+void
+ConnectionManager::onDrained() {
+    if(currentState != Draining)
+        return;
+    setState(Idle);
+    if(!sNextUrl.isEmpty()) {
+        QString sUrl = sNextUrl;
+        sNextUrl.clear();
+        connectToServer(sUrl);
+    }
+    else if(bRetryLastServer) {
+        bRetryLastServer = false;
+        bDirectAttempt   = true;
+        LOG_DEBUG(logFile, "Retrying %1 before a new discovery", sServerUrl);
+        connectToServer(sServerUrl);
+    }
+    else if(bAutoReconnect) {
+        startDiscovery();
+    }
+}
+
+
+bool
+ConnectionManager::isPrimaryServer(const QString &sUrl) const {
+    return sUrl == sServerUrl ||
+           pServerDiscoverer->sameServer(sServerUrl).contains(sUrl);
+}
+
+
+void
+ConnectionManager::setHotStandby(bool bEnable) {
+    bHotStandby = bEnable;
+    if(!bHotStandby)
+        closeStandby();
+    else if(currentState == Connected)
+        findStandby();
+}
+
+
+void
+ConnectionManager::findStandby() {
+    if(!sStandbyUrl.isEmpty())
+        return;
+    if(!sStandbyCandidate.isEmpty() && !isPrimaryServer(sStandbyCandidate)) {
+        QString sUrl = sStandbyCandidate;
+        sStandbyCandidate.clear();
+        openStandby(sUrl);
+        return;
+    }
+    sStandbyCandidate.clear();
+    // The answers are handled by onServerFound()
+    pNetworkMonitor->start();
+    pServerDiscoverer->Discover(pNetworkMonitor->interfaces());
+    standbyRetryTimer.start(scaledMs(STANDBY_RETRY_TIME));
+}
+
+
+void
+ConnectionManager::onTimeToFindStandby() {
+    if(bHotStandby && currentState == Connected)
+        findStandby();
+}
+
+
+void
+ConnectionManager::openStandby(QString sUrl) {
+    if(!pStandbyLiveness)
+        pStandbyLiveness = new LivenessDetector(logFile, this);
+    if(!pStandby || Transport::kindOf(QUrl(sUrl)) != pStandby->kind()) {
+        if(pStandby) {
+            disconnect(pStandby, 0, this, 0);
+            disconnect(pStandby, 0, pStandbyLiveness, 0);
+            pStandby->deleteLater();
+        }
+        pStandby = Transport::create(QUrl(sUrl), pTlsPolicy, this);
+        attachStandby();
+    }
+    standbyRetryTimer.stop();
+    sStandbyUrl   = sUrl;
+    bStandbyReady = false;
+    LOG_INFO(logFile, "Opening standby connection to %1", sStandbyUrl);
+    pStandby->open(QUrl(sStandbyUrl));
+}
+
+
+void
+ConnectionManager::closeStandby() {
+    standbyRetryTimer.stop();
+    sStandbyCandidate.clear();
+    if(!pStandby || sStandbyUrl.isEmpty())
+        return;
+    // Cleared first: the abort may report a disconnection
+    sStandbyUrl.clear();
+    bStandbyReady = false;
+    pStandbyLiveness->stop();
+    pStandby->abort();
+}
+
+
+void
+ConnectionManager::onStandbyConnected() {
+    if(sStandbyUrl.isEmpty()) {
+        pStandby->abort();
+        return;
+    }
+    bStandbyReady = true;
+    pStandbyLiveness->start();
+    LOG_INFO(logFile, "Standby connected to %1", sStandbyUrl);
+}
+
+
+void
+ConnectionManager::onStandbyLost() {
+    if(sStandbyUrl.isEmpty())
+        return;
+    LOG_WARNING(logFile, "Standby connection to %1 lost", sStandbyUrl);
+    closeStandby();
+    if(bHotStandby && currentState == Connected)
+        standbyRetryTimer.start(scaledMs(STANDBY_RETRY_TIME));
+}
+
+
+void
+ConnectionManager::onStandbyError(QAbstractSocket::SocketError error) {
+    LOG_DEBUG(logFile, "%1 %2 Error %3", sStandbyUrl, pStandby->errorString(), error);
+    onStandbyLost();
+}
+
+
+void
+ConnectionManager::onTimeToPingStandby() {
+    if(bStandbyReady)
+        pStandby->ping();
+}
+
+
+// The standby socket becomes the primary without leaving the
+// Connected state: the owner only has to re-apply its setpoints
+void
+ConnectionManager::failover() {
+    TRACE_INSTANT("failover", "socket");
+    static MetricCounter& failovers = Metrics::counter("tremote_failovers_total",
+                                                       "Switches to the standby server");
+    failovers.inc();
+    failoverClock.start();
+    pLiveness->stop();
+    disconnect(pSocket, 0, this, 0);
+    pSocket->abort();
+
+    Transport *pFailed = pSocket;
+    pSocket = pStandby;
+    pStandby = pFailed;
+    LivenessDetector *pFailedLiveness = pLiveness;
+    pLiveness = pStandbyLiveness;
+    pStandbyLiveness = pFailedLiveness;
+    attachPrimary();
+    attachStandby();
+
+    LOG_WARNING(logFile, "Failing over from %1 to %2", sServerUrl, sStandbyUrl);
+    sServerUrl = sStandbyUrl;
+    publish();
+    sStandbyUrl.clear();
+    bStandbyReady = false;
+    pLiveness->start();
+    emit failedOver(sServerUrl);
+    if(bHotStandby)
+        standbyRetryTimer.start(scaledMs(STANDBY_RETRY_TIME));
+}
@@ -0,0 +1,170 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef CONNECTIONMANAGER_H
+#define CONNECTIONMANAGER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QAbstractSocket>
+#include <QMutex>
+
+#include "utility.h"
+#include "tlspolicy.h"
+#include "networkmonitor.h"
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(Transport)
+QT_FORWARD_DECLARE_CLASS(ServerDiscoverer)
+QT_FORWARD_DECLARE_CLASS(LivenessDetector)
+
+
+// Owns the one and only Panel Server transport and drives it through
+// Idle -> Discovering -> Connecting -> Connected -> Draining.
+// Overlapping connection requests are merged or refused, never
+// allowed to open a second link. In hot standby mode a second
+// server, when discovered, is kept connected and takes over as soon
+// as the primary fails.
+// It may be moved to a thread of its own once configured: state(),
+// serverUrl(), peerAddress() and the public slots and send may then
+// be called from any thread, sends and connection requests blocking
+// until the manager has handled them.
+class ConnectionManager : public QObject
+{
+    Q_OBJECT
+public:
+    enum State {
+        Idle,
+        Discovering,
+        Connecting,
+        Connected,
+        Draining
+    };
+    Q_ENUM(State)
+
+    explicit ConnectionManager(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
+    ~ConnectionManager();
+
+    static QString stateName(State aState);
+    // From any thread
+    State        state() const;
+    QString      serverUrl() const;
+    QHostAddress peerAddress() const;
+    Q_INVOKABLE qint64 sendTextMessage(const QString &sMessage);
+    // Before the manager is moved to another thread
+    void         setHotStandby(bool bEnable);
+    void         setSecure(bool bEnable);
+    void         setInterfaceSource(NetworkMonitor::InterfaceSource source);
+    void         setDiscoveryPort(quint16 port);
+    QString      scheme() const { return bSecure ? QString("wss") : QString("ws"); }
+    // From the thread of the manager only
+    QString      standbyUrl() const { return bStandbyReady ? sStandbyUrl : QString(); }
+    QString      transitionSummary() const;
+
+public slots:
+    void startDiscovery();
+    bool connectToServer(QString sUrl);
+    void disconnectFromServer();
+
+signals:
+    void stateChanged(ConnectionManager::State newState);
+    void networkStatus(bool bAvailable);
+    void connected();
+    void disconnected();
+    void failedOver(QString sUrl);
+    void textMessageReceived(QString sMessage);
+    void binaryMessageReceived(QByteArray baMessage);
+
+private slots:
+    void onOnlineStateChanged(bool bOnline);
+    void onConnectionTimerElapsed();
+    void onConnectTimeout();
+    void onServerFound(QString sUrl);
+    void onSocketConnected();
+    void onSocketDisconnected();
+    void onSocketError(QAbstractSocket::SocketError error);
+    void onDrained();
+    void onSocketTextMessage(const QString &sMessage);
+    void onSocketBinaryMessage(const QByteArray &baMessage);
+    void onTimeToPing();
+    void onLinkDead();
+    void onStandbyConnected();
+    void onStandbyLost();
+    void onStandbyError(QAbstractSocket::SocketError error);
+    void onTimeToPingStandby();
+    void onTimeToFindStandby();
+
+private:
+    void discover();
+    void drain();
+    void attachPrimary();
+    void attachStandby();
+    void findStandby();
+    bool isPrimaryServer(const QString &sUrl) const;
+    void openStandby(QString sUrl);
+    void closeStandby();
+    void failover();
+    void setState(State newState);
+    void publish();
+
+private:
+    QFile            *logFile;
+    TlsPolicy        *pTlsPolicy;   // Shared with the group broadcaster
+    bool              bSecure;
+    NetworkMonitor   *pNetworkMonitor;
+    ServerDiscoverer *pServerDiscoverer;
+    Transport        *pSocket;
+    LivenessDetector *pLiveness;
+    Transport        *pStandby;     // Created on first use
+    LivenessDetector *pStandbyLiveness;
+    bool              bHotStandby;
+    bool              bStandbyReady;
+    QString           sStandbyUrl;
+    QString           sStandbyCandidate;
+    QTimer            standbyRetryTimer;
+    QElapsedTimer     failoverClock;
+    State             currentState;
+    QString           sServerUrl;
+    QString           sNextUrl;     // Request arrived while draining
+    bool              bAutoReconnect;
+    QTimer            connectionTimer;
+    QTimer            connectTimeoutTimer;
+    // What the other threads read, updated by publish()
+    mutable QMutex    publishedMutex;
+    State             publishedState;
+    QString           sPublishedUrl;
+    QHostAddress      publishedPeer;
+    // Transition metrics
+    enum { nStates = Draining+1 };
+    QElapsedTimer     stateClock;
+    QElapsedTimer     connectClock;
+    QElapsedTimer     outageClock;
+    TimingStats       dwellTime[nStates];
+    TimingStats       reconnectTime;
+    quint64           nMerged;
+    quint64           nRefused;
+    quint64           nAttempts;   // Identifies the traced connection spans
+    int               discoveryRetry;
+    bool              bRetryLastServer;
+    bool              bDirectAttempt;
+    QElapsedTimer     workflowClock;
+};
+
+#endif // CONNECTIONMANAGER_H
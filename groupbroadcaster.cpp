@@ -0,0 +1,270 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QSettings>
+#include <QUrl>
+
+#include "groupbroadcaster.h"
+#include "transport.h"
+#include "metrics.h"
+
+
+#define GROUP_ACK_TIMEOUT   1000
+#define RECONNECT_TIME      5000
+#define CONNECT_TIMEOUT     30000 // ms before an attempt counts as failed
+
+
+GroupBroadcaster::GroupBroadcaster(QFile *_logFile, QObject *parent)
+    : QObject(parent)
+    , logFile(_logFile)
+    , pTlsPolicy(&TlsPolicy::shared(_logFile))
+    , lastSeq(0)
+    , lastSkewNs(0)
+    , nMembers(0)
+    , nAcked(0)
+{
+    clock.start();
+    ackTimer.setSingleShot(true);
+    connect(&ackTimer, SIGNAL(timeout()),
+            this, SLOT(onAckTimeout()));
+    connect(&reconnectTimer, SIGNAL(timeout()),
+            this, SLOT(onTimeToReconnect()));
+}
+
+
+GroupBroadcaster::~GroupBroadcaster() {
+    QHash<QString, Member>::iterator it;
+    for(it=members.begin(); it!=members.end(); ++it) {
+        disconnect(it.value().pTransport, 0, this, 0);
+        it.value().pTransport->abort();
+    }
+}
+
+
+// Every member is connected as soon as the groups are known
+void
+GroupBroadcaster::loadGroups() {
+    QSettings settings;
+    settings.beginGroup(QString("groups"));
+    QStringList names = settings.childKeys();
+    for(int i=0; i<names.count(); i++) {
+        QStringList urls = settings.value(names.at(i)).toStringList();
+        for(int j=0; j<urls.count(); j++)
+            urls[j] = urls.at(j).trimmed();
+        groups.insert(names.at(i), urls);
+        for(int j=0; j<urls.count(); j++) {
+            QString sUrl = urls.at(j);
+            if(members.contains(sUrl))
+                continue;
+            Member member;
+            member.sUrl       = sUrl;
+            member.pTransport = Transport::create(QUrl(sUrl), pTlsPolicy, this);
+            member.bConnected  = false;
+            member.bConnecting = false;
+            member.openedNs    = 0;
+            member.bPending    = false;
+            member.sentNs      = 0;
+            connect(member.pTransport, SIGNAL(connected()),
+                    this, SLOT(onMemberConnected()));
+            connect(member.pTransport, SIGNAL(disconnected()),
+                    this, SLOT(onMemberDisconnected()));
+            connect(member.pTransport, SIGNAL(error(QAbstractSocket::SocketError)),
+                    this, SLOT(onMemberDisconnected()));
+            connect(member.pTransport, SIGNAL(textMessageReceived(QString)),
+                    this, SLOT(onMemberMessage(QString)));
+            memberUrl.insert(member.pTransport, sUrl);
+            openMember(members.insert(sUrl, member).value());
+        }
+    }
+    settings.endGroup();
+    if(!members.isEmpty())
+        reconnectTimer.start(RECONNECT_TIME);
+    LOG_INFO(logFile, "%1 groups, %2 servers", groups.count(), members.count());
+}
+
+
+void
+GroupBroadcaster::onMemberConnected() {
+    Transport *pTransport = qobject_cast<Transport*>(sender());
+    if(!memberUrl.contains(pTransport))
+        return;
+    Member& member = members[memberUrl.value(pTransport)];
+    member.bConnected  = true;
+    member.bConnecting = false;
+}
+
+
+void
+GroupBroadcaster::onMemberDisconnected() {
+    Transport *pTransport = qobject_cast<Transport*>(sender());
+    if(!memberUrl.contains(pTransport))
+        return;
+    Member& member = members[memberUrl.value(pTransport)];
+    if(member.bConnected)
+        LOG_WARNING(logFile, "Group member %1 lost: %2", member.sUrl, pTransport->errorString());
+    member.bConnected  = false;
+    member.bConnecting = false;
+}
+
+
+void
+GroupBroadcaster::openMember(Member &member) {
+    // abort() may report the end of the previous attempt
+    member.pTransport->abort();
+    member.bConnecting = true;
+    member.openedNs    = clock.nsecsElapsed();
+    member.pTransport->open(QUrl(member.sUrl));
+}
+
+
+// Attempts still in progress are left alone unless hung
+void
+GroupBroadcaster::onTimeToReconnect() {
+    qint64 nowNs = clock.nsecsElapsed();
+    QHash<QString, Member>::iterator it;
+    for(it=members.begin(); it!=members.end(); ++it) {
+        Member& member = it.value();
+        if(member.bConnected)
+            continue;
+        if(member.bConnecting && nowNs-member.openedNs < qint64(CONNECT_TIMEOUT)*1000000)
+            continue;
+        openMember(member);
+    }
+}
+
+
+int
+GroupBroadcaster::connectedMembers(QString sGroup) const {
+    int nConnected = 0;
+    QStringList urls = groups.value(sGroup);
+    for(int i=0; i<urls.count(); i++) {
+        if(members.value(urls.at(i)).bConnected)
+            nConnected++;
+    }
+    return nConnected;
+}
+
+
+// A new command supersedes the acks still awaited for the previous one
+bool
+GroupBroadcaster::apply(QString sGroup, QString sTag, QString sValue) {
+    if(!groups.contains(sGroup))
+        return false;
+    if(!sCurrentGroup.isEmpty())
+        finish();
+    QStringList urls = groups.value(sGroup);
+    QString sMessage = QString("<%1>%2</%1><seq>%3</seq>")
+                       .arg(sTag)
+                       .arg(sValue)
+                       .arg(++lastSeq);
+    // Encoded once per kind of transport, not once per member, and
+    // before the first write so that it does not add to the skew
+    QHash<int, QByteArray> encoded;
+    for(int i=0; i<urls.count(); i++) {
+        const Member& member = members[urls.at(i)];
+        int kind = int(member.pTransport->kind());
+        if(member.bConnected && !encoded.contains(kind))
+            encoded.insert(kind, member.pTransport->encodeText(sMessage));
+    }
+    QList<Transport*> sent;
+    qint64 firstNs = clock.nsecsElapsed();
+    for(int i=0; i<urls.count(); i++) {
+        Member& member = members[urls.at(i)];
+        if(!member.bConnected)
+            continue;
+        member.sentNs = clock.nsecsElapsed();
+        if(member.pTransport->sendEncoded(encoded.value(int(member.pTransport->kind())))) {
+            member.bPending = true;
+            sent.append(member.pTransport);
+        }
+    }
+    for(int i=0; i<sent.count(); i++)
+        sent.at(i)->flush();
+    qint64 skewNs = clock.nsecsElapsed() - firstNs;
+    lastSkewNs = skewNs;
+    static MetricHistogram& sendSkew = Metrics::histogram("tremote_group_send_skew_seconds",
+                                                          "Time from the first write of a group command to the last flush");
+    sendSkew.observe(skewNs);
+    LOG_DEBUG(logFile,
+              "%1 sent to %2/%3 members of %4 with %5 us skew",
+              sMessage,
+              sent.count(),
+              urls.count(),
+              sGroup,
+              double(skewNs)/1000.0);
+    sCurrentGroup = sGroup;
+    nMembers = urls.count();
+    nAcked   = 0;
+    if(sent.isEmpty()) {
+        finish();
+        return false;
+    }
+    ackTimer.start(GROUP_ACK_TIMEOUT);
+    return true;
+}
+
+
+void
+GroupBroadcaster::onMemberMessage(QString sMessage) {
+    Transport *pTransport = qobject_cast<Transport*>(sender());
+    if(!memberUrl.contains(pTransport))
+        return;
+    QString sToken = XML_Parse(sMessage, "ack");
+    if(sToken == QString("NoData") || sToken.toUInt() != lastSeq)
+        return;
+    Member& member = members[memberUrl.value(pTransport)];
+    if(!member.bPending)
+        return;
+    member.bPending = false;
+    qint64 latencyNs = clock.nsecsElapsed() - member.sentNs;
+    static MetricHistogram& memberAck = Metrics::histogram("tremote_group_member_ack_seconds",
+                                                           "Time from a group command to the ack of each member");
+    memberAck.observe(latencyNs);
+    LOG_DEBUG(logFile, "%1 acked in %2 us", member.sUrl, double(latencyNs)/1000.0);
+    nAcked++;
+    bool bAllAcked = true;
+    QStringList urls = groups.value(sCurrentGroup);
+    for(int i=0; i<urls.count(); i++) {
+        if(members.value(urls.at(i)).bPending)
+            bAllAcked = false;
+    }
+    if(bAllAcked)
+        finish();
+}
+
+
+void
+GroupBroadcaster::onAckTimeout() {
+    finish();
+}
+
+
+void
+GroupBroadcaster::finish() {
+    ackTimer.stop();
+    QStringList urls = groups.value(sCurrentGroup);
+    for(int i=0; i<urls.count(); i++) {
+        Member& member = members[urls.at(i)];
+        if(member.bPending)
+            LOG_WARNING(logFile, "%1 did not acknowledge the group command", member.sUrl);
+        member.bPending = false;
+    }
+    QString sGroup = sCurrentGroup;
+    sCurrentGroup.clear();
+    emit groupApplied(sGroup, nAcked, nMembers);
+}
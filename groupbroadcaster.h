@@ -0,0 +1,95 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef GROUPBROADCASTER_H
+#define GROUPBROADCASTER_H
+
+#include <QObject>
+#include <QMap>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include "utility.h"
+#include "tlspolicy.h"
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(Transport)
+
+
+// Applies a command to every Panel Server of a named group at once.
+// Groups are read from the "groups" section of the settings, one key
+// per group holding the list of the member URLs. Every member keeps
+// its own connection; a command is encoded once per transport kind,
+// written to all the members and only then flushed, so that the
+// members receive it as close together as possible. The acks are
+// collected with the latency of each member.
+class GroupBroadcaster : public QObject
+{
+    Q_OBJECT
+public:
+    explicit GroupBroadcaster(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
+    ~GroupBroadcaster();
+
+    void        loadGroups();
+    QStringList groupNames() const { return groups.keys(); }
+    bool        apply(QString sGroup, QString sTag, QString sValue);
+    int         connectedMembers(QString sGroup) const;
+    qint64      lastSendSkewNs() const { return lastSkewNs; }
+
+signals:
+    void groupApplied(QString sGroup, int nAcked, int nMembers);
+
+private slots:
+    void onMemberConnected();
+    void onMemberDisconnected();
+    void onMemberMessage(QString sMessage);
+    void onTimeToReconnect();
+    void onAckTimeout();
+
+private:
+    struct Member {
+        QString    sUrl;
+        Transport *pTransport;
+        bool       bConnected;
+        bool       bConnecting;
+        qint64     openedNs;    // Start of the connection attempt
+        bool       bPending;    // Part of the current broadcast
+        qint64     sentNs;
+    };
+    void finish();
+    void openMember(Member &member);
+
+private:
+    QFile                       *logFile;
+    TlsPolicy                   *pTlsPolicy;   // Shared with the connection manager
+    QMap<QString, QStringList>   groups;
+    QHash<QString, Member>       members;      // Keyed by URL
+    QHash<Transport*, QString>   memberUrl;
+    QTimer                       reconnectTimer;
+    QTimer                       ackTimer;
+    QElapsedTimer                clock;
+    QString                      sCurrentGroup;
+    quint32                      lastSeq;
+    qint64                       lastSkewNs;  // First write to last flush
+    int                          nMembers;
+    int                          nAcked;
+};
+
+#endif // GROUPBROADCASTER_H
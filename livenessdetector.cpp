@@ -0,0 +1,179 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QFile>
+#include <qmath.h>
+#include <cmath>
+
+#include "livenessdetector.h"
+#include "utility.h"
+#include "metrics.h"
+
+
+#define IDLE_PERIOD          1000  // Default ms of silence before a ping
+#define CHECK_PERIOD         100
+#define PHI_THRESHOLD        8.0   // Probability of a false detection 1e-8
+#define RTT_WINDOW           64    // RTT samples kept
+#define INITIAL_RTT          500.0 // ms, assumed until the first pong
+#define MIN_RTT_DEVIATION    20.0  // ms, floor for a jitter free link
+#define MIN_TIMEOUT          500   // ms
+#define MAX_TIMEOUT          30000 // ms
+
+
+LivenessDetector::LivenessDetector(QFile *_logFile, QObject *parent)
+    : QObject(parent)
+    , logFile(_logFile)
+    , idlePeriod(IDLE_PERIOD)
+    , checkTimer(this) // Follows the detector to its thread
+    , bPingPending(false)
+    , nextSample(0)
+    , rttSum(0.0)
+    , rttSumSquares(0.0)
+{
+    rttSamples.reserve(RTT_WINDOW);
+    connect(&checkTimer, SIGNAL(timeout()),
+            this, SLOT(onTimeToCheck()));
+}
+
+
+void
+LivenessDetector::start() {
+    bPingPending = false;
+    lastHeard.start();
+    checkTimer.start(scaledMs(CHECK_PERIOD));
+}
+
+
+void
+LivenessDetector::stop() {
+    checkTimer.stop();
+    bPingPending = false;
+}
+
+
+// Any traffic proves the peer alive: no ping is needed
+void
+LivenessDetector::frameReceived() {
+    lastHeard.restart();
+    bPingPending = false;
+}
+
+
+void
+LivenessDetector::pongReceived() {
+    if(pingClock.isValid()) {
+        addRttSample(double(pingClock.nsecsElapsed())/1.0e6);
+        pingClock.invalidate();
+    }
+    frameReceived();
+}
+
+
+void
+LivenessDetector::addRttSample(double rttMs) {
+    static MetricHistogram& rttSeconds = Metrics::histogram("tremote_ping_rtt_seconds",
+                                                            "Round trip time of the link pings");
+    rttSeconds.observe(qint64(rttMs*1.0e6));
+    if(rttSamples.count() < RTT_WINDOW) {
+        rttSamples.append(rttMs);
+    }
+    else {
+        double oldest = rttSamples.at(nextSample);
+        rttSum        -= oldest;
+        rttSumSquares -= oldest*oldest;
+        rttSamples[nextSample] = rttMs;
+        nextSample = (nextSample+1) % RTT_WINDOW;
+    }
+    rttSum        += rttMs;
+    rttSumSquares += rttMs*rttMs;
+}
+
+
+// phi = -log10(P(a pong arrives later than elapsedMs)) assuming
+// normally distributed round trip times
+double
+LivenessDetector::phiAt(double elapsedMs) const {
+    double mean = INITIAL_RTT;
+    double sd   = INITIAL_RTT/2.0;
+    int n = rttSamples.count();
+    if(n > 0) {
+        mean = rttSum/double(n);
+        double variance = n > 1 ? (rttSumSquares - n*mean*mean)/double(n-1) : 0.0;
+        sd = qSqrt(qMax(variance, 0.0));
+    }
+    sd = qMax(sd, qMax(MIN_RTT_DEVIATION, mean/10.0));
+    double pLater = 0.5*std::erfc((elapsedMs-mean)/(sd*M_SQRT2));
+    if(pLater <= 0.0)
+        return 1.0e3;
+    return -std::log10(pLater);
+}
+
+
+double
+LivenessDetector::phi() const {
+    if(!bPingPending)
+        return 0.0;
+    return phiAt(double(pingClock.nsecsElapsed())/1.0e6);
+}
+
+
+// Time, from the ping, after which the link is declared dead
+qint64
+LivenessDetector::timeoutMs() const {
+    qint64 lo = 0, hi = MAX_TIMEOUT;
+    while(hi-lo > 1) {
+        qint64 mid = (lo+hi)/2;
+        if(phiAt(double(mid)) < PHI_THRESHOLD)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return qBound(qint64(MIN_TIMEOUT), hi, qint64(MAX_TIMEOUT));
+}
+
+
+void
+LivenessDetector::onTimeToCheck() {
+    if(!bPingPending) {
+        if(lastHeard.elapsed() < scaledMs(idlePeriod))
+            return;
+        static MetricCounter& pingsSent = Metrics::counter("tremote_heartbeat_pings_total",
+                                                           "Pings sent after an idle period");
+        pingsSent.inc();
+        bPingPending = true;
+        pingClock.start();
+        emit pingDue();
+        return;
+    }
+    qint64 elapsed = pingClock.elapsed();
+    if(elapsed < scaledMs(MIN_TIMEOUT))
+        return;
+    double currentPhi = phiAt(double(elapsed));
+    if(currentPhi < PHI_THRESHOLD && elapsed < scaledMs(MAX_TIMEOUT))
+        return;
+    static MetricCounter& pongTimeouts = Metrics::counter("tremote_pong_timeouts_total",
+                                                          "Links declared dead for a missing pong");
+    pongTimeouts.inc();
+    LOG_WARNING(logFile,
+                "No answer %1 ms after the ping (phi=%2, %3 RTT samples)",
+                elapsed,
+                currentPhi,
+                rttSamples.count());
+    stop();
+    emit linkDead();
+}
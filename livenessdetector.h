@@ -0,0 +1,75 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef LIVENESSDETECTOR_H
+#define LIVENESSDETECTOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+
+// Decides whether the peer is still alive. Every inbound frame counts
+// as proof of life; a ping is requested only after the link has been
+// idle, and the time allowed for its pong follows the measured round
+// trip times (phi accrual): the link is declared dead when the delay
+// becomes too unlikely given the RTT mean and deviation.
+class LivenessDetector : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LivenessDetector(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
+
+    void   setIdlePeriod(int msec) { idlePeriod = msec; }
+    double phi() const;
+    qint64 timeoutMs() const;
+
+public slots:
+    void start();
+    void stop();
+    void frameReceived();
+    void pongReceived();
+
+signals:
+    void pingDue();
+    void linkDead();
+
+private slots:
+    void onTimeToCheck();
+
+private:
+    double phiAt(double elapsedMs) const;
+    void   addRttSample(double rttMs);
+
+private:
+    QFile         *logFile;
+    int            idlePeriod;    // ms of silence before a ping is sent
+    QTimer         checkTimer;
+    QElapsedTimer  lastHeard;
+    QElapsedTimer  pingClock;
+    bool           bPingPending;
+    QVector<double> rttSamples;  // ms, circular
+    int            nextSample;
+    double         rttSum;
+    double         rttSumSquares;
+};
+
+#endif // LIVENESSDETECTOR_H
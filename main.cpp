@@ -1,15 +1,24 @@
-#include "tremote.h"
-#include <QApplication>
-
-int main(int argc, char *argv[])
-{
-  QApplication a(argc, argv);
-  QCoreApplication::setOrganizationDomain("Gabriele.Salvato");
-  QCoreApplication::setOrganizationName("Gabriele.Salvato");
-  QCoreApplication::setApplicationName("TRemote");
-  QCoreApplication::setApplicationVersion("1.0.0");
-  TRemote w;
-  w.show();
-
-  return a.exec();
-}
+#include "tremote.h"
+#include "utility.h"
+#include "startupprofile.h"
+#include <QApplication>
+
+int main(int argc, char *argv[])
+{
+  StartupProfile::start();
+  QApplication a(argc, argv);
+  QCoreApplication::setOrganizationDomain("Gabriele.Salvato");
+  QCoreApplication::setOrganizationName("Gabriele.Salvato");
+  QCoreApplication::setApplicationName("TRemote");
+  QCoreApplication::setApplicationVersion("1.0.0");
+  StartupProfile::mark("application");
+  int result;
+  {
+    TRemote w;
+    w.show();
+    result = a.exec();
+  }
+  // Flush what is still buffered
+  BinaryLog::close();
+  return result;
+}
@@ -0,0 +1,247 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QMap>
+#include <QMutex>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QSaveFile>
+
+#include "metrics.h"
+#include "utility.h"
+
+
+namespace {
+
+QMap<QByteArray, Metric*>&
+registry() {
+    static QMap<QByteArray, Metric*> metrics;
+    return metrics;
+}
+
+QMutex&
+registryMutex() {
+    static QMutex mutex;
+    return mutex;
+}
+
+template<class T>
+T&
+lookup(const char *name, const char *help) {
+    QMutexLocker locker(&registryMutex());
+    Metric *pMetric = registry().value(QByteArray(name));
+    if(!pMetric) {
+        pMetric = new T(name, help);
+        registry().insert(QByteArray(name), pMetric);
+    }
+    return *static_cast<T*>(pMetric);
+}
+
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// Metric types
+////////////////////////////////////////////////////////////////////////
+
+void
+Metric::renderHeader(QByteArray &out) const {
+    static const char *typeNames[] = { "counter", "gauge", "histogram" };
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + typeNames[type] + "\n";
+}
+
+
+void
+MetricCounter::render(QByteArray &out) const {
+    renderHeader(out);
+    out += name + " " + QByteArray::number(get()) + "\n";
+}
+
+
+void
+MetricGauge::render(QByteArray &out) const {
+    renderHeader(out);
+    out += name + " " + QByteArray::number(get(), 'g', 10) + "\n";
+}
+
+
+// Seconds
+const double MetricHistogram::bounds[MetricHistogram::nBounds] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+    0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0
+};
+
+
+MetricHistogram::MetricHistogram(const char *_name, const char *_help)
+    : Metric(Histogram, _name, _help)
+    , count(0)
+    , sumNs(0)
+{
+    for(int i=0; i<=nBounds; i++)
+        bucket[i].store(0, std::memory_order_relaxed);
+}
+
+
+void
+MetricHistogram::observe(qint64 durationNs) {
+    double seconds = double(durationNs)*1.0e-9;
+    int i = 0;
+    while(i < nBounds && seconds > bounds[i])
+        i++;
+    bucket[i].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumNs.fetch_add(durationNs, std::memory_order_relaxed);
+}
+
+
+void
+MetricHistogram::render(QByteArray &out) const {
+    renderHeader(out);
+    quint64 cumulative = 0;
+    for(int i=0; i<nBounds; i++) {
+        cumulative += bucket[i].load(std::memory_order_relaxed);
+        out += name + "_bucket{le=\"" + QByteArray::number(bounds[i], 'g', 6) + "\"} "
+             + QByteArray::number(cumulative) + "\n";
+    }
+    cumulative += bucket[nBounds].load(std::memory_order_relaxed);
+    out += name + "_bucket{le=\"+Inf\"} " + QByteArray::number(cumulative) + "\n";
+    out += name + "_sum " + QByteArray::number(double(sumNs.load(std::memory_order_relaxed))*1.0e-9, 'g', 10) + "\n";
+    out += name + "_count " + QByteArray::number(count.load(std::memory_order_relaxed)) + "\n";
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// Metrics
+////////////////////////////////////////////////////////////////////////
+
+MetricCounter&
+Metrics::counter(const char *name, const char *help) {
+    return lookup<MetricCounter>(name, help);
+}
+
+
+MetricGauge&
+Metrics::gauge(const char *name, const char *help) {
+    return lookup<MetricGauge>(name, help);
+}
+
+
+MetricHistogram&
+Metrics::histogram(const char *name, const char *help) {
+    return lookup<MetricHistogram>(name, help);
+}
+
+
+QByteArray
+Metrics::render() {
+    QByteArray out;
+    QMutexLocker locker(&registryMutex());
+    QMap<QByteArray, Metric*>::const_iterator it;
+    for(it=registry().constBegin(); it!=registry().constEnd(); ++it)
+        it.value()->render(out);
+    return out;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// MetricsExporter
+////////////////////////////////////////////////////////////////////////
+
+MetricsExporter::MetricsExporter(QFile *_logFile, QObject *parent)
+    : QObject(parent)
+    , logFile(_logFile)
+    , pServer(Q_NULLPTR)
+{
+    connect(&fileTimer, SIGNAL(timeout()),
+            this, SLOT(onTimeToWriteFile()));
+}
+
+
+// Only the loopback interface is served
+bool
+MetricsExporter::listen(quint16 port) {
+    if(!pServer) {
+        pServer = new QTcpServer(this);
+        connect(pServer, SIGNAL(newConnection()),
+                this, SLOT(onNewConnection()));
+    }
+    if(!pServer->listen(QHostAddress::LocalHost, port)) {
+        LOG_ERROR(logFile,
+                  "Unable to serve metrics on port %1: %2",
+                  port,
+                  pServer->errorString());
+        return false;
+    }
+    LOG_INFO(logFile, "Metrics available at http://127.0.0.1:%1/metrics", port);
+    return true;
+}
+
+
+void
+MetricsExporter::writeFilePeriodically(const QString &sFileName, int msec) {
+    sMetricsFileName = sFileName;
+    fileTimer.start(msec);
+}
+
+
+void
+MetricsExporter::onNewConnection() {
+    while(pServer->hasPendingConnections()) {
+        QTcpSocket *pClient = pServer->nextPendingConnection();
+        connect(pClient, SIGNAL(readyRead()),
+                this, SLOT(onClientReadyRead()));
+        connect(pClient, SIGNAL(disconnected()),
+                pClient, SLOT(deleteLater()));
+    }
+}
+
+
+// Whatever the request, the answer is the metrics page
+void
+MetricsExporter::onClientReadyRead() {
+    QTcpSocket *pClient = qobject_cast<QTcpSocket*>(sender());
+    if(!pClient)
+        return;
+    if(!pClient->canReadLine() && pClient->bytesAvailable() < 4096)
+        return;
+    pClient->readAll();
+    disconnect(pClient, SIGNAL(readyRead()), this, SLOT(onClientReadyRead()));
+    QByteArray body = Metrics::render();
+    QByteArray response = "HTTP/1.0 200 OK\r\n"
+                          "Content-Type: text/plain; version=0.0.4\r\n"
+                          "Connection: close\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "\r\n" + body;
+    pClient->write(response);
+    pClient->disconnectFromHost();
+}
+
+
+// Replaced atomically: a scraper never reads a half written file
+void
+MetricsExporter::onTimeToWriteFile() {
+    QSaveFile file(sMetricsFileName);
+    if(!file.open(QIODevice::WriteOnly)) {
+        LOG_WARNING(logFile, "Unable to open %1: %2", sMetricsFileName, file.errorString());
+        return;
+    }
+    file.write(Metrics::render());
+    if(!file.commit())
+        LOG_WARNING(logFile, "Unable to write %1: %2", sMetricsFileName, file.errorString());
+}
@@ -0,0 +1,142 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QTimer>
+#include <atomic>
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(QTcpServer)
+
+
+class Metric
+{
+public:
+    enum Type { Counter, Gauge, Histogram };
+    Metric(Type _type, const char *_name, const char *_help)
+        : type(_type)
+        , name(_name)
+        , help(_help)
+    {
+    }
+    virtual ~Metric() {}
+    virtual void render(QByteArray &out) const = 0;
+
+protected:
+    void renderHeader(QByteArray &out) const;
+
+protected:
+    Type       type;
+    QByteArray name;
+    QByteArray help;
+};
+
+
+class MetricCounter : public Metric
+{
+public:
+    MetricCounter(const char *_name, const char *_help)
+        : Metric(Counter, _name, _help)
+        , value(0)
+    {
+    }
+    void inc(quint64 n=1) { value.fetch_add(n, std::memory_order_relaxed); }
+    quint64 get() const { return value.load(std::memory_order_relaxed); }
+    void render(QByteArray &out) const;
+
+private:
+    std::atomic<quint64> value;
+};
+
+
+class MetricGauge : public Metric
+{
+public:
+    MetricGauge(const char *_name, const char *_help)
+        : Metric(Gauge, _name, _help)
+        , value(0.0)
+    {
+    }
+    void set(double newValue) { value.store(newValue, std::memory_order_relaxed); }
+    double get() const { return value.load(std::memory_order_relaxed); }
+    void render(QByteArray &out) const;
+
+private:
+    std::atomic<double> value;
+};
+
+
+// Durations in ns, exported in seconds over fixed exponential buckets
+class MetricHistogram : public Metric
+{
+public:
+    MetricHistogram(const char *_name, const char *_help);
+    void observe(qint64 durationNs);
+    void render(QByteArray &out) const;
+
+private:
+    enum { nBounds = 17 };
+    static const double bounds[nBounds];
+    std::atomic<quint64> bucket[nBounds+1];
+    std::atomic<quint64> count;
+    std::atomic<qint64>  sumNs;
+};
+
+
+// Process wide registry. Lookups take a lock: callers keep the
+// returned reference (usually in a function static) and update the
+// metric without any locking afterwards.
+class Metrics
+{
+public:
+    static MetricCounter&   counter(const char *name, const char *help);
+    static MetricGauge&     gauge(const char *name, const char *help);
+    static MetricHistogram& histogram(const char *name, const char *help);
+    static QByteArray       render();
+};
+
+
+// Publishes the registry in the Prometheus text format through a
+// local HTTP endpoint and/or a periodically rewritten file.
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsExporter(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
+
+    bool listen(quint16 port);
+    void writeFilePeriodically(const QString &sFileName, int msec);
+
+private slots:
+    void onNewConnection();
+    void onClientReadyRead();
+    void onTimeToWriteFile();
+
+private:
+    QFile      *logFile;
+    QTcpServer *pServer;
+    QTimer      fileTimer;
+    QString     sMetricsFileName;
+};
+
+#endif // METRICS_H
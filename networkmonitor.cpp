@@ -0,0 +1,157 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+#include "networkmonitor.h"
+#include "utility.h"
+#include "metrics.h"
+
+
+#define SCAN_PERIOD 1000 // ms between two enumerations, in the monitor thread
+
+
+NetworkMonitorWorker::NetworkMonitorWorker(InterfaceSource _source, QObject *parent)
+    : QObject(parent)
+    , source(_source)
+    , pScanTimer(Q_NULLPTR)
+    , bScanned(false)
+{
+}
+
+
+// The timer is created here to belong to the monitor thread
+void
+NetworkMonitorWorker::start() {
+    pScanTimer = new QTimer(this);
+    connect(pScanTimer, SIGNAL(timeout()),
+            this, SLOT(scan()));
+    pScanTimer->start(scaledMs(SCAN_PERIOD));
+    scan();
+}
+
+
+void
+NetworkMonitorWorker::scan() {
+    static MetricHistogram& scanSeconds = Metrics::histogram("tremote_network_scan_seconds",
+                                                             "Enumeration of the network interfaces");
+    QElapsedTimer scanClock;
+    scanClock.start();
+    QList<QNetworkInterface> ifaces = source();
+    bool bOnline = false;
+    QString sSignature;
+    for(int i=0; i<ifaces.count(); i++) {
+        const QNetworkInterface &iface = ifaces.at(i);
+        QList<QNetworkAddressEntry> entries = iface.addressEntries();
+        if(iface.flags().testFlag(QNetworkInterface::IsUp) &&
+           iface.flags().testFlag(QNetworkInterface::IsRunning) &&
+           iface.flags().testFlag(QNetworkInterface::CanBroadcast) &&
+          !iface.flags().testFlag(QNetworkInterface::IsLoopBack) &&
+          !entries.isEmpty())
+        {
+            bOnline = true;
+        }
+        sSignature += QString("%1:%2").arg(iface.index()).arg(int(iface.flags()));
+        for(int j=0; j<entries.count(); j++)
+            sSignature += QString(",%1/%2").arg(entries.at(j).ip().toString()).arg(entries.at(j).prefixLength());
+        sSignature += QString(";");
+    }
+    scanSeconds.observe(scanClock.nsecsElapsed());
+    if(bScanned && sSignature == sLastSignature)
+        return;
+    bScanned = true;
+    sLastSignature = sSignature;
+    {
+        QMutexLocker locker(&mutex);
+        lastInterfaces = ifaces;
+    }
+    emit interfacesChanged(bOnline);
+}
+
+
+QList<QNetworkInterface>
+NetworkMonitorWorker::interfaces() const {
+    QMutexLocker locker(&mutex);
+    return lastInterfaces;
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// NetworkMonitor
+////////////////////////////////////////////////////////////////////////
+
+NetworkMonitor::NetworkMonitor(QObject *parent)
+    : QObject(parent)
+    , source(QNetworkInterface::allInterfaces)
+    , pWorker(Q_NULLPTR)
+    , bKnown(false)
+    , bOnline(false)
+{
+}
+
+
+NetworkMonitor::~NetworkMonitor() {
+    monitorThread.quit();
+    monitorThread.wait();
+}
+
+
+void
+NetworkMonitor::setInterfaceSource(InterfaceSource _source) {
+    if(!pWorker)
+        source = _source;
+}
+
+
+// Idempotent: the thread is started on the first discovery only
+void
+NetworkMonitor::start() {
+    if(pWorker)
+        return;
+    pWorker = new NetworkMonitorWorker(source);
+    pWorker->moveToThread(&monitorThread);
+    connect(&monitorThread, SIGNAL(finished()),
+            pWorker, SLOT(deleteLater()));
+    connect(pWorker, SIGNAL(interfacesChanged(bool)),
+            this, SLOT(onInterfacesChanged(bool)));
+    monitorThread.start(QThread::LowPriority);
+    QMetaObject::invokeMethod(pWorker, "start", Qt::QueuedConnection);
+}
+
+
+// A scan without waiting for the period
+void
+NetworkMonitor::checkNow() {
+    if(pWorker)
+        QMetaObject::invokeMethod(pWorker, "scan", Qt::QueuedConnection);
+}
+
+
+// Copied once per change: the discovery reads them every round
+void
+NetworkMonitor::onInterfacesChanged(bool _bOnline) {
+    lastInterfaces = pWorker->interfaces();
+    if(bKnown && _bOnline == bOnline)
+        return;
+    bKnown  = true;
+    bOnline = _bOnline;
+    emit onlineChanged(bOnline);
+}
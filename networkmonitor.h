@@ -0,0 +1,96 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#ifndef NETWORKMONITOR_H
+#define NETWORKMONITOR_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QList>
+#include <QMutex>
+#include <QNetworkInterface>
+
+
+// Lives in the monitor thread: enumerates the interfaces and reports
+// only when something has changed
+class NetworkMonitorWorker : public QObject
+{
+    Q_OBJECT
+public:
+    typedef QList<QNetworkInterface> (*InterfaceSource)();
+
+    explicit NetworkMonitorWorker(InterfaceSource _source, QObject *parent=Q_NULLPTR);
+    // From any thread
+    QList<QNetworkInterface> interfaces() const;
+
+signals:
+    void interfacesChanged(bool bOnline);
+
+public slots:
+    void start();
+    void scan();
+
+private:
+    InterfaceSource source;
+    QTimer         *pScanTimer;
+    bool            bScanned;
+    QString         sLastSignature;
+    mutable QMutex  mutex;
+    QList<QNetworkInterface> lastInterfaces; // Guarded by mutex
+};
+
+
+// The network interfaces as last seen from a thread of its own: the
+// enumeration (getifaddrs() plus an ioctl per interface) must not
+// stall the GUI thread (QTBUG-40332). onlineChanged() is emitted as
+// soon as a scan sees the network come or go; the first scan always
+// reports. The interfaces are read from QNetworkInterface unless
+// another source is set before start().
+class NetworkMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    typedef NetworkMonitorWorker::InterfaceSource InterfaceSource;
+
+    explicit NetworkMonitor(QObject *parent=Q_NULLPTR);
+    ~NetworkMonitor();
+
+    void setInterfaceSource(InterfaceSource _source);
+    void start();
+    void checkNow();
+    bool isOnline() const { return bOnline; }
+    QList<QNetworkInterface> interfaces() const { return lastInterfaces; }
+
+signals:
+    void onlineChanged(bool bOnline);
+
+private slots:
+    void onInterfacesChanged(bool _bOnline);
+
+private:
+    InterfaceSource          source;
+    QThread                  monitorThread;
+    NetworkMonitorWorker    *pWorker;
+    QList<QNetworkInterface> lastInterfaces;
+    bool                     bKnown;
+    bool                     bOnline;
+};
+
+#endif // NETWORKMONITOR_H
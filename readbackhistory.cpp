@@ -0,0 +1,293 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <qmath.h>
+#include <QFile>
+#include <QTextStream>
+
+#include "readbackhistory.h"
+
+
+#define VALUE_SCALE 100.0 // Readbacks are sent in 1/100 of percent
+
+
+namespace {
+
+void
+appendVarint(QByteArray &out, quint64 value) {
+    while(value >= 0x80) {
+        out.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+
+quint64
+zigzag(qint64 value) {
+    return (quint64(value) << 1) ^ quint64(value >> 63);
+}
+
+
+qint64
+unzigzag(quint64 value) {
+    return qint64(value >> 1) ^ -qint64(value & 1);
+}
+
+
+bool
+readVarint(const QByteArray &in, int *pPos, quint64 *pValue) {
+    quint64 value = 0;
+    for(int shift=0; shift<64; shift+=7) {
+        if(*pPos >= in.size())
+            return false;
+        quint8 b = quint8(in.at((*pPos)++));
+        value |= quint64(b & 0x7f) << shift;
+        if(!(b & 0x80)) {
+            *pValue = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void
+flushRun(QByteArray &out, quint64 &run) {
+    if(run > 0)
+        appendVarint(out, run << 1);
+    run = 0;
+}
+
+
+QByteArray
+encodeChunk(const QVector<HistorySample> &samples, int first, int count, bool bLast) {
+    QByteArray out;
+    out.reserve(16 + 2*count);
+    out.append(char(HistoryCodec::ChunkMarker));
+    out.append(char(bLast ? HistoryCodec::LastChunk : 0));
+    appendVarint(out, count > 0 ? samples.at(first).seq : 0);
+    appendVarint(out, quint64(count));
+    qint64 prevUs = 0, prevDtUs = 0, prevValue = 0;
+    quint64 run = 0;
+    for(int i=first; i<first+count; i++) {
+        qint64 us    = samples.at(i).serverNs/1000;
+        qint64 value = qRound64(samples.at(i).value*VALUE_SCALE);
+        qint64 dtUs  = us - prevUs;
+        qint64 dod   = dtUs - prevDtUs;
+        qint64 dv    = value - prevValue;
+        if(dod == 0 && dv == 0) {
+            run++;
+        }
+        else {
+            flushRun(out, run);
+            appendVarint(out, (zigzag(dv) << 1) | 1);
+            appendVarint(out, zigzag(dod));
+        }
+        prevUs    = us;
+        prevDtUs  = dtUs;
+        prevValue = value;
+    }
+    flushRun(out, run);
+    return out;
+}
+
+}
+
+
+bool
+HistoryCodec::isChunk(const QByteArray &data) {
+    return data.size() >= 2 && data.at(0) == char(ChunkMarker);
+}
+
+
+// Splits on sequence gaps and every MaxChunkSamples samples
+QList<QByteArray>
+HistoryCodec::encode(const QVector<HistorySample> &samples) {
+    QList<QByteArray> chunks;
+    int first = 0;
+    while(first < samples.count()) {
+        int count = 1;
+        while(first+count < samples.count() &&
+              count < MaxChunkSamples &&
+              samples.at(first+count).seq == samples.at(first).seq+quint32(count))
+            count++;
+        chunks.append(encodeChunk(samples, first, count, first+count == samples.count()));
+        first += count;
+    }
+    if(chunks.isEmpty())
+        chunks.append(encodeChunk(samples, 0, 0, true));
+    return chunks;
+}
+
+
+// Appends the samples of the chunk to *pSamples
+bool
+HistoryCodec::decode(const QByteArray &chunk, QVector<HistorySample> *pSamples, bool *pLast) {
+    if(!isChunk(chunk))
+        return false;
+    int pos = 2;
+    quint64 firstSeq, count;
+    if(!readVarint(chunk, &pos, &firstSeq) || !readVarint(chunk, &pos, &count))
+        return false;
+    if(count > MaxChunkSamples)
+        return false;
+    *pLast = (quint8(chunk.at(1)) & LastChunk) != 0;
+    pSamples->reserve(pSamples->count() + int(count));
+    qint64 us = 0, dtUs = 0, value = 0;
+    quint64 run = 0;
+    HistorySample sample;
+    for(quint64 i=0; i<count; i++) {
+        if(run == 0) {
+            quint64 token, dod;
+            if(!readVarint(chunk, &pos, &token))
+                return false;
+            if(token & 1) {
+                if(!readVarint(chunk, &pos, &dod))
+                    return false;
+                value += unzigzag(token >> 1);
+                dtUs  += unzigzag(dod);
+            }
+            else {
+                run = token >> 1;
+                if(run == 0)
+                    return false;
+            }
+        }
+        if(run > 0)
+            run--;
+        us += dtUs;
+        sample.seq      = quint32(firstSeq + i);
+        sample.serverNs = us*1000;
+        sample.value    = double(value)/VALUE_SCALE;
+        pSamples->append(sample);
+    }
+    return run == 0 && pos == chunk.size();
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// ReadbackHistory
+////////////////////////////////////////////////////////////////////////
+
+ReadbackHistory::ReadbackHistory(int _capacity)
+    : capacity(qMax(1, _capacity))
+    , head(0)
+    , nSamples(0)
+{
+}
+
+
+quint32
+ReadbackHistory::lastSeq() const {
+    return nSamples > 0 ? at(nSamples-1).seq : 0;
+}
+
+
+// The buffer capacity is kept: nothing is allocated for the new series
+// unless a copy being saved still shares it
+void
+ReadbackHistory::reset(const QString &_sServer) {
+    sServer  = _sServer;
+    ring.resize(0);
+    head     = 0;
+    nSamples = 0;
+}
+
+
+// Live samples arrive in order: one numbered below the last sample
+// comes from a restarted server
+bool
+ReadbackHistory::isNewRun(const HistorySample &sample) const {
+    return nSamples > 0 && sample.seq < lastSeq();
+}
+
+
+// Appends the series to a CSV file, one line per readback. Run on a
+// copy by a pool thread: the copy shares the samples until the
+// history changes them
+bool
+ReadbackHistory::save(const QString &sFileName) const {
+    QFile file(sFileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        return false;
+    QTextStream out(&file);
+    if(file.size() == 0)
+        out << "server,seq,server_ns,value\n";
+    for(int i=0; i<nSamples; i++) {
+        const HistorySample &sample = at(i);
+        out << sServer << ',' << sample.seq << ','
+            << sample.serverNs << ',' << sample.value << '\n';
+    }
+    out.flush();
+    return out.status() == QTextStream::Ok;
+}
+
+
+// Out of order and repeated live samples are left to the backfill
+void
+ReadbackHistory::append(const HistorySample &sample) {
+    if(nSamples > 0 && sample.seq <= lastSeq())
+        return;
+    if(ring.count() < capacity) {
+        ring.append(sample);
+        nSamples++;
+        return;
+    }
+    ring[(head+nSamples) % capacity] = sample;
+    if(nSamples < capacity)
+        nSamples++;
+    else
+        head = (head+1) % capacity;
+}
+
+
+// Returns the number of samples actually added, whose values are
+// appended to *pAddedValues when given
+int
+ReadbackHistory::merge(const QVector<HistorySample> &backfill, QVector<double> *pAddedValues) {
+    QVector<HistorySample> merged;
+    merged.reserve(nSamples + backfill.count());
+    if(pAddedValues)
+        pAddedValues->reserve(pAddedValues->count() + backfill.count());
+    int i = 0, j = 0, nAdded = 0;
+    while(i < nSamples || j < backfill.count()) {
+        if(j == backfill.count() ||
+           (i < nSamples && at(i).seq <= backfill.at(j).seq))
+        {
+            if(j < backfill.count() && at(i).seq == backfill.at(j).seq)
+                j++;
+            merged.append(at(i++));
+        }
+        else {
+            if(merged.isEmpty() || merged.last().seq < backfill.at(j).seq) {
+                merged.append(backfill.at(j));
+                if(pAddedValues)
+                    pAddedValues->append(backfill.at(j).value);
+                nAdded++;
+            }
+            j++;
+        }
+    }
+    if(merged.count() > capacity)
+        merged.remove(0, merged.count()-capacity);
+    ring     = merged;
+    head     = 0;
+    nSamples = ring.count();
+    return nAdded;
+}
@@ -0,0 +1,92 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef READBACKHISTORY_H
+#define READBACKHISTORY_H
+
+#include <QVector>
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+
+struct HistorySample
+{
+    quint32 seq;      // <hseq> of the readback, assigned by the server
+    qint64  serverNs; // <ts> of the readback
+    double  value;
+};
+
+
+// Binary history chunks, sent by the server in answer to
+// <getHistory>lastSeq</getHistory>:
+//   'H' <flags:u8> <firstSeq:varint> <count:varint> <tokens>
+// The samples of a chunk have consecutive sequence numbers. Times (us)
+// are coded as zig-zag delta of delta, values in 1/100 as zig-zag
+// delta. A token is a varint t:
+//   t even : t/2 samples with both deltas zero (steady readback)
+//   t odd  : one sample, value delta zigzag(t/2), then the time
+//            delta of delta as a zig-zag varint
+// The last chunk of an answer carries the LastChunk flag, possibly with
+// no samples at all.
+class HistoryCodec
+{
+public:
+    enum {
+        ChunkMarker     = 'H',
+        LastChunk       = 0x01,
+        MaxChunkSamples = 65536
+    };
+    static bool              isChunk(const QByteArray &data);
+    static QList<QByteArray> encode(const QVector<HistorySample> &samples);
+    static bool              decode(const QByteArray &chunk,
+                                    QVector<HistorySample> *pSamples,
+                                    bool *pLast);
+};
+
+
+// Time series of the readbacks of one server run, ordered by sequence
+// number. Live samples are appended without allocating once the buffer
+// is full; backfilled ones are merged into the gaps. Another server, or
+// the same one restarted, numbers its readbacks on its own: the series
+// is then saved and reset.
+class ReadbackHistory
+{
+public:
+    explicit ReadbackHistory(int _capacity);
+
+    void    reset(const QString &_sServer);
+    bool    isNewRun(const HistorySample &sample) const;
+    bool    save(const QString &sFileName) const;
+    void    append(const HistorySample &sample);
+    int     merge(const QVector<HistorySample> &backfill, QVector<double> *pAddedValues=Q_NULLPTR);
+    int     count() const { return nSamples; }
+    bool    isEmpty() const { return nSamples == 0; }
+    quint32 lastSeq() const;
+    QString server() const { return sServer; }
+    const HistorySample& at(int i) const { return ring.at((head+i) % ring.count()); }
+
+private:
+    QVector<HistorySample> ring;
+    int                    capacity;
+    int                    head;     // Oldest sample
+    int                    nSamples;
+    QString                sServer;
+};
+
+#endif // READBACKHISTORY_H
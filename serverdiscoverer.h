@@ -1,60 +1,69 @@
-/*
- *
-Copyright (C) 2016  Gabriele Salvato
-
-This program is free software: you can redistribute it and/or modify
-it under the terms of the GNU General Public License as published by
-the Free Software Foundation, either version 3 of the License, or
-(at your option) any later version.
-
-This program is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-GNU General Public License for more details.
-
-You should have received a copy of the GNU General Public License
-along with this program.  If not, see <http://www.gnu.org/licenses/>.
-*
-*/
-#ifndef SERVERDISCOVERER_H
-#define SERVERDISCOVERER_H
-
-#include <QObject>
-#include <QList>
-#include <QVector>
-#include <QHostAddress>
-#include <QSslError>
-
-QT_FORWARD_DECLARE_CLASS(QUdpSocket)
-QT_FORWARD_DECLARE_CLASS(QWebSocket)
-QT_FORWARD_DECLARE_CLASS(QFile)
-
-class ServerDiscoverer : public QObject
-{
-    Q_OBJECT
-public:
-    explicit ServerDiscoverer(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
-
-signals:
-    void serverFound(QString serverUrl);
-
-public slots:
-
-private slots:
-    void onProcessDiscoveryPendingDatagrams();
-    void onDiscoverySocketError(QAbstractSocket::SocketError error);
-
-public:
-    void Discover();
-
-private:
-    QFile               *logFile;
-    QList<QHostAddress>  broadcastAddress;
-    QVector<QUdpSocket*> discoverySocketArray;
-    quint16              discoveryPort;
-    quint16              serverPort;
-    QHostAddress         discoveryAddress;
-    QString              serverUrl;
-};
-
-#endif // SERVERDISCOVERER_H
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef SERVERDISCOVERER_H
+#define SERVERDISCOVERER_H
+
+#include <QObject>
+#include <QList>
+#include <QMap>
+#include <QHash>
+#include <QStringList>
+#include <QHostAddress>
+#include <QSslError>
+#include <QNetworkInterface>
+
+QT_FORWARD_DECLARE_CLASS(QUdpSocket)
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+class ServerDiscoverer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ServerDiscoverer(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
+
+signals:
+    void serverFound(QString serverUrl);
+
+public slots:
+
+private slots:
+    void onProcessDiscoveryPendingDatagrams();
+    void onDiscoverySocketError(QAbstractSocket::SocketError error);
+
+public:
+    void Discover(const QList<QNetworkInterface> &ifaces);
+    void setScheme(QString sNewScheme) { sScheme = sNewScheme; }
+    void setDiscoveryPort(quint16 port) { discoveryPort = port; }
+    // Every URL of the server that announced sUrl: a server answers
+    // with all of its addresses, one per interface
+    QStringList sameServer(const QString &sUrl) const;
+
+private:
+    QFile               *logFile;
+    QList<QHostAddress>  broadcastAddress;
+    QMap<int, QUdpSocket*> discoverySockets; // By interface index
+    quint16              discoveryPort;
+    quint16              serverPort;
+    QHostAddress         discoveryAddress;
+    QString              serverUrl;
+    QString              sScheme;
+    QHash<QString, QStringList> serverAliases; // By announced URL
+};
+
+#endif // SERVERDISCOVERER_H
@@ -0,0 +1,296 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QFile>
+#include <QTimer>
+#include <QTextStream>
+#include <QStringList>
+#include <QRegExp>
+
+#include "setpointramp.h"
+#include "utility.h"
+
+#define RAMP_PERIOD 100 // Default interval (ms) between two setpoints
+
+
+////////////////////////////////////////////////////////////////////////
+// SetpointRampWorker
+////////////////////////////////////////////////////////////////////////
+
+SetpointRampWorker::SetpointRampWorker(const QElapsedTimer *_pClock, QObject *parent)
+    : QObject(parent)
+    , pTickTimer(Q_NULLPTR)
+    , pClock(_pClock)
+    , bRunning(false)
+    , runStartNs(0)
+    , period(qint64(RAMP_PERIOD)*1000000)
+    , nextTickNs(0)
+{
+}
+
+
+void
+SetpointRampWorker::setProfile(const QVector<RampStep> &newProfile, qint64 newPeriod) {
+    profile = newProfile;
+    period  = newPeriod;
+}
+
+
+void
+SetpointRampWorker::start(double startValue) {
+    // The timer must be created in the ramp thread
+    if(!pTickTimer) {
+        pTickTimer = new QTimer(this);
+        pTickTimer->setTimerType(Qt::PreciseTimer);
+        pTickTimer->setSingleShot(true);
+        connect(pTickTimer, SIGNAL(timeout()),
+                this, SLOT(onTick()));
+    }
+    segments.clear();
+    double current = startValue;
+    qint64 t = 0;
+    for(int i=0; i<profile.count(); i++) {
+        const RampStep& step = profile.at(i);
+        Segment segment;
+        segment.startNs    = t;
+        segment.startValue = current;
+        segment.endValue   = current;
+        segment.durationNs = 0;
+        if(step.kind == RampStep::Step) {
+            segment.endValue = step.value;
+        }
+        else if(step.kind == RampStep::Ramp) {
+            segment.endValue   = step.value;
+            segment.durationNs = step.duration;
+        }
+        else {// Hold
+            segment.durationNs = step.duration;
+        }
+        segments.append(segment);
+        current = segment.endValue;
+        t += segment.durationNs;
+    }
+    tickJitter.reset();
+    nextTickNs = 0;
+    runStartNs = pClock->nsecsElapsed();
+    bRunning   = true;
+    armTimer();
+}
+
+
+void
+SetpointRampWorker::stop() {
+    if(!pTickTimer || !bRunning)
+        return;
+    pTickTimer->stop();
+    bRunning = false;
+    emit finished(tickJitter.summary());
+}
+
+
+// Sample the profile at the scheduled time (not at the actual one)
+double
+SetpointRampWorker::valueAt(qint64 tNs, bool *pDone) const {
+    *pDone = true;
+    if(segments.isEmpty())
+        return 0.0;
+    const Segment& last = segments.last();
+    if(tNs >= last.startNs+last.durationNs)
+        return last.endValue;
+    *pDone = false;
+    int i = segments.count()-1;
+    while(i > 0 && segments.at(i).startNs > tNs)
+        i--;
+    const Segment& segment = segments.at(i);
+    if(segment.durationNs <= 0 || tNs >= segment.startNs+segment.durationNs)
+        return segment.endValue;
+    double fraction = double(tNs-segment.startNs) / double(segment.durationNs);
+    return segment.startValue + fraction*(segment.endValue-segment.startValue);
+}
+
+
+void
+SetpointRampWorker::onTick() {
+    qint64 now = pClock->nsecsElapsed() - runStartNs;
+    tickJitter.add(now - nextTickNs);
+    bool bDone;
+    double dValue = valueAt(nextTickNs, &bDone);
+    emit setpointDue(dValue, runStartNs+nextTickNs);
+    if(bDone) {
+        stop();
+        return;
+    }
+    // Stay on the original grid: late ticks are skipped, never bunched
+    nextTickNs += period;
+    while(nextTickNs <= now)
+        nextTickNs += period;
+    armTimer();
+}
+
+
+// Re-armed at every tick against the absolute schedule so that
+// the timer errors do not accumulate along the run
+void
+SetpointRampWorker::armTimer() {
+    qint64 remainingNs = nextTickNs - (pClock->nsecsElapsed()-runStartNs);
+    int msec = remainingNs > 0 ? int((remainingNs+500000)/1000000) : 0;
+    pTickTimer->start(msec);
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// SetpointRamp
+////////////////////////////////////////////////////////////////////////
+
+SetpointRamp::SetpointRamp(QFile *_logFile, QObject *parent)
+    : QObject(parent)
+    , logFile(_logFile)
+    , bRunning(false)
+{
+    // Started before the worker thread and never restarted
+    clock.start();
+    pWorker = new SetpointRampWorker(&clock);
+    pWorker->moveToThread(&rampThread);
+    connect(&rampThread, SIGNAL(finished()),
+            pWorker, SLOT(deleteLater()));
+    connect(pWorker, SIGNAL(setpointDue(double,qint64)),
+            this, SIGNAL(setpointDue(double,qint64)),
+            Qt::DirectConnection);
+    connect(pWorker, SIGNAL(finished(QString)),
+            this, SLOT(onWorkerFinished(QString)));
+    rampThread.start(QThread::TimeCriticalPriority);
+}
+
+
+SetpointRamp::~SetpointRamp() {
+    rampThread.quit();
+    rampThread.wait();
+}
+
+
+// Profile file format (one command per line, '#' starts a comment):
+//   period <ms>          interval between two setpoints
+//   step   <value>       jump to value
+//   ramp   <value> <s>   linear ramp to value in <s> seconds
+//   hold   <s>           keep the current value for <s> seconds
+bool
+SetpointRamp::loadProfile(QString sFileName, QString *pErrorString) {
+    QString sError;
+    QFile profileFile(sFileName);
+    if(bRunning) {
+        sError = tr("A profile is already running");
+    }
+    else if(!profileFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        sError = tr("Unable to open %1: %2").arg(sFileName).arg(profileFile.errorString());
+    }
+    QVector<RampStep> steps;
+    qint64 newPeriod = qint64(RAMP_PERIOD)*1000000;
+    QTextStream in(&profileFile);
+    int nLine = 0;
+    while(sError.isEmpty() && !in.atEnd()) {
+        nLine++;
+        QString sLine = in.readLine();
+        int commentPos = sLine.indexOf('#');
+        if(commentPos >= 0)
+            sLine.truncate(commentPos);
+        QStringList tokens = sLine.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+        if(tokens.isEmpty())
+            continue;
+        QString sCommand = tokens.at(0).toLower();
+        bool ok = true, okValue = true;
+        RampStep step;
+        if(sCommand == QString("period") && tokens.count() == 2) {
+            double msec = tokens.at(1).toDouble(&ok);
+            if(!ok || msec < 1.0) {
+                sError = tr("%1: invalid line %2").arg(sFileName).arg(nLine);
+                break;
+            }
+            newPeriod = qint64(msec*1.0e6);
+            continue;
+        }
+        else if(sCommand == QString("step") && tokens.count() == 2) {
+            step.kind     = RampStep::Step;
+            step.value    = tokens.at(1).toDouble(&okValue);
+            step.duration = 0;
+        }
+        else if(sCommand == QString("ramp") && tokens.count() == 3) {
+            step.kind     = RampStep::Ramp;
+            step.value    = tokens.at(1).toDouble(&okValue);
+            step.duration = qint64(tokens.at(2).toDouble(&ok)*1.0e9);
+        }
+        else if(sCommand == QString("hold") && tokens.count() == 2) {
+            step.kind     = RampStep::Hold;
+            step.value    = 0.0;
+            step.duration = qint64(tokens.at(1).toDouble(&ok)*1.0e9);
+        }
+        else {
+            ok = false;
+        }
+        if(!ok || !okValue || step.value < 0.0 || step.value > 100.0 || step.duration < 0) {
+            sError = tr("%1: invalid line %2").arg(sFileName).arg(nLine);
+            break;
+        }
+        steps.append(step);
+    }
+    if(sError.isEmpty() && steps.isEmpty())
+        sError = tr("%1: empty profile").arg(sFileName);
+    if(!sError.isEmpty()) {
+        LOG_WARNING(logFile, "%1", sError);
+        if(pErrorString)
+            *pErrorString = sError;
+        return false;
+    }
+    pWorker->setProfile(steps, newPeriod);
+    LOG_DEBUG(logFile, "Loaded %1 steps from %2", steps.count(), sFileName);
+    return true;
+}
+
+
+// To be called right after the setpoint has been written to the socket
+void
+SetpointRamp::recordSent(qint64 scheduledNs, qint64 sentNs) {
+    sendJitter.add(sentNs - scheduledNs);
+}
+
+
+void
+SetpointRamp::start(double startValue) {
+    if(bRunning)
+        return;
+    bRunning = true;
+    sendJitter.reset();
+    QMetaObject::invokeMethod(pWorker, "start", Qt::QueuedConnection,
+                              Q_ARG(double, startValue));
+}
+
+
+void
+SetpointRamp::stop() {
+    if(!bRunning)
+        return;
+    QMetaObject::invokeMethod(pWorker, "stop", Qt::QueuedConnection);
+}
+
+
+void
+SetpointRamp::onWorkerFinished(QString sTickJitter) {
+    bRunning = false;
+    LOG_INFO(logFile, "Timer jitter: %1", sTickJitter);
+    LOG_INFO(logFile, "Send jitter: %1", sendJitter.summary());
+    emit finished();
+}
@@ -0,0 +1,128 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef SETPOINTRAMP_H
+#define SETPOINTRAMP_H
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "utility.h"
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+
+// A single line of a profile file
+struct RampStep
+{
+    enum Kind { Step, Ramp, Hold };
+    Kind   kind;
+    double value;    // Target value (Step and Ramp)
+    qint64 duration; // Nanoseconds (Ramp and Hold)
+};
+
+
+// Lives in the ramp thread: owns the precise timer.
+// The setpoints are emitted with their scheduled time on the clock of
+// the SetpointRamp, which is started once and then only read.
+class SetpointRampWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SetpointRampWorker(const QElapsedTimer *_pClock, QObject *parent=Q_NULLPTR);
+
+    // Only to be called while the ramp is not running
+    void setProfile(const QVector<RampStep> &newProfile, qint64 newPeriod);
+
+signals:
+    void setpointDue(double dValue, qint64 scheduledNs);
+    void finished(QString sTickJitter);
+
+public slots:
+    void start(double startValue);
+    void stop();
+
+private slots:
+    void onTick();
+
+private:
+    double valueAt(qint64 tNs, bool *pDone) const;
+    void   armTimer();
+
+private:
+    struct Segment {
+        double startValue;
+        double endValue;
+        qint64 startNs;
+        qint64 durationNs;
+    };
+    QVector<RampStep> profile;
+    QVector<Segment>  segments;
+    QTimer              *pTickTimer;
+    const QElapsedTimer *pClock;
+    bool                 bRunning;
+    qint64               runStartNs; // On pClock
+    qint64               period;
+    qint64               nextTickNs; // Since runStartNs
+    TimingStats          tickJitter;
+};
+
+
+// setpointDue() is emitted in the ramp thread. The owner connects to
+// it with Qt::DirectConnection and sends the setpoint from there
+// through a thread-safe path, so that the GUI load cannot delay it,
+// then reports the time it was written with recordSent().
+class SetpointRamp : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SetpointRamp(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
+    ~SetpointRamp();
+
+    bool    loadProfile(QString sFileName, QString *pErrorString=Q_NULLPTR);
+    bool    isRunning() const { return bRunning; }
+    // Same clock as the scheduled times of setpointDue(): safe to read
+    // from any thread
+    qint64  nowNs() const { return clock.nsecsElapsed(); }
+    // From the ramp thread only
+    void    recordSent(qint64 scheduledNs, qint64 sentNs);
+
+signals:
+    void setpointDue(double dValue, qint64 scheduledNs);
+    void finished();
+
+public slots:
+    void start(double startValue);
+    void stop();
+
+private slots:
+    void onWorkerFinished(QString sTickJitter);
+
+private:
+    QFile              *logFile;
+    QElapsedTimer       clock;
+    QThread             rampThread;
+    SetpointRampWorker *pWorker;
+    TimingStats         sendJitter;
+    bool                bRunning;
+};
+
+#endif // SETPOINTRAMP_H
@@ -0,0 +1,243 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QMetaObject>
+
+#include "stallwatchdog.h"
+#include "utility.h"
+#include "metrics.h"
+
+#if defined(Q_OS_LINUX) && defined(__GLIBC__)
+#define STALL_BACKTRACE
+#include <execinfo.h>
+#include <signal.h>
+#include <pthread.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <cxxabi.h>
+#endif
+
+
+#define HEARTBEAT_PERIOD 50  // ms
+#define CHECK_PERIOD     25  // ms
+#define MAX_FRAMES       64
+#define CAPTURE_TIMEOUT  200 // ms the GUI thread has to run the handler
+#define STALL_SIGNAL     SIGUSR2
+
+
+#ifdef STALL_BACKTRACE
+namespace {
+
+pthread_t         guiThread;
+void             *capturedFrames[MAX_FRAMES];
+std::atomic<int>  nCapturedFrames(-1);
+
+
+// Runs in the GUI thread, wherever it is stuck. backtrace() has been
+// called once beforehand, so it does not need to load libgcc here.
+void
+onStallSignal(int signalNumber) {
+    Q_UNUSED(signalNumber)
+    int savedErrno = errno;
+    nCapturedFrames.store(backtrace(capturedFrames, MAX_FRAMES), std::memory_order_release);
+    errno = savedErrno;
+}
+
+
+// "binary(_ZN7TRemote14PrepareLogFileEv+0x1c) [0x...]" with the
+// symbol demangled when possible
+QString
+frameName(const char *symbol) {
+    QString sFrame = QString::fromLocal8Bit(symbol);
+    int open = sFrame.indexOf(QChar('('));
+    int plus = sFrame.indexOf(QChar('+'), open);
+    if(open < 0 || plus <= open+1)
+        return sFrame;
+    QByteArray mangled = sFrame.mid(open+1, plus-open-1).toLocal8Bit();
+    int status = -1;
+    char *demangled = abi::__cxa_demangle(mangled.constData(), Q_NULLPTR, Q_NULLPTR, &status);
+    if(status != 0 || !demangled)
+        return sFrame;
+    sFrame.replace(open+1, plus-open-1, QString::fromLocal8Bit(demangled));
+    free(demangled);
+    return sFrame;
+}
+
+}
+#endif
+
+
+////////////////////////////////////////////////////////////////////////
+// StallWatchdogWorker
+////////////////////////////////////////////////////////////////////////
+
+StallWatchdogWorker::StallWatchdogWorker(const QElapsedTimer *_pClock,
+                                         const std::atomic<qint64> *_pLastBeatNs,
+                                         QObject *parent)
+    : QObject(parent)
+    , pClock(_pClock)
+    , pLastBeatNs(_pLastBeatNs)
+    , pCheckTimer(Q_NULLPTR)
+    , thresholdNs(0)
+    , bStalled(false)
+    , stallStartNs(0)
+{
+}
+
+
+void
+StallWatchdogWorker::start(int thresholdMs) {
+    thresholdNs = qint64(thresholdMs)*1000000;
+    if(!pCheckTimer) {
+        pCheckTimer = new QTimer(this);
+        connect(pCheckTimer, SIGNAL(timeout()),
+                this, SLOT(onTimeToCheck()));
+    }
+    pCheckTimer->start(CHECK_PERIOD);
+}
+
+
+void
+StallWatchdogWorker::stop() {
+    if(pCheckTimer)
+        pCheckTimer->stop();
+}
+
+
+void
+StallWatchdogWorker::onTimeToCheck() {
+    static MetricGauge& guiLag = Metrics::gauge("tremote_gui_lag_seconds",
+                                                "Age of the last GUI event loop heartbeat");
+    qint64 lastBeat = pLastBeatNs->load(std::memory_order_acquire);
+    if(lastBeat < 0)
+        return;
+    qint64 lagNs = pClock->nsecsElapsed() - lastBeat;
+    guiLag.set(double(lagNs)*1.0e-9);
+    if(!bStalled) {
+        if(lagNs <= thresholdNs)
+            return;
+        bStalled     = true;
+        stallStartNs = lastBeat;
+        sStallStack  = captureGuiStack();
+        return;
+    }
+    if(lagNs > thresholdNs)
+        return;
+    // lastBeat is the first heartbeat after the stall
+    bStalled = false;
+    static MetricCounter& stalls = Metrics::counter("tremote_gui_stalls_total",
+                                                    "GUI event loop stalls over the threshold");
+    static MetricHistogram& stallSeconds = Metrics::histogram("tremote_gui_stall_seconds",
+                                                              "Duration of the GUI event loop stalls");
+    qint64 durationNs = qMax(qint64(0), lastBeat-stallStartNs-qint64(HEARTBEAT_PERIOD)*1000000);
+    stalls.inc();
+    stallSeconds.observe(durationNs);
+    emit stallEnded(durationNs/1000000, sStallStack);
+    sStallStack.clear();
+}
+
+
+QString
+StallWatchdogWorker::captureGuiStack() {
+#ifdef STALL_BACKTRACE
+    nCapturedFrames.store(-1, std::memory_order_relaxed);
+    if(pthread_kill(guiThread, STALL_SIGNAL) != 0)
+        return QString("\n  (unable to signal the GUI thread)");
+    QElapsedTimer waitClock;
+    waitClock.start();
+    while(nCapturedFrames.load(std::memory_order_acquire) < 0) {
+        if(waitClock.elapsed() > CAPTURE_TIMEOUT)
+            return QString("\n  (the GUI thread did not answer: blocked signals?)");
+        QThread::msleep(1);
+    }
+    int nFrames = nCapturedFrames.load(std::memory_order_acquire);
+    char **symbols = backtrace_symbols(capturedFrames, nFrames);
+    if(!symbols)
+        return QString("\n  (no symbols)");
+    QString sStack;
+    // Frame 0 is the handler, frame 1 the signal trampoline
+    for(int i=2; i<nFrames; i++)
+        sStack += QString("\n  #%1 %2").arg(i-2).arg(frameName(symbols[i]));
+    free(symbols);
+    return sStack;
+#else
+    return QString("\n  (stack capture not supported on this platform)");
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// StallWatchdog
+////////////////////////////////////////////////////////////////////////
+
+StallWatchdog::StallWatchdog(QFile *_logFile, QObject *parent)
+    : QObject(parent)
+    , logFile(_logFile)
+    , pWorker(Q_NULLPTR)
+    , lastBeatNs(-1)
+{
+    clock.start();
+    connect(&heartbeatTimer, SIGNAL(timeout()),
+            this, SLOT(onHeartbeat()));
+}
+
+
+StallWatchdog::~StallWatchdog() {
+    heartbeatTimer.stop();
+    watchdogThread.quit();
+    watchdogThread.wait();
+}
+
+
+void
+StallWatchdog::start(int thresholdMs) {
+    if(pWorker)
+        return;
+#ifdef STALL_BACKTRACE
+    guiThread = pthread_self();
+    void *frame;
+    backtrace(&frame, 1);
+    struct sigaction action;
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = onStallSignal;
+    action.sa_flags   = SA_RESTART;
+    sigaction(STALL_SIGNAL, &action, Q_NULLPTR);
+#endif
+    pWorker = new StallWatchdogWorker(&clock, &lastBeatNs);
+    pWorker->moveToThread(&watchdogThread);
+    connect(&watchdogThread, SIGNAL(finished()),
+            pWorker, SLOT(deleteLater()));
+    connect(pWorker, SIGNAL(stallEnded(qint64,QString)),
+            this, SLOT(onStallEnded(qint64,QString)));
+    watchdogThread.start(QThread::HighPriority);
+    QMetaObject::invokeMethod(pWorker, "start", Qt::QueuedConnection, Q_ARG(int, thresholdMs));
+    heartbeatTimer.start(HEARTBEAT_PERIOD);
+    LOG_INFO(logFile, "Watching for GUI stalls over %1 ms", thresholdMs);
+}
+
+
+void
+StallWatchdog::onHeartbeat() {
+    lastBeatNs.store(clock.nsecsElapsed(), std::memory_order_release);
+}
+
+
+void
+StallWatchdog::onStallEnded(qint64 durationMs, QString sStack) {
+    LOG_WARNING(logFile, "GUI event loop stalled for %1 ms in:%2", durationMs, sStack);
+}
@@ -0,0 +1,91 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <atomic>
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+
+// Lives in the watchdog thread: watches the age of the last GUI
+// heartbeat and samples the GUI thread stack when it gets too old
+class StallWatchdogWorker : public QObject
+{
+    Q_OBJECT
+public:
+    StallWatchdogWorker(const QElapsedTimer *_pClock,
+                        const std::atomic<qint64> *_pLastBeatNs,
+                        QObject *parent=Q_NULLPTR);
+
+signals:
+    void stallEnded(qint64 durationMs, QString sStack);
+
+public slots:
+    void start(int thresholdMs);
+    void stop();
+
+private slots:
+    void onTimeToCheck();
+
+private:
+    QString captureGuiStack();
+
+private:
+    const QElapsedTimer       *pClock;
+    const std::atomic<qint64> *pLastBeatNs;
+    QTimer                    *pCheckTimer;
+    qint64                     thresholdNs;
+    bool                       bStalled;
+    qint64                     stallStartNs; // Last heartbeat before the stall
+    QString                    sStallStack;
+};
+
+
+// Reports the GUI event loop stalls longer than a threshold, with
+// their duration and the stack of the GUI thread sampled while it was
+// stuck (Linux/glibc only), in the log and in the metrics.
+class StallWatchdog : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StallWatchdog(QFile *_logFile=Q_NULLPTR, QObject *parent=Q_NULLPTR);
+    ~StallWatchdog();
+
+    // To be called from the GUI thread
+    void start(int thresholdMs);
+
+private slots:
+    void onHeartbeat();
+    void onStallEnded(qint64 durationMs, QString sStack);
+
+private:
+    QFile               *logFile;
+    QThread              watchdogThread;
+    StallWatchdogWorker *pWorker;
+    QTimer               heartbeatTimer;
+    QElapsedTimer        clock;
+    std::atomic<qint64>  lastBeatNs; // -1 until the event loop runs
+};
+
+#endif // STALLWATCHDOG_H
@@ -0,0 +1,96 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QElapsedTimer>
+#include <QVector>
+#include <QStringList>
+#include <string.h>
+
+#include "startupprofile.h"
+#include "metrics.h"
+
+
+namespace {
+
+struct Phase {
+    const char *name;
+    qint64      endNs; // Since main()
+};
+
+QElapsedTimer  startupClock;
+QVector<Phase> phases;
+
+}
+
+
+void
+StartupProfile::start() {
+    phases.clear();
+    startupClock.start();
+}
+
+
+bool
+StartupProfile::isMarked(const char *phase) {
+    for(int i=0; i<phases.count(); i++) {
+        if(strcmp(phases.at(i).name, phase) == 0)
+            return true;
+    }
+    return false;
+}
+
+
+// Only the first occurrence of a phase counts: "connected" and
+// "first_readback" are marked again on every reconnection
+void
+StartupProfile::mark(const char *phase) {
+    if(!startupClock.isValid() || isMarked(phase))
+        return;
+    Phase newPhase;
+    newPhase.name  = phase;
+    newPhase.endNs = startupClock.nsecsElapsed();
+    phases.append(newPhase);
+    QByteArray metricName = QByteArray("tremote_startup_") + phase + "_seconds";
+    Metrics::gauge(metricName.constData(),
+                   "Seconds from the process start to the end of the startup phase")
+            .set(double(newPhase.endNs)*1.0e-9);
+}
+
+
+qint64
+StartupProfile::elapsedMs() {
+    return startupClock.isValid() ? startupClock.elapsed() : qint64(0);
+}
+
+
+// "application 41 ms, construction 18 ms, ... (total 312 ms)"
+QString
+StartupProfile::summary() {
+    QStringList items;
+    qint64 previousNs = 0;
+    for(int i=0; i<phases.count(); i++) {
+        const Phase& phase = phases.at(i);
+        items.append(QString("%1 %2 ms")
+                     .arg(phase.name)
+                     .arg(double(phase.endNs-previousNs)*1.0e-6, 0, 'f', 1));
+        previousNs = phase.endNs;
+    }
+    return QString("%1 (total %2 ms)")
+            .arg(items.join(QString(", ")))
+            .arg(double(previousNs)*1.0e-6, 0, 'f', 1);
+}
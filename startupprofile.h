@@ -0,0 +1,40 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef STARTUPPROFILE_H
+#define STARTUPPROFILE_H
+
+#include <QString>
+
+
+// Time spent in each startup phase, from main() to the first readback.
+// Every phase is marked once, when it ends, and exported as the
+// tremote_startup_<phase>_seconds gauge (seconds since main()), so
+// that a cold start can be compared across releases. To be used from
+// the GUI thread only; phase names must be string literals made of [a-z_].
+class StartupProfile
+{
+public:
+    static void    start();
+    static void    mark(const char *phase);
+    static bool    isMarked(const char *phase);
+    static qint64  elapsedMs();
+    static QString summary();
+};
+
+#endif // STARTUPPROFILE_H
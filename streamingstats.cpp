@@ -0,0 +1,240 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QtMath>
+#include <algorithm>
+#include <limits>
+
+#include "streamingstats.h"
+
+
+namespace {
+
+// Four independent accumulators: no loop carried dependency on a
+// single sum, so the loop pipelines and vectorizes
+void
+sumKernel(const double *values, int n, double *pSum, double *pSumSq) {
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    double q0 = 0.0, q1 = 0.0, q2 = 0.0, q3 = 0.0;
+    int i = 0;
+    for(; i+4<=n; i+=4) {
+        s0 += values[i];   q0 += values[i]*values[i];
+        s1 += values[i+1]; q1 += values[i+1]*values[i+1];
+        s2 += values[i+2]; q2 += values[i+2]*values[i+2];
+        s3 += values[i+3]; q3 += values[i+3]*values[i+3];
+    }
+    for(; i<n; i++) {
+        s0 += values[i];
+        q0 += values[i]*values[i];
+    }
+    *pSum   += (s0+s1) + (s2+s3);
+    *pSumSq += (q0+q1) + (q2+q3);
+}
+
+}
+
+
+StreamingStats::StreamingStats(int windowSize)
+    : capacity(qMax(windowSize, 1))
+{
+    reset();
+}
+
+
+void
+StreamingStats::setWindowSize(int windowSize) {
+    capacity = qMax(windowSize, 1);
+    reset();
+}
+
+
+void
+StreamingStats::reset() {
+    ring.fill(0.0, capacity);
+    nextSeq   = 0;
+    nInWindow = 0;
+    nTotal    = 0;
+    sum       = 0.0;
+    sumSq     = 0.0;
+    nEvicted  = 0;
+    minQueue.seq.fill(0, capacity);
+    minQueue.head = minQueue.size = 0;
+    maxQueue.seq.fill(0, capacity);
+    maxQueue.head = maxQueue.size = 0;
+}
+
+
+// Keeps the queue ordered: the front holds the extreme of the window
+void
+StreamingStats::queuePush(MonotonicQueue &queue, quint64 s, bool bMin) {
+    double value = valueAt(s);
+    while(queue.size > 0) {
+        double back = valueAt(queue.seq.at((queue.head+queue.size-1) % capacity));
+        if(bMin ? back < value : back > value)
+            break;
+        queue.size--;
+    }
+    while(queue.size > 0 && queue.seq.at(queue.head) + quint64(capacity) <= s) {
+        queue.head = (queue.head+1) % capacity;
+        queue.size--;
+    }
+    queue.seq[(queue.head+queue.size) % capacity] = s;
+    queue.size++;
+}
+
+
+// Stores the sample and updates min and max, not the sums
+void
+StreamingStats::push(double value) {
+    ring[int(nextSeq % quint64(capacity))] = value;
+    queuePush(minQueue, nextSeq, true);
+    queuePush(maxQueue, nextSeq, false);
+    nextSeq++;
+    nTotal++;
+    if(nInWindow < capacity)
+        nInWindow++;
+}
+
+
+void
+StreamingStats::add(double value) {
+    if(nInWindow == capacity) {
+        double oldest = valueAt(nextSeq - quint64(capacity));
+        sum   -= oldest;
+        sumSq -= oldest*oldest;
+        nEvicted++;
+    }
+    sum   += value;
+    sumSq += value*value;
+    push(value);
+    // Bounds the rounding errors of the running sums
+    if(nEvicted >= capacity)
+        recompute();
+}
+
+
+void
+StreamingStats::addBatch(const double *values, int nValues) {
+    if(nValues <= 0)
+        return;
+    // Only the last samples of a large frame remain in the window
+    if(nValues >= capacity) {
+        quint64 nSeen = nTotal + quint64(nValues - capacity);
+        values  += nValues - capacity;
+        nValues  = capacity;
+        reset();
+        nTotal   = nSeen;
+    }
+    // Samples leaving the window: up to two contiguous spans of the ring
+    int nOut = qMax(0, nInWindow + nValues - capacity);
+    if(nOut > 0) {
+        int first = int((nextSeq - quint64(nInWindow)) % quint64(capacity));
+        int n1 = qMin(nOut, capacity - first);
+        double outSum = 0.0, outSumSq = 0.0;
+        sumKernel(ring.constData() + first, n1, &outSum, &outSumSq);
+        sumKernel(ring.constData(), nOut - n1, &outSum, &outSumSq);
+        sum   -= outSum;
+        sumSq -= outSumSq;
+        nEvicted += nOut;
+    }
+    sumKernel(values, nValues, &sum, &sumSq);
+    for(int i=0; i<nValues; i++)
+        push(values[i]);
+    if(nEvicted >= capacity)
+        recompute();
+}
+
+
+void
+StreamingStats::recompute() {
+    sum   = 0.0;
+    sumSq = 0.0;
+    if(nInWindow == capacity) {
+        sumKernel(ring.constData(), capacity, &sum, &sumSq);
+    }
+    else {
+        for(int i=0; i<nInWindow; i++) {
+            double value = valueAt(nextSeq - quint64(nInWindow) + quint64(i));
+            sum   += value;
+            sumSq += value*value;
+        }
+    }
+    nEvicted = 0;
+}
+
+
+double
+StreamingStats::mean() const {
+    if(nInWindow == 0)
+        return 0.0;
+    return sum/double(nInWindow);
+}
+
+
+double
+StreamingStats::stdDev() const {
+    if(nInWindow < 2)
+        return 0.0;
+    double m = mean();
+    double variance = (sumSq - double(nInWindow)*m*m)/double(nInWindow-1);
+    return qSqrt(qMax(variance, 0.0));
+}
+
+
+double
+StreamingStats::min() const {
+    if(minQueue.size == 0)
+        return 0.0;
+    return valueAt(minQueue.seq.at(minQueue.head));
+}
+
+
+double
+StreamingStats::max() const {
+    if(maxQueue.size == 0)
+        return 0.0;
+    return valueAt(maxQueue.seq.at(maxQueue.head));
+}
+
+
+// p in [0, 100]
+double
+StreamingStats::percentile(double p) const {
+    if(nInWindow == 0)
+        return 0.0;
+    QVector<double> window(nInWindow);
+    for(int i=0; i<nInWindow; i++)
+        window[i] = valueAt(nextSeq - quint64(nInWindow) + quint64(i));
+    int k = qBound(0, int(qCeil(p/100.0*double(nInWindow)))-1, nInWindow-1);
+    std::nth_element(window.begin(), window.begin()+k, window.end());
+    return window.at(k);
+}
+
+
+QString
+StreamingStats::summary(int precision) const {
+    if(nInWindow == 0)
+        return QString("No Data");
+    return QString("%1 +/- %2 [%3, %4] p50 %5 p95 %6")
+           .arg(mean(), 0, 'f', precision)
+           .arg(stdDev(), 0, 'f', precision)
+           .arg(min(), 0, 'f', precision)
+           .arg(max(), 0, 'f', precision)
+           .arg(percentile(50.0), 0, 'f', precision)
+           .arg(percentile(95.0), 0, 'f', precision);
+}
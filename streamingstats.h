@@ -0,0 +1,76 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef STREAMINGSTATS_H
+#define STREAMINGSTATS_H
+
+#include <QVector>
+#include <QString>
+
+
+// Statistics over the last windowSize samples of a stream.
+// add() is O(1) (amortized for min and max, kept in monotonic
+// queues); addBatch() processes a whole frame with loops the compiler
+// can vectorize. Percentiles are computed on demand, in O(window).
+class StreamingStats
+{
+public:
+    explicit StreamingStats(int windowSize=600);
+
+    void    setWindowSize(int windowSize);
+    int     windowSize() const { return capacity; }
+    void    reset();
+    void    add(double value);
+    void    addBatch(const double *values, int nValues);
+
+    int     count() const { return nInWindow; }
+    quint64 total() const { return nTotal; }
+    double  mean() const;
+    double  stdDev() const;
+    double  min() const;
+    double  max() const;
+    double  percentile(double p) const;
+    QString summary(int precision=2) const;
+
+private:
+    void    push(double value);
+    void    recompute();
+
+private:
+    struct MonotonicQueue {
+        QVector<quint64> seq;  // Circular, sequence numbers of the samples
+        int              head;
+        int              size;
+    };
+    double  valueAt(quint64 s) const { return ring.at(int(s % quint64(capacity))); }
+    void    queuePush(MonotonicQueue &queue, quint64 s, bool bMin);
+
+private:
+    int             capacity;
+    QVector<double> ring;
+    quint64         nextSeq;     // Sequence number of the next sample
+    int             nInWindow;
+    quint64         nTotal;
+    double          sum;
+    double          sumSq;
+    int             nEvicted;    // Since the last exact recomputation
+    MonotonicQueue  minQueue;
+    MonotonicQueue  maxQueue;
+};
+
+#endif // STREAMINGSTATS_H
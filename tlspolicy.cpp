@@ -0,0 +1,181 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QSslSocket>
+#include <QSslConfiguration>
+#include <QSslCertificate>
+#include <QCryptographicHash>
+#include <QSettings>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDir>
+#include <QUrl>
+#include <QMutexLocker>
+
+#include "tlspolicy.h"
+#include "utility.h"
+#include "metrics.h"
+
+
+#define TICKET_LIFETIME  7200 // s, RFC 5077 default
+
+
+TlsPolicy::TlsPolicy(QFile *_logFile)
+    : logFile(_logFile)
+    , bLoaded(false)
+{
+}
+
+
+TlsPolicy&
+TlsPolicy::shared(QFile *_logFile) {
+    static TlsPolicy policy(_logFile);
+    return policy;
+}
+
+
+// Called first by every public member
+void
+TlsPolicy::load() const {
+    QMutexLocker locker(&loadMutex);
+    if(bLoaded)
+        return;
+    bLoaded = true;
+    QSettings settings;
+    QString sPins = settings.value(QString("tlsPins"), QString()).toString();
+    if(qEnvironmentVariableIsSet("TREMOTE_TLS_PIN"))
+        sPins = QString::fromLatin1(qgetenv("TREMOTE_TLS_PIN"));
+    QStringList pinList = sPins.split(QChar(','), QString::SkipEmptyParts);
+    for(int i=0; i<pinList.count(); i++)
+        pins.append(pinList.at(i).trimmed().remove(QChar(':')).toLower());
+    // Tickets stored in clear by the previous versions
+    settings.remove(QString("tlsSessions"));
+
+    sSessionDir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) +
+                  QString("/tlssessions");
+    if(!QDir().mkpath(sSessionDir) ||
+       !QFile::setPermissions(sSessionDir, QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner))
+    {
+        LOG_WARNING(logFile, "Unable to create %1: TLS sessions not kept", sSessionDir);
+        sSessionDir.clear();
+    }
+}
+
+
+QString
+TlsPolicy::sessionFileName(const QUrl &url) const {
+    load();
+    if(sSessionDir.isEmpty())
+        return QString();
+    QString sHost = url.host();
+    sHost.replace(QChar(':'), QChar('_'));// IPv6 addresses
+    return QString("%1/%2_%3").arg(sSessionDir).arg(sHost).arg(url.port(443));
+}
+
+
+// To be called before every connectToHostEncrypted()
+void
+TlsPolicy::prepare(QSslSocket *pSocket, const QUrl &url) const {
+    QSslConfiguration configuration = QSslConfiguration::defaultConfiguration();
+    configuration.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+    configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    QFile file(sessionFileName(url));
+    if(!file.fileName().isEmpty() && file.open(QIODevice::ReadOnly)) {
+        QDataStream stream(&file);
+        qint64 expires;
+        QByteArray ticket;
+        stream >> expires >> ticket;
+        if(stream.status() == QDataStream::Ok && !ticket.isEmpty() &&
+           QDateTime::currentMSecsSinceEpoch()/1000 < expires)
+        {
+            static MetricCounter& resumptions = Metrics::counter("tremote_tls_resumption_attempts_total",
+                                                                 "TLS handshakes offering a cached session");
+            resumptions.inc();
+            configuration.setSessionTicket(ticket);
+        }
+    }
+    pSocket->setSslConfiguration(configuration);
+}
+
+
+// Keeps the session ticket negotiated for the next connection
+void
+TlsPolicy::sessionEstablished(QSslSocket *pSocket, const QUrl &url) const {
+    QSslConfiguration configuration = pSocket->sslConfiguration();
+    QByteArray ticket = configuration.sessionTicket();
+    QString sFileName = sessionFileName(url);
+    if(ticket.isEmpty() || sFileName.isEmpty())
+        return;
+    int lifetime = configuration.sessionTicketLifeTimeHint();
+    if(lifetime <= 0)
+        lifetime = TICKET_LIFETIME;
+    QSaveFile file(sFileName);
+    if(!file.open(QIODevice::WriteOnly) ||
+       !file.setPermissions(QFile::ReadOwner | QFile::WriteOwner))
+    {
+        LOG_WARNING(logFile, "Unable to write %1: %2", sFileName, file.errorString());
+        file.cancelWriting();
+        return;
+    }
+    QDataStream stream(&file);
+    stream << qint64(QDateTime::currentMSecsSinceEpoch()/1000 + lifetime) << ticket;
+    if(!file.commit()) {
+        LOG_WARNING(logFile, "Unable to write %1: %2", sFileName, file.errorString());
+        return;
+    }
+    LOG_DEBUG(logFile,
+              "TLS session cached for %1 (%2, %3 s)",
+              url.host(),
+              int(configuration.sessionProtocol()),
+              lifetime);
+}
+
+
+void
+TlsPolicy::forgetSession(const QUrl &url) const {
+    QString sFileName = sessionFileName(url);
+    if(!sFileName.isEmpty())
+        QFile::remove(sFileName);
+}
+
+
+bool
+TlsPolicy::isPeerPinned(const QSslCertificate &certificate) const {
+    load();
+    if(pins.isEmpty())
+        return true;
+    QString sDigest = QString::fromLatin1(certificate.digest(QCryptographicHash::Sha256).toHex());
+    if(pins.contains(sDigest))
+        return true;
+    LOG_ERROR(logFile, "Server certificate %1 is not pinned", sDigest);
+    return false;
+}
+
+
+// A pinned certificate is trusted even if self signed or expired
+bool
+TlsPolicy::canIgnore(const QSslCertificate &certificate, const QList<QSslError> &errors) const {
+    for(int i=0; i<errors.count(); i++)
+        LOG_WARNING(logFile, "%1", errors.at(i).errorString());
+    load();
+    if(pins.isEmpty() || certificate.isNull())
+        return false;
+    return isPeerPinned(certificate);
+}
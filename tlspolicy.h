@@ -0,0 +1,72 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef TLSPOLICY_H
+#define TLSPOLICY_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QSslError>
+#include <QMutex>
+
+QT_FORWARD_DECLARE_CLASS(QFile)
+QT_FORWARD_DECLARE_CLASS(QUrl)
+QT_FORWARD_DECLARE_CLASS(QSslSocket)
+QT_FORWARD_DECLARE_CLASS(QSslCertificate)
+
+
+// TLS settings applied to the wss:// connections.
+// Session tickets are kept per server so that both a reconnection and
+// a new process resume the previous session instead of paying a full
+// handshake. A ticket holds the session master secret: it is stored
+// in a file readable by its owner only, never in QSettings. When
+// SHA-256 pins of the server certificates are configured (tlsPins
+// setting or TREMOTE_TLS_PIN, comma separated hex digests) only those
+// certificates are accepted, self signed ones included.
+// Nothing is read or created before the first wss:// connection: the
+// pins, the settings cleanup and the session directory are handled
+// then, once, whatever the thread.
+class TlsPolicy
+{
+public:
+    explicit TlsPolicy(QFile *_logFile=Q_NULLPTR);
+
+    // The instance shared by the connection manager and the group
+    // broadcaster. The log file of the first call is kept
+    static TlsPolicy& shared(QFile *_logFile=Q_NULLPTR);
+
+    void prepare(QSslSocket *pSocket, const QUrl &url) const;
+    void sessionEstablished(QSslSocket *pSocket, const QUrl &url) const;
+    void forgetSession(const QUrl &url) const;
+    bool isPeerPinned(const QSslCertificate &certificate) const;
+    bool canIgnore(const QSslCertificate &certificate, const QList<QSslError> &errors) const;
+
+private:
+    void    load() const;
+    QString sessionFileName(const QUrl &url) const;
+
+private:
+    QFile               *logFile;
+    mutable QMutex       loadMutex;
+    mutable bool         bLoaded;
+    mutable QStringList  pins;
+    mutable QString      sSessionDir;
+};
+
+#endif // TLSPOLICY_H
@@ -0,0 +1,173 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QVector>
+
+#include "remoteprobe.h"
+#include "allocstats.h"
+#include "utility.h"
+
+
+#define WARMUP_FRAMES  700000 // Enough numbered readbacks to fill the history ring
+#define BATCH_FRAMES   50000  // Frames built ahead of a run
+
+
+namespace {
+
+// Steady state: the displayed values do not change, the sequence
+// numbers and the times do
+QString
+textFrame(quint32 seq) {
+    qint64 ts = qint64(1500000000)*qint64(1000000000) + qint64(seq)*10000000;
+    switch(seq % 3) {
+    case 0:
+        return QString("<readPercent>42.0</readPercent><hseq>%1</hseq><ts>%2</ts>")
+                .arg(seq).arg(ts);
+    case 1:
+        return QString("<setPercent>42.0</setPercent><readPercent>42.0</readPercent>"
+                       "<hseq>%1</hseq><ts>%2</ts>")
+                .arg(seq).arg(ts);
+    default:
+        return QString("<ack>%1</ack><ts>%2</ts>").arg(seq).arg(ts);
+    }
+}
+
+
+struct Result {
+    quint64 nFrames;
+    quint64 nAllocations;
+    quint64 nAllocatingFrames;
+    quint64 worst;
+    QString sWorstFrame;
+};
+
+
+void
+runText(RemoteProbe &remote, quint32 *pSeq, int nFrames, Result *pResult) {
+    QVector<QString> frames;
+    for(int done=0; done<nFrames; done+=frames.count()) {
+        frames.clear();
+        for(int i=0; i<qMin(BATCH_FRAMES, nFrames-done); i++)
+            frames.append(textFrame((*pSeq)++));
+        for(int i=0; i<frames.count(); i++) {
+            quint64 before = AllocStats::threadAllocations();
+            remote.onTextMessageReceived(frames.at(i));
+            quint64 n = AllocStats::threadAllocations() - before;
+            if(!pResult)
+                continue;
+            pResult->nFrames++;
+            pResult->nAllocations += n;
+            if(n > 0)
+                pResult->nAllocatingFrames++;
+            if(n > pResult->worst) {
+                pResult->worst = n;
+                pResult->sWorstFrame = frames.at(i);
+            }
+        }
+    }
+}
+
+
+void
+runBinary(RemoteProbe &remote, int nFrames, Result *pResult) {
+    // Not a history chunk: only counted and logged at debug level
+    const QByteArray frame("R\x01\x02\x03", 4);
+    for(int i=0; i<nFrames; i++) {
+        quint64 before = AllocStats::threadAllocations();
+        remote.onBinaryMessageReceived(frame);
+        quint64 n = AllocStats::threadAllocations() - before;
+        if(!pResult)
+            continue;
+        pResult->nFrames++;
+        pResult->nAllocations += n;
+        if(n > 0)
+            pResult->nAllocatingFrames++;
+        pResult->worst = qMax(pResult->worst, n);
+    }
+}
+
+
+bool
+report(QTextStream &out, const char *name, const Result &result) {
+    out << QString("  %1 %2 frames, %3 allocations (%4 per frame), %5 frames allocating")
+           .arg(QString(name), -7)
+           .arg(result.nFrames)
+           .arg(result.nAllocations)
+           .arg(double(result.nAllocations)/double(qMax(quint64(1), result.nFrames)), 0, 'f', 3)
+           .arg(result.nAllocatingFrames)
+        << endl;
+    if(result.nAllocatingFrames == 0)
+        return true;
+    out << "    worst: " << result.worst << " allocations";
+    if(!result.sWorstFrame.isEmpty())
+        out << " for " << result.sWorstFrame;
+    out << endl;
+    return false;
+}
+
+}
+
+
+int
+main(int argc, char *argv[]) {
+    // The TRemote window is created but never shown
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Gabriele.Salvato");
+    QCoreApplication::setApplicationName("TRemoteAllocCheck");
+    QCoreApplication::setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Fails if the TRemote receive handlers allocate "
+                                     "on steady-state frames");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption framesOption(QStringList() << "n" << "frames",
+                                    "Frames checked after the warm up (default 100000).",
+                                    "n", "100000");
+    parser.addOption(framesOption);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    if(!AllocStats::isEnabled()) {
+        out << "Built without TREMOTE_ALLOC_STATS" << endl;
+        return 1;
+    }
+    setLogLevel(LogError);
+    int nFrames = qMax(1, parser.value(framesOption).toInt());
+    RemoteProbe remote;
+    quint32 seq = 1;
+
+    // First frames: line edit layouts, history ring, statistics...
+    runText(remote, &seq, WARMUP_FRAMES, Q_NULLPTR);
+    runBinary(remote, 1000, Q_NULLPTR);
+
+    Result text = { 0, 0, 0, 0, QString() };
+    Result binary = { 0, 0, 0, 0, QString() };
+    runText(remote, &seq, nFrames, &text);
+    runBinary(remote, nFrames, &binary);
+    out << "Steady-state allocations:" << endl;
+    bool bTextOk   = report(out, "text", text);
+    bool bBinaryOk = report(out, "binary", binary);
+    out << AllocStats::summary() << endl;
+    return bTextOk && bBinaryOk ? 0 : 1;
+}
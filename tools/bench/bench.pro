@@ -0,0 +1,81 @@
+#-------------------------------------------------
+#
+# Micro and loopback benchmarks of the TRemote
+# client paths (logging, transports, TLS, groups)
+#
+#-------------------------------------------------
+
+
+QT += core
+QT += gui
+QT += network
+QT += concurrent
+QT += websockets
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = bench
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
+SOURCES += logbench.cpp
+SOURCES += tlsbench.cpp
+SOURCES += transportbench.cpp
+SOURCES += groupbench.cpp
+SOURCES += ../../serverdiscoverer.cpp
+SOURCES += ../../utility.cpp
+SOURCES += ../../tremote.cpp
+SOURCES += ../../setpointramp.cpp
+SOURCES += ../../commandtracker.cpp
+SOURCES += ../../connectionmanager.cpp
+SOURCES += ../../networkmonitor.cpp
+SOURCES += ../../binarylog.cpp
+SOURCES += ../../tracer.cpp
+SOURCES += ../../metrics.cpp
+SOURCES += ../../livenessdetector.cpp
+SOURCES += ../../commandjournal.cpp
+SOURCES += ../../tlspolicy.cpp
+SOURCES += ../../transport.cpp
+SOURCES += ../../websocketcodec.cpp
+SOURCES += ../../clocksync.cpp
+SOURCES += ../../groupbroadcaster.cpp
+SOURCES += ../../streamingstats.cpp
+SOURCES += ../../allocstats.cpp
+SOURCES += ../../readbackhistory.cpp
+SOURCES += ../../stallwatchdog.cpp
+SOURCES += ../../startupprofile.cpp
+
+HEADERS += remoteprobe.h
+HEADERS += logbench.h
+HEADERS += tlsbench.h
+HEADERS += transportbench.h
+HEADERS += groupbench.h
+HEADERS += ../../utility.h
+HEADERS += ../../serverdiscoverer.h
+HEADERS += ../../tremote.h
+HEADERS += ../../setpointramp.h
+HEADERS += ../../commandtracker.h
+HEADERS += ../../connectionmanager.h
+HEADERS += ../../networkmonitor.h
+HEADERS += ../../binarylog.h
+HEADERS += ../../tracer.h
+HEADERS += ../../metrics.h
+HEADERS += ../../livenessdetector.h
+HEADERS += ../../commandjournal.h
+HEADERS += ../../tlspolicy.h
+HEADERS += ../../transport.h
+HEADERS += ../../websocketcodec.h
+HEADERS += ../../clocksync.h
+HEADERS += ../../groupbroadcaster.h
+HEADERS += ../../streamingstats.h
+HEADERS += ../../allocstats.h
+HEADERS += ../../readbackhistory.h
+HEADERS += ../../stallwatchdog.h
+HEADERS += ../../startupprofile.h
+
+FORMS   += ../../tremote.ui
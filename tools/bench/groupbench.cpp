@@ -0,0 +1,303 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QWebSocketServer>
+#include <QWebSocket>
+#include <QSettings>
+#include <QThread>
+#include <QVector>
+#include <QtEndian>
+
+#include "groupbench.h"
+#include "groupbroadcaster.h"
+#include "utility.h"
+
+#include <algorithm>
+
+
+#define FRAME_HEADER     5     // As in FramedTransport
+#define TEXT_FRAME       1
+#define CONNECT_TIMEOUT  20000 // ms for all the members to connect
+#define APPLY_TIMEOUT    5000
+#define MAX_SKEW         1000000 // ns, the target for 100 members
+
+
+namespace {
+
+double
+percentile(QVector<qint64> values, double fraction) {
+    if(values.isEmpty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    return double(values.at(qMin(values.count()-1, int(fraction*values.count()))));
+}
+
+
+bool
+waitUntil(const bool *pbDone, int timeout) {
+    QElapsedTimer clock;
+    clock.start();
+    while(!*pbDone && clock.elapsed() < timeout)
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+    return *pbDone;
+}
+
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// GroupServers
+////////////////////////////////////////////////////////////////////////
+
+GroupServers::GroupServers(int _nServers, const QElapsedTimer *_pClock)
+    : nServers(_nServers)
+    , pClock(_pClock)
+{
+}
+
+
+// Runs on the servers thread
+bool
+GroupServers::start() {
+    for(int i=0; i<nServers; i++) {
+        QTcpServer *pTcpServer = new QTcpServer(this);
+        connect(pTcpServer, SIGNAL(newConnection()),
+                this, SLOT(onTcpConnection()));
+        if(!pTcpServer->listen(QHostAddress::LocalHost, 0))
+            return false;
+        tcpServers.append(pTcpServer);
+        tcpServerUrls.append(QString("tcp://127.0.0.1:%1").arg(pTcpServer->serverPort()));
+
+        QWebSocketServer *pWsServer = new QWebSocketServer(QString("TRemote bench"),
+                                                           QWebSocketServer::NonSecureMode,
+                                                           this);
+        connect(pWsServer, SIGNAL(newConnection()),
+                this, SLOT(onWsConnection()));
+        if(!pWsServer->listen(QHostAddress::LocalHost, 0))
+            return false;
+        wsServers.append(pWsServer);
+        wsServerUrls.append(QString("ws://127.0.0.1:%1").arg(pWsServer->serverPort()));
+    }
+    return true;
+}
+
+
+void
+GroupServers::stop() {
+    qDeleteAll(tcpServers);
+    tcpServers.clear();
+    qDeleteAll(wsServers);
+    wsServers.clear();
+}
+
+
+quint32
+GroupServers::received(const QString &sMessage) {
+    qint64 nowNs = pClock->nsecsElapsed();
+    quint32 seq = XML_Parse(sMessage, "seq").toUInt();
+    QMutexLocker locker(&mutex);
+    if(!arrivals.contains(seq)) {
+        Arrival arrival;
+        arrival.firstNs = nowNs;
+        arrival.lastNs  = nowNs;
+        arrival.count   = 0;
+        arrivals.insert(seq, arrival);
+    }
+    Arrival& arrival = arrivals[seq];
+    arrival.firstNs = qMin(arrival.firstNs, nowNs);
+    arrival.lastNs  = qMax(arrival.lastNs, nowNs);
+    arrival.count++;
+    return seq;
+}
+
+
+qint64
+GroupServers::spreadNs(quint32 seq, int *pnReceived) const {
+    QMutexLocker locker(&mutex);
+    Arrival arrival = arrivals.value(seq);
+    *pnReceived = arrivals.contains(seq) ? arrival.count : 0;
+    return arrivals.contains(seq) ? arrival.lastNs-arrival.firstNs : 0;
+}
+
+
+void
+GroupServers::onTcpConnection() {
+    QTcpServer *pTcpServer = qobject_cast<QTcpServer*>(sender());
+    while(pTcpServer->hasPendingConnections()) {
+        QTcpSocket *pSocket = pTcpServer->nextPendingConnection();
+        pSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(pSocket, SIGNAL(readyRead()),
+                this, SLOT(onTcpReadyRead()));
+    }
+}
+
+
+void
+GroupServers::onTcpReadyRead() {
+    QTcpSocket *pSocket = qobject_cast<QTcpSocket*>(sender());
+    QByteArray& inBuffer = inBuffers[pSocket];
+    inBuffer.append(pSocket->readAll());
+    while(inBuffer.size() >= FRAME_HEADER) {
+        const uchar *pHeader = reinterpret_cast<const uchar*>(inBuffer.constData());
+        int length = int(qFromBigEndian<quint32>(pHeader));
+        if(inBuffer.size() < FRAME_HEADER+length)
+            break;
+        QString sMessage = QString::fromUtf8(inBuffer.constData()+FRAME_HEADER, length);
+        bool bText = pHeader[4] == TEXT_FRAME;
+        inBuffer.remove(0, FRAME_HEADER+length);
+        if(!bText)
+            continue;
+        QByteArray ack = QString("<ack>%1</ack>").arg(received(sMessage)).toUtf8();
+        char header[FRAME_HEADER];
+        qToBigEndian(quint32(ack.size()), reinterpret_cast<uchar*>(header));
+        header[4] = char(TEXT_FRAME);
+        pSocket->write(header, FRAME_HEADER);
+        pSocket->write(ack);
+    }
+}
+
+
+void
+GroupServers::onWsConnection() {
+    QWebSocketServer *pWsServer = qobject_cast<QWebSocketServer*>(sender());
+    while(pWsServer->hasPendingConnections()) {
+        QWebSocket *pSocket = pWsServer->nextPendingConnection();
+        connect(pSocket, SIGNAL(textMessageReceived(QString)),
+                this, SLOT(onWsMessage(QString)));
+    }
+}
+
+
+void
+GroupServers::onWsMessage(QString sMessage) {
+    QWebSocket *pSocket = qobject_cast<QWebSocket*>(sender());
+    pSocket->sendTextMessage(QString("<ack>%1</ack>").arg(received(sMessage)));
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// GroupBench
+////////////////////////////////////////////////////////////////////////
+
+GroupBench::GroupBench()
+    : bApplied(false)
+    , nLastAcked(0)
+{
+}
+
+
+void
+GroupBench::onGroupApplied(QString sGroup, int nAcked, int nMembers) {
+    Q_UNUSED(sGroup)
+    Q_UNUSED(nMembers)
+    nLastAcked = nAcked;
+    bApplied   = true;
+}
+
+
+int
+GroupBench::run(QTextStream &out, int nServers, int nRounds) {
+    QElapsedTimer clock;
+    clock.start();
+    QThread serverThread;
+    GroupServers *pServers = new GroupServers(nServers, &clock);
+    pServers->moveToThread(&serverThread);
+    serverThread.start();
+    bool bStarted = false;
+    QMetaObject::invokeMethod(pServers, "start", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, bStarted));
+
+    int result = 0;
+    if(!bStarted) {
+        out << "Unable to start " << nServers << " servers" << endl;
+        result = 1;
+    }
+    else {
+        QSettings settings;
+        settings.beginGroup(QString("groups"));
+        settings.remove(QString());
+        settings.setValue(QString("tcp"), pServers->tcpUrls());
+        settings.setValue(QString("ws"), pServers->wsUrls());
+        settings.endGroup();
+
+        GroupBench bench;
+        GroupBroadcaster broadcaster;
+        connect(&broadcaster, SIGNAL(groupApplied(QString,int,int)),
+                &bench, SLOT(onGroupApplied(QString,int,int)));
+        broadcaster.loadGroups();
+        QStringList groups = QStringList() << QString("tcp") << QString("ws");
+        QElapsedTimer connectClock;
+        connectClock.start();
+        while(broadcaster.connectedMembers(groups.at(0)) < nServers ||
+              broadcaster.connectedMembers(groups.at(1)) < nServers)
+        {
+            if(connectClock.elapsed() > CONNECT_TIMEOUT)
+                break;
+            QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+        }
+
+        out << "Group commands to " << nServers << " servers, " << nRounds << " rounds:" << endl;
+        quint32 seq = 0;
+        for(int g=0; g<groups.count() && result == 0; g++) {
+            if(broadcaster.connectedMembers(groups.at(g)) < nServers) {
+                out << "  " << groups.at(g) << ": only "
+                    << broadcaster.connectedMembers(groups.at(g)) << " members connected" << endl;
+                result = 1;
+                break;
+            }
+            QVector<qint64> sendSkewNs, spreadNs;
+            int nIncomplete = 0;
+            for(int r=0; r<nRounds; r++) {
+                bench.bApplied = false;
+                seq++;
+                if(!broadcaster.apply(groups.at(g), QString("setPercent"), QString::number(r%100)) ||
+                   !waitUntil(&bench.bApplied, APPLY_TIMEOUT))
+                {
+                    nIncomplete++;
+                    continue;
+                }
+                sendSkewNs.append(broadcaster.lastSendSkewNs());
+                int nReceived;
+                spreadNs.append(pServers->spreadNs(seq, &nReceived));
+                if(bench.nLastAcked != nServers || nReceived != nServers)
+                    nIncomplete++;
+            }
+            out << QString("  %1 send skew %2 us (median) %3 us (max)  arrival spread %4 us (median) %5 us (max)  %6 incomplete")
+                   .arg(groups.at(g)+QString("://"), -7)
+                   .arg(percentile(sendSkewNs, 0.5)/1000.0, 7, 'f', 1)
+                   .arg(percentile(sendSkewNs, 1.0)/1000.0, 7, 'f', 1)
+                   .arg(percentile(spreadNs, 0.5)/1000.0, 7, 'f', 1)
+                   .arg(percentile(spreadNs, 1.0)/1000.0, 7, 'f', 1)
+                   .arg(nIncomplete)
+                << endl;
+            if(nIncomplete > 0 || percentile(sendSkewNs, 0.5) >= MAX_SKEW)
+                result = 1;
+        }
+        settings.remove(QString("groups"));
+    }
+    QMetaObject::invokeMethod(pServers, "stop", Qt::BlockingQueuedConnection);
+    serverThread.quit();
+    serverThread.wait();
+    delete pServers;
+    return result;
+}
@@ -0,0 +1,98 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef GROUPBENCH_H
+#define GROUPBENCH_H
+
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+
+QT_FORWARD_DECLARE_CLASS(QTextStream)
+QT_FORWARD_DECLARE_CLASS(QElapsedTimer)
+QT_FORWARD_DECLARE_CLASS(QTcpServer)
+QT_FORWARD_DECLARE_CLASS(QWebSocketServer)
+
+
+// The members of the benchmark groups: as many tcp:// and ws://
+// servers, run on a thread of their own, that stamp the arrival of
+// every group command and acknowledge it.
+class GroupServers : public QObject
+{
+    Q_OBJECT
+public:
+    GroupServers(int _nServers, const QElapsedTimer *_pClock);
+
+    QStringList tcpUrls() const { return tcpServerUrls; }
+    QStringList wsUrls() const { return wsServerUrls; }
+    qint64      spreadNs(quint32 seq, int *pnReceived) const;
+
+public slots:
+    bool start();
+    void stop();
+
+private slots:
+    void onTcpConnection();
+    void onTcpReadyRead();
+    void onWsConnection();
+    void onWsMessage(QString sMessage);
+
+private:
+    quint32 received(const QString &sMessage);
+
+private:
+    struct Arrival {
+        qint64 firstNs;
+        qint64 lastNs;
+        int    count;
+    };
+    int                      nServers;
+    const QElapsedTimer     *pClock;
+    QList<QTcpServer*>       tcpServers;
+    QList<QWebSocketServer*> wsServers;
+    QStringList              tcpServerUrls;
+    QStringList              wsServerUrls;
+    QHash<QObject*, QByteArray> inBuffers;
+    mutable QMutex           mutex;
+    QHash<quint32, Arrival>  arrivals;  // By command sequence number
+};
+
+
+// Send skew of GroupBroadcaster::apply(), from the first write to the
+// last flush, and spread of the arrivals at the members, for groups
+// of tcp:// and of ws:// servers on the loopback interface.
+class GroupBench : public QObject
+{
+    Q_OBJECT
+public:
+    static int run(QTextStream &out, int nServers, int nRounds);
+
+private:
+    GroupBench();
+
+private slots:
+    void onGroupApplied(QString sGroup, int nAcked, int nMembers);
+
+private:
+    bool bApplied;
+    int  nLastAcked;
+};
+
+#endif // GROUPBENCH_H
@@ -0,0 +1,139 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QDir>
+
+#include "logbench.h"
+#include "remoteprobe.h"
+#include "utility.h"
+#include "binarylog.h"
+
+
+#define SITE_CALLS  10000000 // Disabled call sites timed in a row
+
+
+namespace {
+
+// Same shape as the periodic readbacks of the Panel Server
+QString
+readbackFrame(quint32 seq) {
+    return QString("<readPercent>%1</readPercent><hseq>%2</hseq><ts>%3</ts>")
+            .arg(42.0 + 0.1*double(seq % 3), 0, 'f', 1)
+            .arg(seq)
+            .arg(qint64(1500000000)*qint64(1000000000) + qint64(seq)*10000000);
+}
+
+
+double
+disabledSiteNs(bool bWithSite) {
+    volatile int sink = 0;
+    QElapsedTimer clock;
+    clock.start();
+    for(int i=0; i<SITE_CALLS; i++) {
+        sink = sink + i;
+        if(bWithSite)
+            LOG_DEBUG(Q_NULLPTR, "Iteration %1: %2", i, QString("never built"));
+    }
+    return double(clock.nsecsElapsed())/double(SITE_CALLS);
+}
+
+
+double
+handlerNs(RemoteProbe &remote, const QVector<QString> &frames) {
+    QElapsedTimer clock;
+    clock.start();
+    for(int i=0; i<frames.count(); i++)
+        remote.onTextMessageReceived(frames.at(i));
+    return double(clock.nsecsElapsed())/double(frames.count());
+}
+
+}
+
+
+QVector<QString>
+LogBench::readbackFrames(quint32 firstSeq, int nFrames) {
+    QVector<QString> frames;
+    frames.reserve(nFrames);
+    for(int i=0; i<nFrames; i++)
+        frames.append(readbackFrame(firstSeq+quint32(i)));
+    return frames;
+}
+
+
+int
+LogBench::run(QTextStream &out, int nFrames, const QString &sWorkDir) {
+    QString sTextLog   = QDir(sWorkDir).filePath("bench-log.txt");
+    QString sBinaryLog = QDir(sWorkDir).filePath("bench-log.tlog");
+    RemoteProbe remote;
+    quint32 seq = 1;
+
+    setLogLevel(LogOff);
+    double loopNs = disabledSiteNs(false);
+    double siteNs = disabledSiteNs(true);
+    out << "Disabled call site: " << QString::number(siteNs-loopNs, 'f', 2)
+        << " ns (" << SITE_CALLS << " calls)" << endl;
+
+    // Warm up: first layout of the line edits, history ring pages...
+    handlerNs(remote, readbackFrames(seq, nFrames));
+    seq += quint32(nFrames);
+
+    struct Run {
+        const char *name;
+        int         level;
+        bool        bBinary;
+    };
+    const Run runs[] = {
+        { "off",          LogOff,   false },
+        { "error, text",  LogError, false },
+        { "debug, text",  LogDebug, false },
+        { "debug, binary", LogDebug, true  }
+    };
+    double offNs = 0.0;
+    out << "onTextMessageReceived, " << nFrames << " readback frames:" << endl;
+    for(unsigned r=0; r<sizeof(runs)/sizeof(runs[0]); r++) {
+        if(runs[r].bBinary) {
+            if(!BinaryLog::open(sBinaryLog)) {
+                out << "Unable to open " << sBinaryLog << endl;
+                return 1;
+            }
+        }
+        else if(!remote.openLog(sTextLog)) {
+            out << "Unable to open " << sTextLog << endl;
+            return 1;
+        }
+        setLogLevel(runs[r].level);
+        QVector<QString> frames = readbackFrames(seq, nFrames);
+        seq += quint32(nFrames);
+        double ns = handlerNs(remote, frames);
+        if(r == 0)
+            offNs = ns;
+        out << QString("  %1 %2 ns/frame  %3%")
+               .arg(QString(runs[r].name), -14)
+               .arg(ns, 9, 'f', 1)
+               .arg(offNs > 0.0 ? 100.0*(ns-offNs)/offNs : 0.0, 6, 'f', 1)
+            << endl;
+        BinaryLog::close();
+        remote.closeLog();
+    }
+    setLogLevel(LogError);
+    QFile::remove(sTextLog);
+    QFile::remove(sBinaryLog);
+    return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef LOGBENCH_H
+#define LOGBENCH_H
+
+#include <QVector>
+#include <QString>
+
+QT_FORWARD_DECLARE_CLASS(QTextStream)
+
+
+// Cost of the logging on the readback path: a disabled LOG_xxx call
+// site on its own, then TRemote::onTextMessageReceived() fed with
+// canned readback frames at every runtime level, text and binary.
+class LogBench
+{
+public:
+    static int run(QTextStream &out, int nFrames, const QString &sWorkDir);
+    static QVector<QString> readbackFrames(quint32 firstSeq, int nFrames);
+};
+
+#endif // LOGBENCH_H
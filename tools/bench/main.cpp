@@ -0,0 +1,87 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QDir>
+
+#include "logbench.h"
+#include "tlsbench.h"
+#include "transportbench.h"
+#include "groupbench.h"
+#include "utility.h"
+
+
+int
+main(int argc, char *argv[]) {
+    // The TRemote window is created but never shown
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Gabriele.Salvato");
+    QCoreApplication::setApplicationName("TRemoteBench");
+    QCoreApplication::setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks of the TRemote client paths.\n"
+                                     "  log        logging cost on the readback path\n"
+                                     "  tls        cold and resumed TLS handshakes\n"
+                                     "  transport  loopback latency and rate of each transport\n"
+                                     "  groups     send skew of a command to a group of servers");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption framesOption(QStringList() << "n" << "frames",
+                                    "Frames (or messages) per run (default 200000).",
+                                    "n", "200000");
+    QCommandLineOption dirOption(QStringList() << "d" << "work-dir",
+                                 "Directory for the temporary files (default: the system one).",
+                                 "dir", QDir::tempPath());
+    QCommandLineOption roundsOption(QStringList() << "r" << "rounds",
+                                    "Connections per run (default 50).",
+                                    "n", "50");
+    QCommandLineOption serversOption(QStringList() << "s" << "servers",
+                                     "Servers per group (default 100).",
+                                     "n", "100");
+    parser.addOption(framesOption);
+    parser.addOption(roundsOption);
+    parser.addOption(serversOption);
+    parser.addOption(dirOption);
+    parser.addPositionalArgument("benchmark", "log | tls | transport | groups");
+    parser.process(app);
+
+    QTextStream out(stdout);
+    setLogLevel(LogError);
+    QStringList arguments = parser.positionalArguments();
+    if(arguments.count() != 1)
+        parser.showHelp(1);
+    int nFrames = qMax(1, parser.value(framesOption).toInt());
+    int nRounds = qMax(1, parser.value(roundsOption).toInt());
+    int nServers = qMax(1, parser.value(serversOption).toInt());
+    QString sBenchmark = arguments.at(0);
+    if(sBenchmark == QString("log"))
+        return LogBench::run(out, nFrames, parser.value(dirOption));
+    if(sBenchmark == QString("tls"))
+        return TlsBench::run(out, nRounds, parser.value(dirOption));
+    if(sBenchmark == QString("transport"))
+        return TransportBench::run(out, nFrames);
+    if(sBenchmark == QString("groups"))
+        return GroupBench::run(out, nServers, nRounds);
+    parser.showHelp(1);
+    return 1;
+}
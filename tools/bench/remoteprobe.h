@@ -0,0 +1,49 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef REMOTEPROBE_H
+#define REMOTEPROBE_H
+
+#include <QFile>
+
+#include "tremote.h"
+
+
+// The TRemote window, never shown, with its message handlers made
+// callable: frames are fed in without any server or socket
+class RemoteProbe : public TRemote
+{
+public:
+    explicit RemoteProbe(QWidget *parent=Q_NULLPTR)
+        : TRemote(parent)
+    {
+    }
+
+    using TRemote::onTextMessageReceived;
+    using TRemote::onBinaryMessageReceived;
+
+    // The text log goes to sFileName instead of the user's one
+    bool openLog(const QString &sFileName) {
+        logFile->close();
+        logFile->setFileName(sFileName);
+        return logFile->open(QIODevice::WriteOnly);
+    }
+    void closeLog() { logFile->close(); }
+};
+
+#endif // REMOTEPROBE_H
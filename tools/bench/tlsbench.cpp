@@ -0,0 +1,209 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+#include <QVector>
+#include <QSslSocket>
+#include <QSslCertificate>
+#include <QTcpServer>
+#include <QProcess>
+#include <QThread>
+#include <QDir>
+#include <QUrl>
+
+#include "tlsbench.h"
+#include "tlspolicy.h"
+
+#include <algorithm>
+
+
+#define OPENSSL_TIMEOUT   30000 // ms for the certificate generation
+#define SERVER_STARTUP    5000  // ms for s_server to accept connections
+#define IO_TIMEOUT        5000
+
+
+namespace {
+
+bool
+runOpenssl(const QStringList &arguments, const QString &sWorkDir) {
+    QProcess process;
+    process.setWorkingDirectory(sWorkDir);
+    process.setProcessChannelMode(QProcess::MergedChannels);
+    process.start(QString("openssl"), arguments);
+    return process.waitForFinished(OPENSSL_TIMEOUT) &&
+           process.exitStatus() == QProcess::NormalExit &&
+           process.exitCode() == 0;
+}
+
+
+quint16
+freePort() {
+    QTcpServer server;
+    if(!server.listen(QHostAddress::LocalHost, 0))
+        return 0;
+    return server.serverPort();
+}
+
+
+bool
+waitForServer(quint16 port) {
+    QElapsedTimer clock;
+    clock.start();
+    while(clock.elapsed() < SERVER_STARTUP) {
+        QTcpSocket socket;
+        socket.connectToHost(QHostAddress::LocalHost, port);
+        if(socket.waitForConnected(100))
+            return true;
+        QThread::msleep(50);
+    }
+    return false;
+}
+
+
+double
+median(QVector<qint64> values) {
+    if(values.isEmpty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    return double(values.at(values.count()/2));
+}
+
+}
+
+
+TlsBench::TlsBench(const TlsPolicy *_pTlsPolicy)
+    : pTlsPolicy(_pTlsPolicy)
+{
+}
+
+
+void
+TlsBench::onSslErrors(const QList<QSslError> &errors) {
+    QSslSocket *pSocket = qobject_cast<QSslSocket*>(sender());
+    if(pTlsPolicy->canIgnore(pSocket->peerCertificate(), errors))
+        pSocket->ignoreSslErrors();
+}
+
+
+// Same calls as WebSocketTransport, then a request for the s_server
+// page, which also lets TLS 1.3 deliver its tickets
+bool
+TlsBench::handshake(const QUrl &url, qint64 *pNs, bool *pbReused) {
+    QSslSocket socket;
+    connect(&socket, SIGNAL(sslErrors(QList<QSslError>)),
+            this, SLOT(onSslErrors(QList<QSslError>)));
+    pTlsPolicy->prepare(&socket, url);
+    QElapsedTimer clock;
+    clock.start();
+    socket.connectToHostEncrypted(url.host(), quint16(url.port()));
+    if(!socket.waitForEncrypted(IO_TIMEOUT))
+        return false;
+    *pNs = clock.nsecsElapsed();
+    if(!pTlsPolicy->isPeerPinned(socket.peerCertificate()))
+        return false;
+    pTlsPolicy->sessionEstablished(&socket, url);
+    socket.write("GET / HTTP/1.0\r\n\r\n");
+    QByteArray page;
+    while(socket.waitForReadyRead(IO_TIMEOUT))
+        page += socket.readAll();
+    page += socket.readAll();
+    pTlsPolicy->sessionEstablished(&socket, url);
+    *pbReused = page.contains("Reused,");
+    return page.contains("New,") || *pbReused;
+}
+
+
+int
+TlsBench::run(QTextStream &out, int nRounds, const QString &sWorkDir) {
+    if(!QSslSocket::supportsSsl()) {
+        out << "No TLS support in this Qt build" << endl;
+        return 1;
+    }
+    QString sKey  = QDir(sWorkDir).filePath("bench-tls-key.pem");
+    QString sCert = QDir(sWorkDir).filePath("bench-tls-cert.pem");
+    if(!runOpenssl(QStringList() << "req" << "-x509" << "-newkey" << "rsa:2048" << "-nodes"
+                                 << "-keyout" << sKey << "-out" << sCert
+                                 << "-days" << "1" << "-subj" << "/CN=localhost",
+                   sWorkDir))
+    {
+        out << "Unable to create a certificate with openssl" << endl;
+        return 1;
+    }
+    QList<QSslCertificate> certificates = QSslCertificate::fromPath(sCert);
+    if(certificates.isEmpty()) {
+        out << "Unable to read " << sCert << endl;
+        return 1;
+    }
+    qputenv("TREMOTE_TLS_PIN", certificates.at(0).digest(QCryptographicHash::Sha256).toHex());
+
+    quint16 port = freePort();
+    QProcess server;
+    server.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    server.start(QString("openssl"), QStringList() << "s_server" << "-quiet" << "-www"
+                                                   << "-accept" << QString::number(port)
+                                                   << "-cert" << sCert << "-key" << sKey);
+    if(port == 0 || !server.waitForStarted() || !waitForServer(port)) {
+        out << "Unable to start openssl s_server" << endl;
+        return 1;
+    }
+
+    TlsPolicy policy;
+    TlsBench bench(&policy);
+    QUrl url(QString("wss://localhost:%1").arg(port));
+    QVector<qint64> coldNs, resumedNs;
+    int nReused = 0;
+    int result = 0;
+    for(int i=0; i<nRounds; i++) {
+        qint64 ns;
+        bool bReused;
+        policy.forgetSession(url);
+        if(!bench.handshake(url, &ns, &bReused)) {
+            out << "Cold handshake failed" << endl;
+            result = 1;
+            break;
+        }
+        coldNs.append(ns);
+        if(!bench.handshake(url, &ns, &bReused)) {
+            out << "Resumed handshake failed" << endl;
+            result = 1;
+            break;
+        }
+        resumedNs.append(ns);
+        if(bReused)
+            nReused++;
+    }
+    policy.forgetSession(url);
+    server.kill();
+    server.waitForFinished();
+    QFile::remove(sKey);
+    QFile::remove(sCert);
+    if(result != 0)
+        return result;
+
+    out << "TLS handshakes to openssl s_server, " << nRounds << " rounds:" << endl;
+    out << QString("  cold     %1 us (median)").arg(median(coldNs)/1000.0, 9, 'f', 1) << endl;
+    out << QString("  resumed  %1 us (median)  %2/%3 sessions reused")
+           .arg(median(resumedNs)/1000.0, 9, 'f', 1)
+           .arg(nReused)
+           .arg(nRounds)
+        << endl;
+    // Resumption is the point of caching the tickets
+    return nReused == nRounds ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef TLSBENCH_H
+#define TLSBENCH_H
+
+#include <QObject>
+#include <QList>
+#include <QSslError>
+
+QT_FORWARD_DECLARE_CLASS(QTextStream)
+QT_FORWARD_DECLARE_CLASS(QUrl)
+QT_FORWARD_DECLARE_CLASS(TlsPolicy)
+
+
+// Cold and resumed TLS handshakes made through TlsPolicy, as the
+// wss:// transport does, against an "openssl s_server" stand-in on
+// the loopback interface. Its certificate is a throwaway self signed
+// one, pinned for the run; the s_server status page tells whether the
+// session was really reused.
+class TlsBench : public QObject
+{
+    Q_OBJECT
+public:
+    static int run(QTextStream &out, int nRounds, const QString &sWorkDir);
+
+private:
+    explicit TlsBench(const TlsPolicy *_pTlsPolicy);
+    bool handshake(const QUrl &url, qint64 *pNs, bool *pbReused);
+
+private slots:
+    void onSslErrors(const QList<QSslError> &errors);
+
+private:
+    const TlsPolicy *pTlsPolicy;
+};
+
+#endif // TLSBENCH_H
@@ -0,0 +1,240 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QTcpSocket>
+#include <QLocalSocket>
+#include <QWebSocketServer>
+#include <QWebSocket>
+#include <QVector>
+#include <QUrl>
+
+#include "transportbench.h"
+#include "transport.h"
+
+#include <algorithm>
+
+
+#define IO_TIMEOUT   5000 // ms
+#define MAX_RTT_RUNS 10000
+#define WINDOW       64   // Messages in flight for the rate
+
+
+namespace {
+
+double
+percentile(QVector<qint64> values, double fraction) {
+    if(values.isEmpty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    return double(values.at(qMin(values.count()-1, int(fraction*values.count()))));
+}
+
+}
+
+
+TransportBench::TransportBench()
+    : pWebSocketServer(Q_NULLPTR)
+    , bConnected(false)
+    , nReceived(0)
+    , nExpected(0)
+{
+    timeoutTimer.setSingleShot(true);
+    timeoutTimer.setInterval(IO_TIMEOUT);
+    connect(&timeoutTimer, SIGNAL(timeout()),
+            &loop, SLOT(quit()));
+}
+
+
+bool
+TransportBench::startServers() {
+    connect(&tcpServer, SIGNAL(newConnection()),
+            this, SLOT(onTcpConnection()));
+    if(!tcpServer.listen(QHostAddress::LocalHost, 0))
+        return false;
+    QString sName = QString("tremote-bench-%1").arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(sName);
+    connect(&localServer, SIGNAL(newConnection()),
+            this, SLOT(onLocalConnection()));
+    if(!localServer.listen(sName))
+        return false;
+    pWebSocketServer = new QWebSocketServer(QString("TRemote bench"),
+                                            QWebSocketServer::NonSecureMode,
+                                            this);
+    connect(pWebSocketServer, SIGNAL(newConnection()),
+            this, SLOT(onWebSocketConnection()));
+    return pWebSocketServer->listen(QHostAddress::LocalHost, 0);
+}
+
+
+void
+TransportBench::onTcpConnection() {
+    while(tcpServer.hasPendingConnections()) {
+        QTcpSocket *pSocket = tcpServer.nextPendingConnection();
+        pSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(pSocket, SIGNAL(readyRead()),
+                this, SLOT(onEchoReadyRead()));
+    }
+}
+
+
+void
+TransportBench::onLocalConnection() {
+    while(localServer.hasPendingConnections()) {
+        QLocalSocket *pSocket = localServer.nextPendingConnection();
+        connect(pSocket, SIGNAL(readyRead()),
+                this, SLOT(onEchoReadyRead()));
+    }
+}
+
+
+void
+TransportBench::onWebSocketConnection() {
+    while(pWebSocketServer->hasPendingConnections()) {
+        QWebSocket *pSocket = pWebSocketServer->nextPendingConnection();
+        connect(pSocket, SIGNAL(textMessageReceived(QString)),
+                this, SLOT(onEchoTextMessage(QString)));
+    }
+}
+
+
+// A text frame sent back as is is a text frame for the client
+void
+TransportBench::onEchoReadyRead() {
+    QIODevice *pDevice = qobject_cast<QIODevice*>(sender());
+    pDevice->write(pDevice->readAll());
+}
+
+
+void
+TransportBench::onEchoTextMessage(QString sMessage) {
+    qobject_cast<QWebSocket*>(sender())->sendTextMessage(sMessage);
+}
+
+
+void
+TransportBench::onConnected() {
+    bConnected = true;
+    loop.quit();
+}
+
+
+void
+TransportBench::onTextMessageReceived(QString sMessage) {
+    Q_UNUSED(sMessage)
+    nReceived++;
+    if(nReceived >= nExpected)
+        loop.quit();
+}
+
+
+bool
+TransportBench::waitFor(int nMessages) {
+    nExpected = nMessages;
+    if(nReceived >= nExpected)
+        return true;
+    timeoutTimer.start();
+    loop.exec();
+    timeoutTimer.stop();
+    return nReceived >= nExpected;
+}
+
+
+bool
+TransportBench::measure(Transport *pTransport, const QUrl &url, int nMessages,
+                        QVector<qint64> *pRttNs, double *pRate)
+{
+    connect(pTransport, SIGNAL(connected()),
+            this, SLOT(onConnected()));
+    connect(pTransport, SIGNAL(textMessageReceived(QString)),
+            this, SLOT(onTextMessageReceived(QString)));
+    bConnected = false;
+    pTransport->open(url);
+    timeoutTimer.start();
+    loop.exec();
+    timeoutTimer.stop();
+    if(!bConnected)
+        return false;
+    const QString sMessage("<setPercent>42.0</setPercent><cseq>1</cseq>");
+
+    // One message at a time
+    nReceived = 0;
+    QElapsedTimer clock;
+    int nRuns = qMin(nMessages, MAX_RTT_RUNS);
+    for(int i=0; i<nRuns; i++) {
+        clock.start();
+        pTransport->sendTextMessage(sMessage);
+        pTransport->flush();
+        if(!waitFor(i+1))
+            return false;
+        pRttNs->append(clock.nsecsElapsed());
+    }
+
+    // Pipelined
+    nReceived = 0;
+    int nSent = 0;
+    clock.start();
+    while(nReceived < nMessages) {
+        while(nSent < nMessages && nSent-nReceived < WINDOW) {
+            pTransport->sendTextMessage(sMessage);
+            nSent++;
+        }
+        pTransport->flush();
+        if(!waitFor(nReceived+1))
+            return false;
+    }
+    *pRate = double(nMessages)*1.0e9/double(clock.nsecsElapsed());
+    pTransport->abort();
+    return true;
+}
+
+
+int
+TransportBench::run(QTextStream &out, int nMessages) {
+    TransportBench bench;
+    if(!bench.startServers()) {
+        out << "Unable to start the echo servers" << endl;
+        return 1;
+    }
+    QStringList urls;
+    urls << QString("tcp://127.0.0.1:%1").arg(bench.tcpServer.serverPort())
+         << QString("local://%1").arg(bench.localServer.serverName())
+         << QString("ws://127.0.0.1:%1").arg(bench.pWebSocketServer->serverPort());
+    out << "Loopback echo, " << nMessages << " messages:" << endl;
+    for(int i=0; i<urls.count(); i++) {
+        QUrl url(urls.at(i));
+        Transport *pTransport = Transport::create(url, Q_NULLPTR, &bench);
+        QVector<qint64> rttNs;
+        double rate = 0.0;
+        bool bOk = bench.measure(pTransport, url, nMessages, &rttNs, &rate);
+        delete pTransport;
+        if(!bOk) {
+            out << "  " << url.scheme() << ": no echo from " << urls.at(i) << endl;
+            return 1;
+        }
+        out << QString("  %1 rtt %2 us (median) %3 us (99th)  %4 msg/s")
+               .arg(url.scheme()+QString("://"), -9)
+               .arg(percentile(rttNs, 0.5)/1000.0, 7, 'f', 1)
+               .arg(percentile(rttNs, 0.99)/1000.0, 7, 'f', 1)
+               .arg(rate, 10, 'f', 0)
+            << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef TRANSPORTBENCH_H
+#define TRANSPORTBENCH_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QLocalServer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QVector>
+
+QT_FORWARD_DECLARE_CLASS(QTextStream)
+QT_FORWARD_DECLARE_CLASS(QUrl)
+QT_FORWARD_DECLARE_CLASS(QWebSocketServer)
+QT_FORWARD_DECLARE_CLASS(Transport)
+
+
+// Round trip latency and message rate of every Transport backend
+// against echo servers on the loopback interface, in the same
+// process like the soak stand-in server. The tcp:// and local://
+// servers send back the frames as they come; the ws:// one echoes
+// the messages.
+class TransportBench : public QObject
+{
+    Q_OBJECT
+public:
+    static int run(QTextStream &out, int nMessages);
+
+private:
+    TransportBench();
+    bool startServers();
+    bool measure(Transport *pTransport, const QUrl &url, int nMessages,
+                 QVector<qint64> *pRttNs, double *pRate);
+    bool waitFor(int nMessages);
+
+private slots:
+    void onTcpConnection();
+    void onLocalConnection();
+    void onWebSocketConnection();
+    void onEchoReadyRead();
+    void onEchoTextMessage(QString sMessage);
+    void onConnected();
+    void onTextMessageReceived(QString sMessage);
+
+private:
+    QTcpServer        tcpServer;
+    QLocalServer      localServer;
+    QWebSocketServer *pWebSocketServer;
+    QEventLoop        loop;
+    QTimer            timeoutTimer;
+    bool              bConnected;
+    int               nReceived;
+    int               nExpected;
+};
+
+#endif // TRANSPORTBENCH_H
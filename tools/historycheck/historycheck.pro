@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Round trip of the readback history codec and
+# checks of the history series: fails on any
+# mismatch
+#
+#-------------------------------------------------
+
+
+QT += core
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = historycheck
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
+SOURCES += ../../readbackhistory.cpp
+
+HEADERS += ../../readbackhistory.h
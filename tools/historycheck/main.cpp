@@ -0,0 +1,212 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QVector>
+
+#include "readbackhistory.h"
+
+
+#define SMALL_CAPACITY 100 // Ring used for the series checks
+
+
+namespace {
+
+int nFailures = 0;
+
+
+void
+check(QTextStream &out, bool bOk, const QString &sWhat) {
+    if(bOk)
+        return;
+    nFailures++;
+    out << "FAILED: " << sWhat << endl;
+}
+
+
+// Steady stretches, steps, jitter and sequence gaps, as a server
+// with a few outages would send them. Times are whole microseconds and
+// values whole hundredths: what the codec keeps.
+QVector<HistorySample>
+makeSeries(int nSamples) {
+    QVector<HistorySample> samples;
+    samples.reserve(nSamples);
+    quint32 seq   = 1;
+    qint64  us    = qint64(1500000000)*qint64(1000000);
+    qint64  value = 4200;
+    for(int i=0; i<nSamples; i++) {
+        if(qrand() % 500 == 0)
+            seq += quint32(1 + qrand() % 1000);
+        if(qrand() % 50 == 0)
+            value += qrand() % 201 - 100;
+        us += 10000 + (qrand() % 20 == 0 ? qrand() % 401 - 200 : 0);
+        HistorySample sample;
+        sample.seq      = seq++;
+        sample.serverNs = us*1000;
+        sample.value    = double(value)/100.0;
+        samples.append(sample);
+    }
+    return samples;
+}
+
+
+bool
+sameSample(const HistorySample &a, const HistorySample &b) {
+    return a.seq == b.seq &&
+           a.serverNs == b.serverNs &&
+           qRound64(a.value*100.0) == qRound64(b.value*100.0);
+}
+
+
+void
+checkCodec(QTextStream &out, int nSamples) {
+    QVector<HistorySample> samples = makeSeries(nSamples);
+    QList<QByteArray> chunks = HistoryCodec::encode(samples);
+    QVector<HistorySample> decoded;
+    qint64 nBytes = 0;
+    bool bLast = false;
+    for(int i=0; i<chunks.count(); i++) {
+        nBytes += chunks.at(i).size();
+        check(out, HistoryCodec::isChunk(chunks.at(i)), QString("chunk %1 marker").arg(i));
+        check(out, HistoryCodec::decode(chunks.at(i), &decoded, &bLast),
+              QString("chunk %1 decodes").arg(i));
+        check(out, bLast == (i == chunks.count()-1), QString("chunk %1 last flag").arg(i));
+    }
+    check(out, decoded.count() == samples.count(),
+          QString("%1 samples decoded out of %2").arg(decoded.count()).arg(samples.count()));
+    for(int i=0; i<qMin(decoded.count(), samples.count()); i++) {
+        if(!sameSample(decoded.at(i), samples.at(i))) {
+            check(out, false, QString("sample %1 (seq %2) round trip").arg(i).arg(samples.at(i).seq));
+            break;
+        }
+    }
+    // An empty answer is a single last chunk
+    QList<QByteArray> empty = HistoryCodec::encode(QVector<HistorySample>());
+    decoded.clear();
+    check(out, empty.count() == 1 &&
+               HistoryCodec::decode(empty.at(0), &decoded, &bLast) &&
+               bLast && decoded.isEmpty(),
+          QString("empty answer"));
+    // Truncated chunks are refused
+    if(!chunks.isEmpty() && chunks.at(0).size() > 4) {
+        decoded.clear();
+        check(out, !HistoryCodec::decode(chunks.at(0).left(chunks.at(0).size()-1), &decoded, &bLast),
+              QString("truncated chunk refused"));
+    }
+    out << "codec: " << samples.count() << " samples in " << chunks.count()
+        << " chunks, " << nBytes << " bytes" << endl;
+}
+
+
+HistorySample
+sampleAt(quint32 seq) {
+    HistorySample sample;
+    sample.seq      = seq;
+    sample.serverNs = qint64(seq)*10000000;
+    sample.value    = double(seq % 100);
+    return sample;
+}
+
+
+void
+checkSeries(QTextStream &out) {
+    ReadbackHistory history(SMALL_CAPACITY);
+    history.reset(QString("ws://first:45454"));
+
+    // Not yet full, then wrapped around
+    for(quint32 seq=1; seq<=40; seq++)
+        history.append(sampleAt(seq));
+    check(out, history.count() == 40 && history.lastSeq() == 40, QString("partial ring"));
+    history.append(sampleAt(40));
+    history.append(sampleAt(12));
+    check(out, history.count() == 40, QString("repeated and late samples left out"));
+
+    // A restart within the first fill: the new run must not see the
+    // samples of the old one
+    check(out, history.isNewRun(sampleAt(5)), QString("restart detected"));
+    ReadbackHistory saved = history;
+    history.reset(history.server());
+    check(out, history.isEmpty(), QString("empty after reset"));
+    for(quint32 seq=5; seq<=14; seq++)
+        history.append(sampleAt(seq));
+    check(out, history.count() == 10 &&
+               history.at(0).seq == 5 &&
+               history.lastSeq() == 14,
+          QString("new run after a partial ring: %1 samples, %2..%3")
+          .arg(history.count()).arg(history.at(0).seq).arg(history.lastSeq()));
+    check(out, !history.isNewRun(sampleAt(15)), QString("next sample of the new run"));
+    check(out, saved.count() == 40 && saved.at(0).seq == 1 && saved.lastSeq() == 40,
+              QString("saved copy untouched by the reset"));
+
+    // Wrapped ring, then a server switch
+    for(quint32 seq=15; seq<=250; seq++)
+        history.append(sampleAt(seq));
+    check(out, history.count() == SMALL_CAPACITY &&
+               history.at(0).seq == 151 &&
+               history.lastSeq() == 250,
+          QString("full ring keeps the last samples"));
+    history.reset(QString("ws://standby:45454"));
+    history.append(sampleAt(3));
+    check(out, history.count() == 1 && history.at(0).seq == 3 && history.lastSeq() == 3,
+          QString("new server after a full ring"));
+
+    // Backfill merged into the gaps, duplicates dropped
+    history.append(sampleAt(20));
+    QVector<HistorySample> backfill;
+    for(quint32 seq=1; seq<=25; seq++)
+        backfill.append(sampleAt(seq));
+    QVector<double> added;
+    int nAdded = history.merge(backfill, &added);
+    check(out, nAdded == 23 && added.count() == 23, QString("%1 backfilled samples").arg(nAdded));
+    bool bOrdered = history.count() == 25;
+    for(int i=0; bOrdered && i<history.count(); i++)
+        bOrdered = history.at(i).seq == quint32(i+1);
+    check(out, bOrdered, QString("merged series in order"));
+    out << "series: done" << endl;
+}
+
+}
+
+
+int
+main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Gabriele.Salvato");
+    QCoreApplication::setApplicationName("TRemoteHistoryCheck");
+    QCoreApplication::setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Checks the readback history codec round trip "
+                                     "and the history series");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption samplesOption(QStringList() << "n" << "samples",
+                                     "Samples of the codec round trip (default 200000).",
+                                     "n", "200000");
+    parser.addOption(samplesOption);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    qsrand(1);
+    checkCodec(out, qMax(1, parser.value(samplesOption).toInt()));
+    checkSeries(out);
+    out << (nFailures == 0 ? QString("OK") : QString("%1 failures").arg(nFailures)) << endl;
+    return nFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include "impairedlink.h"
+
+
+#define MIN_RTO 200 // ms, TCP minimum retransmission timeout
+
+
+namespace {
+
+struct BuiltinProfile {
+    const char *name;
+    int         latencyMs;
+    int         jitterMs;
+    qint64      bandwidthBps;
+    double      lossRate;
+    double      reorderRate;
+    int         stallAfterMs;
+};
+
+const BuiltinProfile builtins[] = {
+    { "none",      0,   0,   0,         0.0,   0.0,   -1   },
+    { "lan",       1,   1,   100000000, 0.0,   0.0,   -1   },
+    { "wifi",      5,   10,  20000000,  0.005, 0.001, -1   },
+    { "dsl",       25,  5,   1000000,   0.001, 0.0,   -1   },
+    { "cellular",  80,  40,  2000000,   0.01,  0.01,  -1   },
+    { "satellite", 300, 20,  512000,    0.005, 0.0,   -1   },
+    { "lossy",     20,  10,  0,         0.05,  0.02,  -1   },
+    { "slow",      400, 200, 64000,     0.02,  0.02,  -1   },
+    { "stall",     10,  2,   0,         0.0,   0.0,   5000 }
+};
+
+const int nBuiltins = int(sizeof(builtins)/sizeof(builtins[0]));
+
+
+// "64k", "2M", "1000000"
+bool
+parseBandwidth(QString sValue, qint64 *pBps) {
+    qint64 multiplier = 1;
+    if(sValue.endsWith(QChar('k'), Qt::CaseInsensitive))
+        multiplier = 1000;
+    else if(sValue.endsWith(QChar('M')))
+        multiplier = 1000000;
+    if(multiplier != 1)
+        sValue.chop(1);
+    bool ok;
+    double value = sValue.toDouble(&ok);
+    if(!ok || value < 0.0)
+        return false;
+    *pBps = qint64(value*multiplier);
+    return true;
+}
+
+}
+
+
+ImpairmentProfile::ImpairmentProfile()
+    : name(QString("none"))
+    , latencyMs(0)
+    , jitterMs(0)
+    , bandwidthBps(0)
+    , lossRate(0.0)
+    , reorderRate(0.0)
+    , stallAfterMs(-1)
+{
+}
+
+
+QString
+ImpairmentProfile::toString() const {
+    return QString("%1: latency %2 ms, jitter %3 ms, bandwidth %4, loss %5%, reorder %6%%7")
+           .arg(name)
+           .arg(latencyMs)
+           .arg(jitterMs)
+           .arg(bandwidthBps > 0 ? QString("%1 kbit/s").arg(bandwidthBps/1000) : QString("unlimited"))
+           .arg(100.0*lossRate)
+           .arg(100.0*reorderRate)
+           .arg(stallAfterMs >= 0 ? QString(", stall after %1 ms").arg(stallAfterMs) : QString());
+}
+
+
+QStringList
+ImpairmentProfile::builtinNames() {
+    QStringList names;
+    for(int i=0; i<nBuiltins; i++)
+        names.append(QString(builtins[i].name));
+    return names;
+}
+
+
+// "<builtin>[,key=value...]" or "key=value[,key=value...]" with the keys
+// latency, jitter, bw, loss, reorder and stall
+bool
+ImpairmentProfile::fromString(const QString &sSpec, ImpairmentProfile *pProfile, QString *pError) {
+    ImpairmentProfile profile;
+    QStringList fields = sSpec.split(QChar(','), QString::SkipEmptyParts);
+    if(!fields.isEmpty() && !fields.first().contains(QChar('='))) {
+        QString sBase = fields.takeFirst().trimmed();
+        int i = 0;
+        while(i < nBuiltins && sBase != QString(builtins[i].name))
+            i++;
+        if(i == nBuiltins) {
+            *pError = QString("Unknown profile %1").arg(sBase);
+            return false;
+        }
+        profile.latencyMs    = builtins[i].latencyMs;
+        profile.jitterMs     = builtins[i].jitterMs;
+        profile.bandwidthBps = builtins[i].bandwidthBps;
+        profile.lossRate     = builtins[i].lossRate;
+        profile.reorderRate  = builtins[i].reorderRate;
+        profile.stallAfterMs = builtins[i].stallAfterMs;
+    }
+    for(int i=0; i<fields.count(); i++) {
+        QString sKey   = fields.at(i).section(QChar('='), 0, 0).trimmed();
+        QString sValue = fields.at(i).section(QChar('='), 1).trimmed();
+        bool ok = false;
+        if(sKey == QString("latency"))
+            profile.latencyMs = sValue.toInt(&ok);
+        else if(sKey == QString("jitter"))
+            profile.jitterMs = sValue.toInt(&ok);
+        else if(sKey == QString("bw"))
+            ok = parseBandwidth(sValue, &profile.bandwidthBps);
+        else if(sKey == QString("loss"))
+            profile.lossRate = sValue.toDouble(&ok);
+        else if(sKey == QString("reorder"))
+            profile.reorderRate = sValue.toDouble(&ok);
+        else if(sKey == QString("stall"))
+            profile.stallAfterMs = sValue.toInt(&ok);
+        if(!ok) {
+            *pError = QString("Invalid setting %1").arg(fields.at(i));
+            return false;
+        }
+    }
+    profile.name = sSpec;
+    *pProfile = profile;
+    return true;
+}
+
+
+ImpairedLink::ImpairedLink(Mode _mode, const ImpairmentProfile &_profile, QObject *parent)
+    : QObject(parent)
+    , mode(_mode)
+    , profile(_profile)
+    , linkFreeNs(0)
+    , lastDueNs(0)
+    , bStalled(false)
+    , nDropped(0)
+    , nRetransmitted(0)
+{
+    clock.start();
+    deliveryTimer.setSingleShot(true);
+    deliveryTimer.setTimerType(Qt::PreciseTimer);
+    connect(&deliveryTimer, SIGNAL(timeout()),
+            this, SLOT(onTimeToDeliver()));
+}
+
+
+double
+ImpairedLink::uniform() {
+    return double(qrand())/double(RAND_MAX);
+}
+
+
+void
+ImpairedLink::push(const QByteArray &data) {
+    if(mode == Datagram && uniform() < profile.lossRate) {
+        nDropped++;
+        return;
+    }
+    Item item;
+    item.data   = data;
+    item.bClose = false;
+    enqueue(item, data.size());
+}
+
+
+// The end of the stream travels behind the data
+void
+ImpairedLink::pushClose() {
+    Item item;
+    item.bClose = true;
+    enqueue(item, 0);
+}
+
+
+void
+ImpairedLink::enqueue(const Item &item, qint64 size) {
+    qint64 now = clock.nsecsElapsed();
+    // Serialization at the configured bandwidth
+    linkFreeNs = qMax(now, linkFreeNs);
+    if(profile.bandwidthBps > 0)
+        linkFreeNs += size*8*qint64(1000000000)/profile.bandwidthBps;
+    double delayMs = profile.latencyMs + profile.jitterMs*(2.0*uniform()-1.0);
+    qint64 due = linkFreeNs + qint64(qMax(0.0, delayMs)*1.0e6);
+    if(mode == Stream) {
+        if(!item.bClose && uniform() < profile.lossRate) {
+            nRetransmitted++;
+            due += qint64(qMax(MIN_RTO, 2*profile.latencyMs+4*profile.jitterMs))*1000000;
+        }
+        due = qMax(due, lastDueNs+1); // Unique keys keep the order
+    }
+    else if(uniform() < profile.reorderRate) {
+        due += qint64(profile.latencyMs+2*profile.jitterMs+1)*1000000;
+    }
+    lastDueNs = qMax(lastDueNs, due);
+    queue.insert(due, item);
+    schedule();
+}
+
+
+void
+ImpairedLink::setStalled(bool bStall) {
+    bStalled = bStall;
+    schedule();
+}
+
+
+void
+ImpairedLink::schedule() {
+    if(bStalled || queue.isEmpty()) {
+        deliveryTimer.stop();
+        return;
+    }
+    qint64 waitNs = queue.constBegin().key() - clock.nsecsElapsed();
+    deliveryTimer.start(int(qMax(qint64(0), waitNs/1000000)));
+}
+
+
+void
+ImpairedLink::onTimeToDeliver() {
+    qint64 now = clock.nsecsElapsed();
+    while(!bStalled && !queue.isEmpty() && queue.constBegin().key() <= now+500000) {
+        QMultiMap<qint64, Item>::iterator it = queue.begin();
+        Item item = it.value();
+        queue.erase(it);
+        if(item.bClose)
+            emit closeDue();
+        else
+            emit deliver(item.data);
+    }
+    schedule();
+}
@@ -0,0 +1,100 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef IMPAIREDLINK_H
+#define IMPAIREDLINK_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QMultiMap>
+#include <QTimer>
+#include <QElapsedTimer>
+
+
+// Conditions applied to one direction of a proxied link
+struct ImpairmentProfile
+{
+    ImpairmentProfile();
+
+    QString name;
+    int     latencyMs;    // One way
+    int     jitterMs;     // Uniform in [-jitter, +jitter]
+    qint64  bandwidthBps; // 0 for unlimited
+    double  lossRate;     // Streams pay a retransmission instead
+    double  reorderRate;  // Datagrams only
+    int     stallAfterMs; // Half-open stall after connection, -1 never
+
+    QString toString() const;
+
+    static QStringList builtinNames();
+    static bool fromString(const QString &sSpec, ImpairmentProfile *pProfile, QString *pError);
+};
+
+
+// Delay line with a bandwidth limit. In Stream mode the bytes keep
+// their order and a loss delays everything behind it by a
+// retransmission timeout, as TCP would. In Datagram mode losses drop
+// and reordering lets later datagrams overtake. A stalled link keeps
+// everything it receives: the peers see a half-open connection.
+class ImpairedLink : public QObject
+{
+    Q_OBJECT
+public:
+    enum Mode { Stream, Datagram };
+
+    ImpairedLink(Mode _mode, const ImpairmentProfile &_profile, QObject *parent=Q_NULLPTR);
+
+    void    push(const QByteArray &data);
+    void    pushClose();
+    void    setStalled(bool bStall);
+    bool    isStalled() const { return bStalled; }
+    quint64 dropped() const { return nDropped; }
+    quint64 retransmitted() const { return nRetransmitted; }
+
+signals:
+    void deliver(QByteArray data);
+    void closeDue();
+
+private slots:
+    void onTimeToDeliver();
+
+private:
+    struct Item {
+        QByteArray data;
+        bool       bClose;
+    };
+    void   enqueue(const Item &item, qint64 size);
+    void   schedule();
+    static double uniform();
+
+private:
+    Mode                    mode;
+    ImpairmentProfile       profile;
+    QMultiMap<qint64, Item> queue;      // By due time, ns
+    QElapsedTimer           clock;
+    QTimer                  deliveryTimer;
+    qint64                  linkFreeNs; // End of the last serialization
+    qint64                  lastDueNs;
+    bool                    bStalled;
+    quint64                 nDropped;
+    quint64                 nRetransmitted;
+};
+
+#endif // IMPAIREDLINK_H
@@ -0,0 +1,173 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QHostAddress>
+
+#include "impairedlink.h"
+#include "proxy.h"
+#include "scenario.h"
+#include "utility.h"
+
+#define SCENARIO_BASE_PORT 45470
+
+
+// "host:port"
+bool
+parseTarget(const QString &sTarget, QString *pHost, quint16 *pPort) {
+    int colon = sTarget.lastIndexOf(QChar(':'));
+    if(colon <= 0)
+        return false;
+    bool ok;
+    *pHost = sTarget.left(colon);
+    *pPort = quint16(sTarget.mid(colon+1).toUInt(&ok));
+    return ok && *pPort != 0;
+}
+
+
+int
+main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Gabriele.Salvato");
+    QCoreApplication::setApplicationName("netimpair");
+    QCoreApplication::setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Network impairment proxy for TRemote.\n"
+        "  netimpair proxy --listen 45464 --target server:45454 --profile cellular\n"
+        "  netimpair proxy --udp --listen 45453 --multicast 224.0.0.1 --target server:45453\n"
+        "                  --server-port 45464\n"
+        "  netimpair scenario --profiles \"lan;wifi;cellular;slow,loss=0.05\"\n"
+        "A profile is a built-in name, optionally followed by overrides, or only\n"
+        "overrides: \"slow,loss=0.1\", \"latency=150,jitter=30,bw=256k,loss=0.01\".\n"
+        "Keys: latency, jitter (ms), bw (bit/s, k and M suffixes), loss, reorder\n"
+        "(0..1) and stall (ms after the connection, half-open).");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("mode", "proxy, scenario or profiles.");
+    QCommandLineOption listenOption(QStringList() << "l" << "listen",
+                                    "Local port of the proxy.", "port");
+    QCommandLineOption targetOption(QStringList() << "t" << "target",
+                                    "Where the proxy forwards to.", "host:port");
+    QCommandLineOption profileOption(QStringList() << "p" << "profile",
+                                     "Impairment of the proxy (default none).", "profile", "none");
+    QCommandLineOption udpOption(QStringList() << "u" << "udp",
+                                 "Relay datagrams (discovery) instead of TCP.");
+    QCommandLineOption multicastOption(QStringList() << "m" << "multicast",
+                                       "Multicast group joined by the UDP relay.", "group");
+    QCommandLineOption serverPortOption(QStringList() << "s" << "server-port",
+                                        "Port written into the relayed discovery answers, "
+                                        "to connect through a TCP proxy.", "port");
+    QCommandLineOption profilesOption(QStringList() << "profiles",
+                                      "Profiles measured by the scenario, separated by ';' "
+                                      "(default: every built-in profile but stall).", "list");
+    QCommandLineOption runsOption(QStringList() << "r" << "runs",
+                                  "Runs per profile (default 5).", "n", "5");
+    QCommandLineOption messagesOption(QStringList() << "n" << "messages",
+                                      "Commands per run (default 20).", "n", "20");
+    parser.addOption(listenOption);
+    parser.addOption(targetOption);
+    parser.addOption(profileOption);
+    parser.addOption(udpOption);
+    parser.addOption(multicastOption);
+    parser.addOption(serverPortOption);
+    parser.addOption(profilesOption);
+    parser.addOption(runsOption);
+    parser.addOption(messagesOption);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    setLogLevel(LogError);
+    if(parser.positionalArguments().count() != 1)
+        parser.showHelp(1);
+    QString sMode = parser.positionalArguments().at(0);
+    QString sError;
+
+    if(sMode == QString("profiles")) {
+        QStringList names = ImpairmentProfile::builtinNames();
+        for(int i=0; i<names.count(); i++) {
+            ImpairmentProfile profile;
+            ImpairmentProfile::fromString(names.at(i), &profile, &sError);
+            out << profile.toString() << endl;
+        }
+        return 0;
+    }
+
+    if(sMode == QString("scenario")) {
+        QStringList specs;
+        if(parser.isSet(profilesOption))
+            specs = parser.value(profilesOption).split(QChar(';'), QString::SkipEmptyParts);
+        else {
+            specs = ImpairmentProfile::builtinNames();
+            specs.removeAll(QString("stall"));
+        }
+        QList<ImpairmentProfile> profiles;
+        for(int i=0; i<specs.count(); i++) {
+            ImpairmentProfile profile;
+            if(!ImpairmentProfile::fromString(specs.at(i), &profile, &sError)) {
+                err << sError << endl;
+                return 1;
+            }
+            profiles.append(profile);
+        }
+        Scenario scenario(SCENARIO_BASE_PORT,
+                          parser.value(runsOption).toInt(),
+                          parser.value(messagesOption).toInt());
+        return scenario.run(profiles);
+    }
+
+    if(sMode != QString("proxy"))
+        parser.showHelp(1);
+    ImpairmentProfile profile;
+    if(!ImpairmentProfile::fromString(parser.value(profileOption), &profile, &sError)) {
+        err << sError << endl;
+        return 1;
+    }
+    QString sHost;
+    quint16 targetPort;
+    quint16 listenPort = quint16(parser.value(listenOption).toUInt());
+    if(listenPort == 0 || !parseTarget(parser.value(targetOption), &sHost, &targetPort)) {
+        err << "proxy needs --listen and --target" << endl;
+        return 1;
+    }
+    out << profile.toString() << endl;
+    if(parser.isSet(udpOption)) {
+        UdpProxy *pProxy = new UdpProxy(profile, &app);
+        QHostAddress group;
+        if(parser.isSet(multicastOption))
+            group = QHostAddress(parser.value(multicastOption));
+        if(parser.isSet(serverPortOption))
+            pProxy->setServerPort(quint16(parser.value(serverPortOption).toUInt()));
+        if(!pProxy->listen(listenPort, group, sHost, targetPort)) {
+            err << "Unable to relay port " << listenPort << ": " << pProxy->errorString() << endl;
+            return 1;
+        }
+    }
+    else {
+        TcpProxy *pProxy = new TcpProxy(profile, &app);
+        if(!pProxy->listen(listenPort, sHost, targetPort)) {
+            err << "Unable to listen on port " << listenPort << ": " << pProxy->errorString() << endl;
+            return 1;
+        }
+    }
+    return app.exec();
+}
@@ -0,0 +1,56 @@
+#-------------------------------------------------
+#
+# Network impairment proxy and reconnection
+# performance scenarios for TRemote
+#
+#-------------------------------------------------
+
+
+QT += core
+QT += network
+QT += websockets
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = netimpair
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+INCLUDEPATH += ../soak
+
+SOURCES += main.cpp
+SOURCES += impairedlink.cpp
+SOURCES += proxy.cpp
+SOURCES += scenario.cpp
+SOURCES += ../soak/standinserver.cpp
+SOURCES += ../../connectionmanager.cpp
+SOURCES += ../../networkmonitor.cpp
+SOURCES += ../../serverdiscoverer.cpp
+SOURCES += ../../livenessdetector.cpp
+SOURCES += ../../transport.cpp
+SOURCES += ../../websocketcodec.cpp
+SOURCES += ../../tlspolicy.cpp
+SOURCES += ../../utility.cpp
+SOURCES += ../../binarylog.cpp
+SOURCES += ../../tracer.cpp
+SOURCES += ../../metrics.cpp
+SOURCES += ../../readbackhistory.cpp
+
+HEADERS += impairedlink.h
+HEADERS += proxy.h
+HEADERS += scenario.h
+HEADERS += ../soak/standinserver.h
+HEADERS += ../../connectionmanager.h
+HEADERS += ../../networkmonitor.h
+HEADERS += ../../serverdiscoverer.h
+HEADERS += ../../livenessdetector.h
+HEADERS += ../../transport.h
+HEADERS += ../../websocketcodec.h
+HEADERS += ../../tlspolicy.h
+HEADERS += ../../utility.h
+HEADERS += ../../binarylog.h
+HEADERS += ../../tracer.h
+HEADERS += ../../metrics.h
+HEADERS += ../../readbackhistory.h
@@ -0,0 +1,340 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QHostInfo>
+#include <QStringList>
+
+#include "proxy.h"
+#include "utility.h"
+
+
+////////////////////////////////////////////////////////////////////////
+// ProxiedConnection
+////////////////////////////////////////////////////////////////////////
+
+ProxiedConnection::ProxiedConnection(QTcpSocket *_pClient,
+                                     const QString &sTargetHost,
+                                     quint16 targetPort,
+                                     const ImpairmentProfile &profile,
+                                     QObject *parent)
+    : QObject(parent)
+    , pClient(_pClient)
+    , bClientOpen(true)
+    , bServerOpen(true)
+{
+    pClient->setParent(this);
+    pServer = new QTcpSocket(this);
+    pUp     = new ImpairedLink(ImpairedLink::Stream, profile, this);
+    pDown   = new ImpairedLink(ImpairedLink::Stream, profile, this);
+
+    connect(pClient, SIGNAL(readyRead()),
+            this, SLOT(onClientReadyRead()));
+    connect(pClient, SIGNAL(disconnected()),
+            this, SLOT(onClientDisconnected()));
+    connect(pServer, SIGNAL(readyRead()),
+            this, SLOT(onServerReadyRead()));
+    connect(pServer, SIGNAL(disconnected()),
+            this, SLOT(onServerDisconnected()));
+    // A refused upstream connection looks like a server that went away
+    connect(pServer, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(onServerDisconnected()));
+    connect(pUp, SIGNAL(deliver(QByteArray)),
+            this, SLOT(onDeliverUp(QByteArray)));
+    connect(pDown, SIGNAL(deliver(QByteArray)),
+            this, SLOT(onDeliverDown(QByteArray)));
+    connect(pUp, SIGNAL(closeDue()),
+            this, SLOT(onCloseUp()));
+    connect(pDown, SIGNAL(closeDue()),
+            this, SLOT(onCloseDown()));
+
+    if(profile.stallAfterMs >= 0) {
+        stallTimer.setSingleShot(true);
+        connect(&stallTimer, SIGNAL(timeout()),
+                this, SLOT(stall()));
+        stallTimer.start(profile.stallAfterMs);
+    }
+    pServer->connectToHost(sTargetHost, targetPort);
+}
+
+
+// Both directions freeze without any FIN or RST
+void
+ProxiedConnection::stall() {
+    pUp->setStalled(true);
+    pDown->setStalled(true);
+}
+
+
+void
+ProxiedConnection::resume() {
+    pUp->setStalled(false);
+    pDown->setStalled(false);
+}
+
+
+void
+ProxiedConnection::drop() {
+    disconnect(pClient, 0, this, 0);
+    disconnect(pServer, 0, this, 0);
+    pClient->abort();
+    pServer->abort();
+    bClientOpen = false;
+    bServerOpen = false;
+    emit closed();
+}
+
+
+void
+ProxiedConnection::onClientReadyRead() {
+    pUp->push(pClient->readAll());
+}
+
+
+void
+ProxiedConnection::onServerReadyRead() {
+    pDown->push(pServer->readAll());
+}
+
+
+void
+ProxiedConnection::onClientDisconnected() {
+    if(!bClientOpen)
+        return;
+    bClientOpen = false;
+    pUp->pushClose();
+}
+
+
+void
+ProxiedConnection::onServerDisconnected() {
+    if(!bServerOpen)
+        return;
+    bServerOpen = false;
+    pDown->pushClose();
+}
+
+
+void
+ProxiedConnection::onDeliverUp(QByteArray data) {
+    pServer->write(data);
+}
+
+
+void
+ProxiedConnection::onDeliverDown(QByteArray data) {
+    pClient->write(data);
+}
+
+
+void
+ProxiedConnection::onCloseUp() {
+    pServer->disconnectFromHost();
+    closeIfDone();
+}
+
+
+void
+ProxiedConnection::onCloseDown() {
+    pClient->disconnectFromHost();
+    closeIfDone();
+}
+
+
+void
+ProxiedConnection::closeIfDone() {
+    if(!bClientOpen || !bServerOpen) {
+        disconnect(pClient, 0, this, 0);
+        disconnect(pServer, 0, this, 0);
+        emit closed();
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// TcpProxy
+////////////////////////////////////////////////////////////////////////
+
+TcpProxy::TcpProxy(const ImpairmentProfile &_profile, QObject *parent)
+    : QObject(parent)
+    , profile(_profile)
+    , targetPort(0)
+{
+    pServer = new QTcpServer(this);
+    connect(pServer, SIGNAL(newConnection()),
+            this, SLOT(onNewConnection()));
+}
+
+
+bool
+TcpProxy::listen(quint16 port, const QString &_sTargetHost, quint16 _targetPort) {
+    sTargetHost = _sTargetHost;
+    targetPort  = _targetPort;
+    return pServer->listen(QHostAddress::Any, port);
+}
+
+
+QString
+TcpProxy::errorString() const {
+    return pServer->errorString();
+}
+
+
+void
+TcpProxy::stallAll() {
+    for(int i=0; i<connections.count(); i++)
+        connections.at(i)->stall();
+}
+
+
+void
+TcpProxy::resumeAll() {
+    for(int i=0; i<connections.count(); i++)
+        connections.at(i)->resume();
+}
+
+
+void
+TcpProxy::dropAll() {
+    QList<ProxiedConnection*> dropped = connections;
+    for(int i=0; i<dropped.count(); i++)
+        dropped.at(i)->drop();
+}
+
+
+void
+TcpProxy::onNewConnection() {
+    while(pServer->hasPendingConnections()) {
+        ProxiedConnection *pConnection = new ProxiedConnection(pServer->nextPendingConnection(),
+                                                               sTargetHost,
+                                                               targetPort,
+                                                               profile,
+                                                               this);
+        connect(pConnection, SIGNAL(closed()),
+                this, SLOT(onConnectionClosed()));
+        connections.append(pConnection);
+    }
+}
+
+
+void
+TcpProxy::onConnectionClosed() {
+    ProxiedConnection *pConnection = qobject_cast<ProxiedConnection *>(sender());
+    connections.removeAll(pConnection);
+    pConnection->deleteLater();
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// UdpProxy
+////////////////////////////////////////////////////////////////////////
+
+UdpProxy::UdpProxy(const ImpairmentProfile &_profile, QObject *parent)
+    : QObject(parent)
+    , targetPort(0)
+    , clientPort(0)
+    , serverPort(0)
+{
+    pListenSocket   = new QUdpSocket(this);
+    pUpstreamSocket = new QUdpSocket(this);
+    pUp   = new ImpairedLink(ImpairedLink::Datagram, _profile, this);
+    pDown = new ImpairedLink(ImpairedLink::Datagram, _profile, this);
+    connect(pListenSocket, SIGNAL(readyRead()),
+            this, SLOT(onClientDatagram()));
+    connect(pUpstreamSocket, SIGNAL(readyRead()),
+            this, SLOT(onServerDatagram()));
+    connect(pUp, SIGNAL(deliver(QByteArray)),
+            this, SLOT(onDeliverUp(QByteArray)));
+    connect(pDown, SIGNAL(deliver(QByteArray)),
+            this, SLOT(onDeliverDown(QByteArray)));
+}
+
+
+bool
+UdpProxy::listen(quint16 port,
+                 const QHostAddress &multicastGroup,
+                 const QString &sTargetHost,
+                 quint16 _targetPort)
+{
+    QHostInfo info = QHostInfo::fromName(sTargetHost);
+    if(info.addresses().isEmpty())
+        return false;
+    targetAddress = info.addresses().first();
+    targetPort    = _targetPort;
+    if(!pListenSocket->bind(QHostAddress::AnyIPv4, port,
+                            QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint))
+        return false;
+    if(!multicastGroup.isNull() && !pListenSocket->joinMulticastGroup(multicastGroup))
+        return false;
+    return pUpstreamSocket->bind(QHostAddress::AnyIPv4, 0);
+}
+
+
+QString
+UdpProxy::errorString() const {
+    return pListenSocket->errorString();
+}
+
+
+void
+UdpProxy::onClientDatagram() {
+    QByteArray datagram;
+    while(pListenSocket->hasPendingDatagrams()) {
+        datagram.resize(int(pListenSocket->pendingDatagramSize()));
+        pListenSocket->readDatagram(datagram.data(), datagram.size(), &clientAddress, &clientPort);
+        pUp->push(datagram);
+    }
+}
+
+
+void
+UdpProxy::onServerDatagram() {
+    QByteArray datagram;
+    while(pUpstreamSocket->hasPendingDatagrams()) {
+        datagram.resize(int(pUpstreamSocket->pendingDatagramSize()));
+        pUpstreamSocket->readDatagram(datagram.data(), datagram.size());
+        QString sAddresses = XML_Parse(QString::fromUtf8(datagram), "serverIP");
+        if(serverPort != 0 && sAddresses != QString("NoData")) {
+            // Only IPv4 addresses can carry a port in the answer
+            QStringList addresses = sAddresses.split(QChar(';'), QString::SkipEmptyParts);
+            QStringList rewritten;
+            for(int i=0; i<addresses.count(); i++) {
+                QString sAddress = addresses.at(i).trimmed().section(QChar(':'), 0, 0);
+                if(QHostAddress(sAddress).protocol() == QAbstractSocket::IPv4Protocol)
+                    rewritten.append(QString("%1:%2").arg(sAddress).arg(serverPort));
+            }
+            datagram = QString("<serverIP>%1</serverIP>").arg(rewritten.join(QChar(';'))).toUtf8();
+        }
+        pDown->push(datagram);
+    }
+}
+
+
+void
+UdpProxy::onDeliverUp(QByteArray data) {
+    pUpstreamSocket->writeDatagram(data, targetAddress, targetPort);
+}
+
+
+void
+UdpProxy::onDeliverDown(QByteArray data) {
+    if(clientPort != 0)
+        pListenSocket->writeDatagram(data, clientAddress, clientPort);
+}
@@ -0,0 +1,140 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <QHostAddress>
+
+#include "impairedlink.h"
+
+QT_FORWARD_DECLARE_CLASS(QTcpServer)
+QT_FORWARD_DECLARE_CLASS(QTcpSocket)
+QT_FORWARD_DECLARE_CLASS(QUdpSocket)
+
+
+// One client connection and its upstream twin, with an impaired link
+// per direction
+class ProxiedConnection : public QObject
+{
+    Q_OBJECT
+public:
+    ProxiedConnection(QTcpSocket *_pClient,
+                      const QString &sTargetHost,
+                      quint16 targetPort,
+                      const ImpairmentProfile &profile,
+                      QObject *parent=Q_NULLPTR);
+
+public slots:
+    void stall();
+    void resume();
+    void drop();
+
+signals:
+    void closed();
+
+private slots:
+    void onClientReadyRead();
+    void onServerReadyRead();
+    void onClientDisconnected();
+    void onServerDisconnected();
+    void onDeliverUp(QByteArray data);
+    void onDeliverDown(QByteArray data);
+    void onCloseUp();
+    void onCloseDown();
+
+private:
+    void closeIfDone();
+
+private:
+    QTcpSocket   *pClient;
+    QTcpSocket   *pServer;
+    ImpairedLink *pUp;
+    ImpairedLink *pDown;
+    QTimer        stallTimer;
+    bool          bClientOpen;
+    bool          bServerOpen;
+};
+
+
+// Impaired TCP (and so WebSocket) proxy
+class TcpProxy : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TcpProxy(const ImpairmentProfile &_profile, QObject *parent=Q_NULLPTR);
+
+    bool    listen(quint16 port, const QString &sTargetHost, quint16 _targetPort);
+    QString errorString() const;
+    int     connectionCount() const { return connections.count(); }
+    void    stallAll();
+    void    resumeAll();
+    void    dropAll();
+
+private slots:
+    void onNewConnection();
+    void onConnectionClosed();
+
+private:
+    ImpairmentProfile         profile;
+    QTcpServer               *pServer;
+    QString                   sTargetHost;
+    quint16                   targetPort;
+    QList<ProxiedConnection*> connections;
+};
+
+
+// Impaired UDP relay. Answers go back to the most recent client, which
+// is all the discovery exchange needs. With a server port set, the
+// addresses of the discovery answers are rewritten to "address:port",
+// so that the client connects through the TCP proxy listening there.
+class UdpProxy : public QObject
+{
+    Q_OBJECT
+public:
+    explicit UdpProxy(const ImpairmentProfile &_profile, QObject *parent=Q_NULLPTR);
+
+    bool    listen(quint16 port,
+                   const QHostAddress &multicastGroup,
+                   const QString &sTargetHost,
+                   quint16 _targetPort);
+    void    setServerPort(quint16 _serverPort) { serverPort = _serverPort; }
+    QString errorString() const;
+
+private slots:
+    void onClientDatagram();
+    void onServerDatagram();
+    void onDeliverUp(QByteArray data);
+    void onDeliverDown(QByteArray data);
+
+private:
+    QUdpSocket   *pListenSocket;
+    QUdpSocket   *pUpstreamSocket;
+    ImpairedLink *pUp;
+    ImpairedLink *pDown;
+    QHostAddress  targetAddress;
+    quint16       targetPort;
+    QHostAddress  clientAddress;
+    quint16       clientPort;
+    quint16       serverPort;   // Written into the answers, 0 to keep them
+};
+
+#endif // PROXY_H
@@ -0,0 +1,256 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+
+#include "scenario.h"
+#include "proxy.h"
+#include "standinserver.h"
+#include "connectionmanager.h"
+#include "utility.h"
+
+
+#define CONNECT_LIMIT    60000 // ms before an attempt counts as failed
+#define STANDBY_LIMIT    30000
+#define FAILOVER_LIMIT   60000
+#define ACK_LIMIT        30000
+#define DRAIN_LIMIT      10000
+#define MESSAGE_INTERVAL 100   // ms between two commands
+
+
+Scenario::Scenario(quint16 _basePort, int _nRuns, int _nMessages, QObject *parent)
+    : QObject(parent)
+    , basePort(_basePort)
+    , nRuns(qMax(1, _nRuns))
+    , nMessages(qMax(1, _nMessages))
+    , pCurrent(Q_NULLPTR)
+    , bFailedOver(false)
+{
+    clock.start();
+}
+
+
+// Ports: basePort and basePort+1 for the servers, basePort+10 and
+// basePort+11 for their proxies, basePort+12 for the discovery relays
+// and basePort+20, basePort+21 for the discovery of the servers
+int
+Scenario::run(const QList<ImpairmentProfile> &profiles) {
+    QTextStream out(stdout);
+    StandInServer primaryServer(basePort);
+    StandInServer standbyServer(basePort+1);
+    primaryServer.setDiscoveryPort(basePort+20);
+    standbyServer.setDiscoveryPort(basePort+21);
+    if(!primaryServer.start() || !standbyServer.start()) {
+        QTextStream(stderr) << "Unable to start the stand-in servers on port " << basePort << endl;
+        return 1;
+    }
+    out << QString("%1 %2 %3 %4 %5")
+           .arg(QString("profile"), -12)
+           .arg(QString("discover ms p50/p95"), -22)
+           .arg(QString("round trip ms p50/p95"), -22)
+           .arg(QString("failover ms p50/p95"), -22)
+           .arg(QString("failed runs"))
+        << endl;
+    int exitCode = 0;
+    for(int i=0; i<profiles.count(); i++) {
+        const ImpairmentProfile &profile = profiles.at(i);
+        TcpProxy primaryProxy(profile);
+        TcpProxy standbyProxy(profile);
+        if(!primaryProxy.listen(basePort+10, QString("127.0.0.1"), basePort) ||
+           !standbyProxy.listen(basePort+11, QString("127.0.0.1"), basePort+1))
+        {
+            QTextStream(stderr) << "Unable to listen: " << primaryProxy.errorString() << endl;
+            return 1;
+        }
+        // Both relays receive every discovery request; each one answers
+        // with the port of its server's proxy
+        UdpProxy primaryRelay(profile);
+        UdpProxy standbyRelay(profile);
+        primaryRelay.setServerPort(basePort+10);
+        standbyRelay.setServerPort(basePort+11);
+        if(!primaryRelay.listen(basePort+12, QHostAddress(QString("224.0.0.1")), QString("127.0.0.1"), basePort+20) ||
+           !standbyRelay.listen(basePort+12, QHostAddress(QString("224.0.0.1")), QString("127.0.0.1"), basePort+21))
+        {
+            QTextStream(stderr) << "Unable to relay the discovery: " << primaryRelay.errorString() << endl;
+            return 1;
+        }
+        QString sPrimaryUrl = QString("ws://127.0.0.1:%1").arg(basePort+10);
+        Result result;
+        result.nFailures = 0;
+        for(int run=0; run<nRuns; run++) {
+            // A fresh client each time: no state carried between runs
+            ConnectionManager connection;
+            connection.setDiscoveryPort(basePort+12);
+            if(!runOnce(&connection, sPrimaryUrl, &primaryProxy, &standbyProxy, &result))
+                result.nFailures++;
+            primaryProxy.dropAll();
+            standbyProxy.dropAll();
+            primaryServer.dropClients();
+            standbyServer.dropClients();
+            QCoreApplication::processEvents();
+        }
+        out << QString("%1 %2 %3 %4 %5/%6")
+               .arg(profile.name, -12)
+               .arg(percentiles(result.connectMs), -22)
+               .arg(percentiles(result.roundTripMs), -22)
+               .arg(percentiles(result.failoverMs), -22)
+               .arg(result.nFailures)
+               .arg(nRuns)
+            << endl;
+        if(result.nFailures > 0)
+            exitCode = 1;
+    }
+    return exitCode;
+}
+
+
+bool
+Scenario::runOnce(ConnectionManager *pConnection,
+                  const QString &sPrimaryUrl,
+                  TcpProxy *pPrimaryProxy,
+                  TcpProxy *pStandbyProxy,
+                  Result *pResult)
+{
+    pCurrent = pConnection;
+    sentNs.clear();
+    roundTrips.clear();
+    bFailedOver = false;
+    connect(pConnection, SIGNAL(textMessageReceived(QString)),
+            this, SLOT(onTextMessageReceived(QString)));
+    connect(pConnection, SIGNAL(failedOver(QString)),
+            this, SLOT(onFailedOver(QString)));
+    bool bSuccess = false;
+
+    // Time to discover a server through the relays and connect to it
+    qint64 t0 = clock.nsecsElapsed();
+    pConnection->startDiscovery();
+    if(waitUntil(&Scenario::isConnected, CONNECT_LIMIT)) {
+        pResult->connectMs.append(double(clock.nsecsElapsed()-t0)/1.0e6);
+
+        // Command round trips
+        for(int i=0; i<nMessages; i++) {
+            quint32 seq = quint32(i+1);
+            sentNs.insert(seq, clock.nsecsElapsed());
+            pConnection->sendTextMessage(QString("<setPercent>%1</setPercent><seq>%2</seq>")
+                                         .arg(i%100)
+                                         .arg(seq));
+            waitUntil(&Scenario::allAcknowledged, MESSAGE_INTERVAL);
+        }
+        bool bAcked = waitUntil(&Scenario::allAcknowledged, ACK_LIMIT);
+        pResult->roundTripMs += roundTrips;
+
+        // Failover after a half-open stall of the server in use. The
+        // manager finds the other one as its standby by discovery
+        pConnection->setHotStandby(true);
+        if(bAcked && waitUntil(&Scenario::isStandbyReady, STANDBY_LIMIT)) {
+            // Whichever server answered first is the one in use
+            TcpProxy *pActiveProxy = pConnection->serverUrl() == sPrimaryUrl ? pPrimaryProxy
+                                                                             : pStandbyProxy;
+            t0 = clock.nsecsElapsed();
+            pActiveProxy->stallAll();
+            if(waitUntil(&Scenario::hasFailedOver, FAILOVER_LIMIT)) {
+                pResult->failoverMs.append(double(clock.nsecsElapsed()-t0)/1.0e6);
+                bSuccess = true;
+            }
+            pActiveProxy->resumeAll();
+        }
+        pConnection->setHotStandby(false);
+    }
+    pConnection->disconnectFromServer();
+    waitUntil(&Scenario::isIdle, DRAIN_LIMIT);
+    disconnect(pConnection, 0, this, 0);
+    pCurrent = Q_NULLPTR;
+    return bSuccess;
+}
+
+
+// Keeps the event loop running until the condition holds
+bool
+Scenario::waitUntil(bool (Scenario::*condition)() const, int timeoutMs) {
+    QElapsedTimer waitClock;
+    waitClock.start();
+    while(!(this->*condition)()) {
+        if(waitClock.elapsed() >= timeoutMs)
+            return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+        QThread::msleep(1);
+    }
+    return true;
+}
+
+
+bool
+Scenario::isConnected() const {
+    return pCurrent->state() == ConnectionManager::Connected;
+}
+
+
+bool
+Scenario::isIdle() const {
+    return pCurrent->state() == ConnectionManager::Idle;
+}
+
+
+bool
+Scenario::isStandbyReady() const {
+    return !pCurrent->standbyUrl().isEmpty();
+}
+
+
+bool
+Scenario::allAcknowledged() const {
+    return sentNs.isEmpty();
+}
+
+
+bool
+Scenario::hasFailedOver() const {
+    return bFailedOver;
+}
+
+
+void
+Scenario::onTextMessageReceived(QString sMessage) {
+    QString sToken = XML_Parse(sMessage, "ack");
+    if(sToken == QString("NoData"))
+        return;
+    quint32 seq = sToken.toUInt();
+    if(sentNs.contains(seq))
+        roundTrips.append(double(clock.nsecsElapsed()-sentNs.take(seq))/1.0e6);
+}
+
+
+void
+Scenario::onFailedOver(QString sUrl) {
+    Q_UNUSED(sUrl)
+    bFailedOver = true;
+}
+
+
+QString
+Scenario::percentiles(QVector<double> values) {
+    if(values.isEmpty())
+        return QString("-");
+    std::sort(values.begin(), values.end());
+    double p50 = values.at((values.count()-1)/2);
+    double p95 = values.at(int(0.95*(values.count()-1)));
+    return QString("%1/%2").arg(p50, 0, 'f', 1).arg(p95, 0, 'f', 1);
+}
@@ -0,0 +1,83 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <QObject>
+#include <QList>
+#include <QMap>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "impairedlink.h"
+
+QT_FORWARD_DECLARE_CLASS(ConnectionManager)
+QT_FORWARD_DECLARE_CLASS(TcpProxy)
+
+
+// Scripted measurement of the TRemote connection logic behind two
+// impaired proxies (primary and hot standby) in front of stand-in
+// servers, found by discovery through two impaired UDP relays: time
+// to discover and connect, command round trip and failover time after
+// a half-open stall of the server in use, for each profile. Discovery
+// needs a multicast capable interface.
+class Scenario : public QObject
+{
+    Q_OBJECT
+public:
+    Scenario(quint16 _basePort, int _nRuns, int _nMessages, QObject *parent=Q_NULLPTR);
+
+    int run(const QList<ImpairmentProfile> &profiles);
+
+private slots:
+    void onTextMessageReceived(QString sMessage);
+    void onFailedOver(QString sUrl);
+
+private:
+    struct Result {
+        QVector<double> connectMs;
+        QVector<double> roundTripMs;
+        QVector<double> failoverMs;
+        int             nFailures;
+    };
+    bool   runOnce(ConnectionManager *pConnection,
+                   const QString &sPrimaryUrl,
+                   TcpProxy *pPrimaryProxy,
+                   TcpProxy *pStandbyProxy,
+                   Result *pResult);
+    bool   waitUntil(bool (Scenario::*condition)() const, int timeoutMs);
+    bool   isConnected() const;
+    bool   isIdle() const;
+    bool   isStandbyReady() const;
+    bool   allAcknowledged() const;
+    bool   hasFailedOver() const;
+    static QString percentiles(QVector<double> values);
+
+private:
+    quint16                 basePort;
+    int                     nRuns;
+    int                     nMessages;
+    ConnectionManager      *pCurrent;
+    QElapsedTimer           clock;
+    QMap<quint32, qint64>   sentNs;   // Commands waiting for their ack
+    QVector<double>         roundTrips;
+    bool                    bFailedOver;
+};
+
+#endif // SCENARIO_H
@@ -0,0 +1,77 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+#include "connectionmanager.h"
+#include "standinserver.h"
+#include "soakrunner.h"
+#include "utility.h"
+
+#define SERVER_PORT 45454 // The one the discovery answers point to
+
+
+int
+main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Gabriele.Salvato");
+    QCoreApplication::setApplicationName("TRemoteSoak");
+    QCoreApplication::setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs the TRemote connection core through fault cycles "
+                                     "and fails if memory, descriptors, objects or timers grow");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption cyclesOption(QStringList() << "c" << "cycles",
+                                    "Fault cycles to run (default 2000).",
+                                    "n", "2000");
+    QCommandLineOption scaleOption(QStringList() << "s" << "time-scale",
+                                   "Divide every protocol timer by this factor (default 50).",
+                                   "factor", "50");
+    QCommandLineOption sampleOption(QStringList() << "e" << "sample-every",
+                                    "Cycles between two resource samples (default 10).",
+                                    "n", "10");
+    QCommandLineOption verboseOption(QStringList() << "v" << "verbose",
+                                     "Log the connection events.");
+    parser.addOption(cyclesOption);
+    parser.addOption(scaleOption);
+    parser.addOption(sampleOption);
+    parser.addOption(verboseOption);
+    parser.process(app);
+
+    setTimeScale(parser.value(scaleOption).toInt());
+    setLogLevel(parser.isSet(verboseOption) ? LogDebug : LogError);
+
+    StandInServer server(SERVER_PORT);
+    if(!server.start()) {
+        QTextStream(stderr) << "Unable to listen on port " << SERVER_PORT << endl;
+        return 1;
+    }
+    ConnectionManager connection;
+    SoakRunner runner(&connection,
+                      &server,
+                      parser.value(cyclesOption).toInt(),
+                      parser.value(sampleOption).toInt());
+    QObject::connect(&runner, SIGNAL(finished(int)),
+                     &app, SLOT(exit(int)));
+    runner.start();
+    return app.exec();
+}
@@ -0,0 +1,52 @@
+#-------------------------------------------------
+#
+# Soak harness: drives the TRemote connection core
+# through endless faults against a local stand-in
+# server and fails on resource growth (Linux only)
+#
+#-------------------------------------------------
+
+
+QT += core
+QT += network
+QT += websockets
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = soak
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
+SOURCES += standinserver.cpp
+SOURCES += soakrunner.cpp
+SOURCES += ../../connectionmanager.cpp
+SOURCES += ../../networkmonitor.cpp
+SOURCES += ../../serverdiscoverer.cpp
+SOURCES += ../../livenessdetector.cpp
+SOURCES += ../../transport.cpp
+SOURCES += ../../websocketcodec.cpp
+SOURCES += ../../tlspolicy.cpp
+SOURCES += ../../utility.cpp
+SOURCES += ../../binarylog.cpp
+SOURCES += ../../tracer.cpp
+SOURCES += ../../metrics.cpp
+SOURCES += ../../readbackhistory.cpp
+
+HEADERS += standinserver.h
+HEADERS += soakrunner.h
+HEADERS += ../../connectionmanager.h
+HEADERS += ../../networkmonitor.h
+HEADERS += ../../serverdiscoverer.h
+HEADERS += ../../livenessdetector.h
+HEADERS += ../../transport.h
+HEADERS += ../../websocketcodec.h
+HEADERS += ../../tlspolicy.h
+HEADERS += ../../utility.h
+HEADERS += ../../binarylog.h
+HEADERS += ../../tracer.h
+HEADERS += ../../metrics.h
+HEADERS += ../../readbackhistory.h
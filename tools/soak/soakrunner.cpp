@@ -0,0 +1,291 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QCoreApplication>
+#include <QAbstractEventDispatcher>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QNetworkInterface>
+#include <unistd.h>
+#include <atomic>
+
+#include "soakrunner.h"
+#include "standinserver.h"
+#include "utility.h"
+
+
+#define HOLD_TIME         1000  // ms connected before the next fault
+#define RESTART_DOWNTIME  3000  // ms the server stays down
+#define FLAP_DOWNTIME     2000  // ms the network stays down
+#define NUDGE_TIME        15000 // ms before the address is entered by hand
+#define MAX_NUDGES        3     // Unrecovered cycles make the run fail
+#define WARMUP_CYCLES     50    // Caches, pools and metrics settle first
+
+// Allowed growth between the first and the last quarter of the samples
+#define RSS_TOLERANCE_KB  4096
+#define RSS_TOLERANCE     0.10
+#define FD_TOLERANCE      4
+#define OBJECT_TOLERANCE  8
+#define TIMER_TOLERANCE   4
+
+
+namespace {
+
+// The monitor thread reads the interfaces through this source: while a
+// flap is injected it sees none, as after every cable was pulled
+std::atomic<bool> bInterfacesDown(false);
+
+QList<QNetworkInterface>
+soakInterfaces() {
+    if(bInterfacesDown.load(std::memory_order_relaxed))
+        return QList<QNetworkInterface>();
+    return QNetworkInterface::allInterfaces();
+}
+
+}
+
+
+SoakRunner::SoakRunner(ConnectionManager *_pConnection,
+                       StandInServer *_pServer,
+                       int _nCycles,
+                       int _sampleEvery,
+                       QObject *parent)
+    : QObject(parent)
+    , pConnection(_pConnection)
+    , pServer(_pServer)
+    , nCycles(_nCycles)
+    , sampleEvery(qMax(1, _sampleEvery))
+    , cycle(0)
+    , nNudges(0)
+    , bWaitingRecovery(true)
+{
+    faultTimer.setSingleShot(true);
+    recoveryTimer.setSingleShot(true);
+    connect(&faultTimer, SIGNAL(timeout()),
+            this, SLOT(onTimeToInjectFault()));
+    connect(&recoveryTimer, SIGNAL(timeout()),
+            this, SLOT(onRecoveryTimeout()));
+    connect(pConnection, SIGNAL(stateChanged(ConnectionManager::State)),
+            this, SLOT(onStateChanged(ConnectionManager::State)));
+    pConnection->setInterfaceSource(soakInterfaces);
+}
+
+
+void
+SoakRunner::start() {
+    runClock.start();
+    recoveryTimer.start(scaledMs(NUDGE_TIME));
+    pConnection->connectToServer(pServer->url());
+}
+
+
+void
+SoakRunner::onStateChanged(ConnectionManager::State newState) {
+    if(newState != ConnectionManager::Connected || !bWaitingRecovery)
+        return;
+    bWaitingRecovery = false;
+    recoveryTimer.stop();
+    nNudges = 0;
+    if(cycle >= WARMUP_CYCLES && (cycle % sampleEvery) == 0)
+        takeSample();
+    if(cycle >= nCycles) {
+        finish(evaluate());
+        return;
+    }
+    faultTimer.start(scaledMs(HOLD_TIME));
+}
+
+
+void
+SoakRunner::onTimeToInjectFault() {
+    Fault fault = Fault(cycle % nFaults);
+    cycle++;
+    bWaitingRecovery = true;
+    recoveryTimer.start(scaledMs(NUDGE_TIME));
+    switch(fault) {
+    case LinkDrop:
+        pServer->dropClients();
+        break;
+    case ServerRestart:
+        pServer->stop();
+        QTimer::singleShot(scaledMs(RESTART_DOWNTIME), this, SLOT(onTimeToRestartServer()));
+        break;
+    case InterfaceFlap:
+        // Simulated: the network monitor sees every interface disappear
+        // and the reconnection must wait for them to come back
+        bInterfacesDown.store(true, std::memory_order_relaxed);
+        pServer->dropClients();
+        QTimer::singleShot(scaledMs(FLAP_DOWNTIME), this, SLOT(onTimeToRestoreNetwork()));
+        break;
+    case OverlappingRequests:
+        // A user impatiently pressing "Connect": the requests must merge
+        pConnection->disconnectFromServer();
+        pConnection->startDiscovery();
+        pConnection->connectToServer(pServer->url());
+        pConnection->startDiscovery();
+        pConnection->connectToServer(pServer->url());
+        break;
+    default:
+        break;
+    }
+    if(cycle % 100 == 0) {
+        QTextStream out(stdout);
+        out << "cycle " << cycle << "/" << nCycles
+            << " after " << runClock.elapsed()/1000 << " s" << endl;
+    }
+}
+
+
+void
+SoakRunner::onTimeToRestartServer() {
+    if(!pServer->start()) {
+        // The port may still be in TIME_WAIT
+        QTimer::singleShot(scaledMs(RESTART_DOWNTIME), this, SLOT(onTimeToRestartServer()));
+    }
+}
+
+
+void
+SoakRunner::onTimeToRestoreNetwork() {
+    // Noticed by the next scan of the network monitor
+    bInterfacesDown.store(false, std::memory_order_relaxed);
+}
+
+
+// Discovery needs multicast, which the host may not route: after a
+// while the address is entered by hand, as a user would
+void
+SoakRunner::onRecoveryTimeout() {
+    if(++nNudges > MAX_NUDGES) {
+        QTextStream err(stderr);
+        err << "No recovery after cycle " << cycle
+            << " (state " << ConnectionManager::stateName(pConnection->state()) << ")" << endl;
+        finish(2);
+        return;
+    }
+    if(!pServer->isListening())
+        pServer->start();
+    if(pConnection->state() != ConnectionManager::Connecting)
+        pConnection->connectToServer(pServer->url());
+    recoveryTimer.start(scaledMs(NUDGE_TIME));
+}
+
+
+void
+SoakRunner::takeSample() {
+    Sample sample;
+    sample.cycle   = cycle;
+    sample.rssKb   = residentKb();
+    sample.fds     = openDescriptors();
+    sample.objects = countObjects(false);
+    sample.timers  = countObjects(true);
+    samples.append(sample);
+}
+
+
+int
+SoakRunner::evaluate() {
+    QTextStream out(stdout);
+    out << cycle << " cycles in " << runClock.elapsed()/1000 << " s, "
+        << samples.count() << " samples" << endl;
+    out << pConnection->transitionSummary() << endl;
+    if(samples.count() < 8) {
+        out << "Not enough samples: run more cycles" << endl;
+        return 1;
+    }
+    int nQuarter = samples.count()/4;
+    double first[4] = { 0.0, 0.0, 0.0, 0.0 };
+    double last[4]  = { 0.0, 0.0, 0.0, 0.0 };
+    for(int i=0; i<nQuarter; i++) {
+        const Sample &a = samples.at(i);
+        const Sample &b = samples.at(samples.count()-nQuarter+i);
+        first[0] += a.rssKb;   last[0] += b.rssKb;
+        first[1] += a.fds;     last[1] += b.fds;
+        first[2] += a.objects; last[2] += b.objects;
+        first[3] += a.timers;  last[3] += b.timers;
+    }
+    static const char *names[4] = { "RSS (kB)", "descriptors", "QObjects", "timers" };
+    double tolerance[4] = {
+        qMax(double(RSS_TOLERANCE_KB), RSS_TOLERANCE*first[0]/nQuarter),
+        FD_TOLERANCE,
+        OBJECT_TOLERANCE,
+        TIMER_TOLERANCE
+    };
+    int exitCode = 0;
+    for(int i=0; i<4; i++) {
+        double growth = (last[i]-first[i])/nQuarter;
+        bool bFailed = growth > tolerance[i];
+        out << QString("%1 %2 -> %3 (growth %4, tolerance %5) %6")
+               .arg(names[i], -14)
+               .arg(first[i]/nQuarter, 0, 'f', 1)
+               .arg(last[i]/nQuarter, 0, 'f', 1)
+               .arg(growth, 0, 'f', 1)
+               .arg(tolerance[i], 0, 'f', 1)
+               .arg(bFailed ? "FAIL" : "ok")
+            << endl;
+        if(bFailed)
+            exitCode = 1;
+    }
+    return exitCode;
+}
+
+
+void
+SoakRunner::finish(int exitCode) {
+    faultTimer.stop();
+    recoveryTimer.stop();
+    disconnect(pConnection, 0, this, 0);
+    emit finished(exitCode);
+}
+
+
+qint64
+SoakRunner::residentKb() {
+    QFile file("/proc/self/statm");
+    if(!file.open(QIODevice::ReadOnly))
+        return 0;
+    QList<QByteArray> fields = file.readAll().split(' ');
+    if(fields.count() < 2)
+        return 0;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+
+int
+SoakRunner::openDescriptors() {
+    QDir fdDir("/proc/self/fd");
+    return fdDir.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot).count();
+}
+
+
+// Everything the client and the stand-in server own. Timers are
+// counted in the event dispatcher: QTimer and QObject::startTimer() alike
+int
+SoakRunner::countObjects(bool bTimersOnly) const {
+    QList<QObject*> objects = pConnection->findChildren<QObject*>();
+    objects += pServer->findChildren<QObject*>();
+    objects << pConnection << pServer;
+    if(!bTimersOnly)
+        return objects.count();
+    QAbstractEventDispatcher *pDispatcher = QAbstractEventDispatcher::instance();
+    int nTimers = 0;
+    for(int i=0; i<objects.count(); i++)
+        nTimers += pDispatcher->registeredTimers(objects.at(i)).count();
+    return nTimers;
+}
@@ -0,0 +1,94 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef SOAKRUNNER_H
+#define SOAKRUNNER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include <QElapsedTimer>
+
+#include "connectionmanager.h"
+
+QT_FORWARD_DECLARE_CLASS(StandInServer)
+
+
+// Drives the connection through nCycles fault cycles (link drop,
+// server restart, simulated interface flap, overlapping connection
+// requests), samples the process resources once connected again and
+// finally checks that none of them keeps growing.
+class SoakRunner : public QObject
+{
+    Q_OBJECT
+public:
+    SoakRunner(ConnectionManager *_pConnection,
+               StandInServer *_pServer,
+               int _nCycles,
+               int _sampleEvery,
+               QObject *parent=Q_NULLPTR);
+    void start();
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void onStateChanged(ConnectionManager::State newState);
+    void onTimeToInjectFault();
+    void onTimeToRestartServer();
+    void onTimeToRestoreNetwork();
+    void onRecoveryTimeout();
+
+private:
+    struct Sample {
+        int    cycle;
+        qint64 rssKb;
+        int    fds;
+        int    objects;
+        int    timers;
+    };
+    enum Fault {
+        LinkDrop,
+        ServerRestart,
+        InterfaceFlap,
+        OverlappingRequests,
+        nFaults
+    };
+
+    void   takeSample();
+    int    evaluate();
+    void   finish(int exitCode);
+    static qint64 residentKb();
+    static int    openDescriptors();
+    int    countObjects(bool bTimersOnly) const;
+
+private:
+    ConnectionManager *pConnection;
+    StandInServer     *pServer;
+    int                nCycles;
+    int                sampleEvery;
+    int                cycle;
+    int                nNudges;
+    bool               bWaitingRecovery;
+    QTimer             faultTimer;
+    QTimer             recoveryTimer;
+    QElapsedTimer      runClock;
+    QVector<Sample>    samples;
+};
+
+#endif // SOAKRUNNER_H
@@ -0,0 +1,207 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QWebSocketServer>
+#include <QWebSocket>
+#include <QUdpSocket>
+#include <QHostAddress>
+
+#include "standinserver.h"
+#include "utility.h"
+
+#define DISCOVERY_PORT  45453
+#define READBACK_PERIOD 200 // ms, before the time scale
+#define HISTORY_LENGTH  18000 // Readbacks kept: one hour
+
+
+StandInServer::StandInServer(quint16 _port, QObject *parent)
+    : QObject(parent)
+    , port(_port)
+    , discoveryPort(DISCOVERY_PORT)
+    , pServer(Q_NULLPTR)
+    , pDiscoverySocket(Q_NULLPTR)
+    , setpoint(0.0)
+{
+    serverClock.start();
+    connect(&readbackTimer, SIGNAL(timeout()),
+            this, SLOT(onTimeToSendReadback()));
+}
+
+
+bool
+StandInServer::start() {
+    if(isListening())
+        return true;
+    pServer = new QWebSocketServer(QString("TRemote stand-in"),
+                                   QWebSocketServer::NonSecureMode,
+                                   this);
+    connect(pServer, SIGNAL(newConnection()),
+            this, SLOT(onNewConnection()));
+    if(!pServer->listen(QHostAddress::LocalHost, port)) {
+        pServer->deleteLater();
+        pServer = Q_NULLPTR;
+        return false;
+    }
+    // Discovery is best effort: multicast may be unavailable
+    if(!pDiscoverySocket) {
+        pDiscoverySocket = new QUdpSocket(this);
+        pDiscoverySocket->bind(QHostAddress::AnyIPv4, discoveryPort,
+                               QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint);
+        pDiscoverySocket->joinMulticastGroup(QHostAddress("224.0.0.1"));
+        connect(pDiscoverySocket, SIGNAL(readyRead()),
+                this, SLOT(onDiscoveryDatagram()));
+    }
+    readbackTimer.start(scaledMs(READBACK_PERIOD));
+    return true;
+}
+
+
+// Simulates a server restart: the listening socket goes away too
+void
+StandInServer::stop() {
+    readbackTimer.stop();
+    dropClients();
+    if(pServer) {
+        pServer->close();
+        pServer->deleteLater();
+        pServer = Q_NULLPTR;
+    }
+    if(pDiscoverySocket) {
+        pDiscoverySocket->close();
+        pDiscoverySocket->deleteLater();
+        pDiscoverySocket = Q_NULLPTR;
+    }
+}
+
+
+// Abrupt loss of the links, as on a cable pull or a crash
+void
+StandInServer::dropClients() {
+    QList<QWebSocket*> dropped = clients;
+    clients.clear();
+    for(int i=0; i<dropped.count(); i++) {
+        disconnect(dropped.at(i), 0, this, 0);
+        dropped.at(i)->abort();
+        dropped.at(i)->deleteLater();
+    }
+}
+
+
+bool
+StandInServer::isListening() const {
+    return pServer && pServer->isListening();
+}
+
+
+QString
+StandInServer::url() const {
+    return QString("ws://127.0.0.1:%1").arg(port);
+}
+
+
+void
+StandInServer::onNewConnection() {
+    while(pServer->hasPendingConnections()) {
+        QWebSocket *pClient = pServer->nextPendingConnection();
+        pClient->setParent(this);
+        connect(pClient, SIGNAL(textMessageReceived(QString)),
+                this, SLOT(onTextMessageReceived(QString)));
+        connect(pClient, SIGNAL(disconnected()),
+                this, SLOT(onClientDisconnected()));
+        clients.append(pClient);
+    }
+}
+
+
+void
+StandInServer::onTextMessageReceived(QString sMessage) {
+    QWebSocket *pClient = qobject_cast<QWebSocket *>(sender());
+    QString sAnswer;
+    QString sToken = XML_Parse(sMessage, "setPercent");
+    if(sToken != QString("NoData")) {
+        bool ok;
+        double value = sToken.toDouble(&ok);
+        if(ok)
+            setpoint = value;
+        QString sSeq = XML_Parse(sMessage, "seq");
+        if(sSeq != QString("NoData"))
+            sAnswer += QString("<ack>%1</ack>").arg(sSeq);
+        sAnswer += QString("<setPercent>%1</setPercent>").arg(setpoint);
+    }
+    if(XML_Parse(sMessage, "getStatus") != QString("NoData"))
+        sAnswer += QString("<setPercent>%1</setPercent>").arg(setpoint);
+    if(!sAnswer.isEmpty())
+        pClient->sendTextMessage(sAnswer);
+    sToken = XML_Parse(sMessage, "getHistory");
+    if(sToken != QString("NoData")) {
+        quint32 lastSeq = sToken.toUInt();
+        QVector<HistorySample> missing;
+        for(int i=0; i<history.count(); i++) {
+            if(history.at(i).seq > lastSeq)
+                missing.append(history.at(i));
+        }
+        QList<QByteArray> chunks = HistoryCodec::encode(missing);
+        for(int i=0; i<chunks.count(); i++)
+            pClient->sendBinaryMessage(chunks.at(i));
+    }
+}
+
+
+void
+StandInServer::onClientDisconnected() {
+    QWebSocket *pClient = qobject_cast<QWebSocket *>(sender());
+    clients.removeAll(pClient);
+    pClient->deleteLater();
+}
+
+
+void
+StandInServer::onDiscoveryDatagram() {
+    QByteArray datagram;
+    QHostAddress sender;
+    quint16 senderPort;
+    while(pDiscoverySocket->hasPendingDatagrams()) {
+        datagram.resize(int(pDiscoverySocket->pendingDatagramSize()));
+        pDiscoverySocket->readDatagram(datagram.data(), datagram.size(), &sender, &senderPort);
+        if(XML_Parse(QString::fromUtf8(datagram), "getServer") == QString("NoData"))
+            continue;
+        if(!isListening())
+            continue;
+        QByteArray answer("<serverIP>127.0.0.1</serverIP>");
+        pDiscoverySocket->writeDatagram(answer, sender, senderPort);
+    }
+}
+
+
+// Produced even with no client: that is what the history is for
+void
+StandInServer::onTimeToSendReadback() {
+    HistorySample sample;
+    sample.seq      = history.isEmpty() ? 1 : history.last().seq+1;
+    sample.serverNs = serverClock.nsecsElapsed();
+    sample.value    = setpoint;
+    if(history.count() >= HISTORY_LENGTH)
+        history.remove(0, history.count()-HISTORY_LENGTH+1);
+    history.append(sample);
+    QString sMessage = QString("<readPercent>%1</readPercent><hseq>%2</hseq><ts>%3</ts>")
+                       .arg(sample.value)
+                       .arg(sample.seq)
+                       .arg(sample.serverNs);
+    for(int i=0; i<clients.count(); i++)
+        clients.at(i)->sendTextMessage(sMessage);
+}
@@ -0,0 +1,72 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef STANDINSERVER_H
+#define STANDINSERVER_H
+
+#include <QObject>
+#include <QList>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QVector>
+
+#include "readbackhistory.h"
+
+QT_FORWARD_DECLARE_CLASS(QWebSocketServer)
+QT_FORWARD_DECLARE_CLASS(QWebSocket)
+QT_FORWARD_DECLARE_CLASS(QUdpSocket)
+
+
+// Minimal Panel Server on the loopback interface: answers the
+// discovery datagrams, acknowledges the setpoints and streams
+// numbered readbacks, whose history it serves on <getHistory>. It can
+// be stopped, restarted and made to drop its clients to inject faults.
+class StandInServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StandInServer(quint16 _port, QObject *parent=Q_NULLPTR);
+
+    // Before start(): tools/netimpair relays the discovery to it
+    void    setDiscoveryPort(quint16 _discoveryPort) { discoveryPort = _discoveryPort; }
+    bool    start();
+    void    stop();
+    void    dropClients();
+    bool    isListening() const;
+    QString url() const;
+
+private slots:
+    void onNewConnection();
+    void onTextMessageReceived(QString sMessage);
+    void onClientDisconnected();
+    void onDiscoveryDatagram();
+    void onTimeToSendReadback();
+
+private:
+    quint16            port;
+    quint16            discoveryPort;
+    QWebSocketServer  *pServer;
+    QUdpSocket        *pDiscoverySocket;
+    QList<QWebSocket*> clients;
+    QTimer             readbackTimer;
+    double             setpoint;
+    QElapsedTimer      serverClock;
+    QVector<HistorySample> history;
+};
+
+#endif // STANDINSERVER_H
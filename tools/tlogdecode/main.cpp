@@ -0,0 +1,250 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QVariant>
+#include <QMap>
+#include <QtEndian>
+#include <string.h>
+
+#include "binarylog.h"
+
+
+struct Site {
+    QString file;
+    int     line;
+    QString function;
+    QString format;
+    int     level;
+};
+
+
+QString
+levelName(int level) {
+    static const char *names[] = { "E", "W", "I", "D" };
+    if(level >= 0 && level < 4)
+        return QString(names[level]);
+    return QString::number(level);
+}
+
+
+class Reader
+{
+public:
+    explicit Reader(const QByteArray &_data)
+        : data(_data)
+        , pos(0)
+        , bError(false)
+    {
+    }
+    bool atEnd() const { return pos >= data.size(); }
+    bool error() const { return bError; }
+    QString errorString() const { return sError; }
+
+    // Nothing that follows can be decoded
+    void fail(const QString &sReason) {
+        if(!bError)
+            sError = sReason;
+        bError = true;
+    }
+
+    quint8 byte() {
+        if(pos >= data.size()) {
+            fail(QString("Truncated log file"));
+            return 0;
+        }
+        return quint8(data.at(pos++));
+    }
+
+    quint64 varint() {
+        quint64 value = 0;
+        int shift = 0;
+        while(!bError && shift < 64) {
+            quint8 b = byte();
+            value |= quint64(b & 0x7f) << shift;
+            if(!(b & 0x80))
+                break;
+            shift += 7;
+        }
+        return value;
+    }
+
+    QByteArray bytes(int length) {
+        if(length < 0 || pos+length > data.size()) {
+            fail(QString("Truncated log file"));
+            return QByteArray();
+        }
+        QByteArray result = data.mid(pos, length);
+        pos += length;
+        return result;
+    }
+
+    QString utf8() {
+        return QString::fromUtf8(bytes(int(varint())));
+    }
+
+private:
+    const QByteArray &data;
+    int               pos;
+    bool              bError;
+    QString           sError;
+};
+
+
+QVariant
+readArg(Reader &in) {
+    quint8 type = in.byte();
+    switch(type) {
+    case BinaryLog::ArgInt: {
+        quint64 z = in.varint();
+        return QVariant(qint64((z >> 1) ^ (~(z & 1) + 1)));
+    }
+    case BinaryLog::ArgUInt:
+        return QVariant(in.varint());
+    case BinaryLog::ArgDouble: {
+        QByteArray raw = in.bytes(int(sizeof(double)));
+        double value = 0.0;
+        if(raw.size() == int(sizeof(double))) {
+            quint64 bits = qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(raw.constData()));
+            memcpy(&value, &bits, sizeof(double));
+        }
+        return QVariant(value);
+    }
+    case BinaryLog::ArgBool:
+        return QVariant(in.byte() != 0);
+    case BinaryLog::ArgUtf8:
+        return QVariant(in.utf8());
+    case BinaryLog::ArgUtf16: {
+        int length = int(in.varint());
+        QByteArray raw = in.bytes(2*length);
+        QString sValue(raw.size()/2, Qt::Uninitialized);
+        const uchar *pUnits = reinterpret_cast<const uchar*>(raw.constData());
+        for(int i=0; i<sValue.size(); i++)
+            sValue[i] = QChar(qFromLittleEndian<quint16>(pUnits+2*i));
+        return QVariant(sValue);
+    }
+    }
+    // The length of the argument is unknown: the rest is out of sync
+    in.fail(QString("Unknown argument type %1").arg(type));
+    return QVariant();
+}
+
+
+int
+main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("tlogdecode");
+    QCoreApplication::setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders a TRemote binary log as text or JSON");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption jsonOption(QStringList() << "j" << "json",
+                                  "One JSON object per line instead of plain text.");
+    parser.addOption(jsonOption);
+    parser.addPositionalArgument("file", "The binary log file to decode.");
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    if(parser.positionalArguments().count() != 1)
+        parser.showHelp(1);
+
+    QFile file(parser.positionalArguments().at(0));
+    if(!file.open(QIODevice::ReadOnly)) {
+        err << "Unable to open " << file.fileName() << ": " << file.errorString() << endl;
+        return 1;
+    }
+    QByteArray data = file.readAll();
+    Reader in(data);
+    int version = 0;
+    if(in.bytes(4) == QByteArray(BINARY_LOG_MAGIC))
+        version = in.byte();
+    if(version < 1 || version > BINARY_LOG_VERSION) {
+        err << file.fileName() << " is not a TRemote binary log" << endl;
+        return 1;
+    }
+    qint64 startMs = qint64(in.varint());
+    bool bJson = parser.isSet(jsonOption);
+
+    QMap<quint64, Site> sites;
+    qint64 tNs = 0;
+    while(!in.atEnd() && !in.error()) {
+        quint8 recordType = in.byte();
+        if(recordType == BinaryLog::SiteRecord) {
+            quint64 id = in.varint();
+            Site site;
+            site.file     = in.utf8();
+            site.line     = int(in.varint());
+            site.function = in.utf8();
+            site.format   = in.utf8();
+            site.level    = version >= 2 ? in.byte() : 2;
+            sites.insert(id, site);
+        }
+        else if(recordType == BinaryLog::EventRecord) {
+            tNs += qint64(in.varint());
+            quint64 id = in.varint();
+            int nArgs = in.byte();
+            QVariantList args;
+            for(int i=0; i<nArgs && !in.error(); i++)
+                args.append(readArg(in));
+            if(in.error())
+                break;
+            Site site = sites.value(id);
+            QString sMessage = site.format;
+            for(int i=0; i<args.count(); i++)
+                sMessage = sMessage.arg(args.at(i).toString());
+            QDateTime time = QDateTime::fromMSecsSinceEpoch(startMs + tNs/1000000);
+            if(bJson) {
+                QJsonObject record;
+                record.insert("t_ns", double(tNs));
+                record.insert("time", time.toString(Qt::ISODateWithMs));
+                record.insert("file", site.file);
+                record.insert("line", site.line);
+                record.insert("level", site.level);
+                record.insert("function", site.function);
+                record.insert("format", site.format);
+                record.insert("args", QJsonArray::fromVariantList(args));
+                record.insert("message", sMessage);
+                out << QJsonDocument(record).toJson(QJsonDocument::Compact) << endl;
+            }
+            else {
+                out << time.toString("yyyy-MM-dd hh:mm:ss.zzz") << " "
+                    << levelName(site.level) << " "
+                    << site.function << " " << sMessage << endl;
+            }
+        }
+        else {
+            err << "Unknown record type " << recordType << endl;
+            return 1;
+        }
+    }
+    if(in.error()) {
+        err << in.errorString() << endl;
+        return 1;
+    }
+    return 0;
+}
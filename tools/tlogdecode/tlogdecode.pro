@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Offline decoder for the TRemote binary log
+#
+#-------------------------------------------------
+
+
+QT += core
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = tlogdecode
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
+
+HEADERS += ../../binarylog.h
@@ -0,0 +1,283 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QtEndian>
+
+#include "websocketcodec.h"
+
+
+#define CLIENT_KEY "dGhlIHNhbXBsZSBub25jZQ==" // RFC 6455, 1.3
+#define SERVER_KEY "s3pPLMBiTxaQ9kYGzzhZRbK+xOo="
+
+
+namespace {
+
+int nFailures = 0;
+int nChecks   = 0;
+
+
+void
+check(QTextStream &out, bool bOk, const QString &sWhat) {
+    nChecks++;
+    if(bOk)
+        return;
+    nFailures++;
+    out << "FAILED: " << sWhat << endl;
+}
+
+
+// An unmasked frame as a server sends it. length < 0: the shortest
+// length encoding, else forced (126 or 127) to test non-minimal ones
+QByteArray
+serverFrame(int firstByte, const QByteArray &payload, int lengthCode=-1) {
+    QByteArray frame;
+    frame.append(char(firstByte));
+    quint64 length = quint64(payload.size());
+    if(lengthCode < 0)
+        lengthCode = length < 126 ? int(length) : (length < 65536 ? 126 : 127);
+    frame.append(char(lengthCode));
+    uchar extended[8];
+    if(lengthCode == 126) {
+        qToBigEndian(quint16(length), extended);
+        frame.append(reinterpret_cast<const char*>(extended), 2);
+    }
+    else if(lengthCode == 127) {
+        qToBigEndian(length, extended);
+        frame.append(reinterpret_cast<const char*>(extended), 8);
+    }
+    return frame + payload;
+}
+
+
+QByteArray
+closePayload(quint16 code, const QByteArray &reason=QByteArray()) {
+    uchar bytes[2];
+    qToBigEndian(code, bytes);
+    return QByteArray(reinterpret_cast<const char*>(bytes), 2) + reason;
+}
+
+
+// Feeds the bytes and expects a protocol error with the given close code
+void
+expectError(QTextStream &out, const QString &sCase, const QByteArray &bytes, int closeCode) {
+    WebSocketCodec codec;
+    codec.append(bytes);
+    WebSocketCodec::Event event = codec.next();
+    while(event != WebSocketCodec::ProtocolError && event != WebSocketCodec::NeedMoreData)
+        event = codec.next();
+    check(out, event == WebSocketCodec::ProtocolError && codec.closeCode() == closeCode,
+          QString("%1: expected error %2, got event %3 code %4")
+          .arg(sCase).arg(closeCode).arg(int(event)).arg(codec.closeCode()));
+    check(out, codec.next() == WebSocketCodec::ProtocolError,
+          QString("%1: the error is final").arg(sCase));
+}
+
+
+void
+checkHandshake(QTextStream &out) {
+    QString sReason;
+    QByteArray valid = "HTTP/1.1 101 Switching Protocols\r\n"
+                       "Upgrade: websocket\r\n"
+                       "Connection: Upgrade\r\n"
+                       "Sec-WebSocket-Accept: " SERVER_KEY;
+    check(out, WebSocketCodec::checkUpgradeResponse(valid, CLIENT_KEY, &sReason) ==
+               WebSocketCodec::HandshakeAccepted,
+          QString("RFC sample upgrade accepted: %1").arg(sReason));
+    QByteArray relaxed = "HTTP/1.1 101 Switching Protocols\r\n"
+                         "upgrade: WebSocket\r\n"
+                         "CONNECTION: keep-alive, Upgrade\r\n"
+                         "sec-websocket-accept: " SERVER_KEY;
+    check(out, WebSocketCodec::checkUpgradeResponse(relaxed, CLIENT_KEY, &sReason) ==
+               WebSocketCodec::HandshakeAccepted,
+          QString("header names and values are case insensitive: %1").arg(sReason));
+
+    struct { const char *sCase; QByteArray head; WebSocketCodec::Handshake expected; } cases[] = {
+        { "not 101", "HTTP/1.1 200 OK\r\nContent-Length: 0", WebSocketCodec::HandshakeRefused },
+        { "not HTTP/1.1", "HTTP/1.0 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                          "Connection: Upgrade\r\nSec-WebSocket-Accept: " SERVER_KEY,
+          WebSocketCodec::HandshakeRefused },
+        { "no Upgrade", "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\n"
+                        "Sec-WebSocket-Accept: " SERVER_KEY, WebSocketCodec::HandshakeInvalid },
+        { "wrong Upgrade", "HTTP/1.1 101 Switching Protocols\r\nUpgrade: h2c\r\nConnection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: " SERVER_KEY, WebSocketCodec::HandshakeInvalid },
+        { "no Connection", "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                           "Sec-WebSocket-Accept: " SERVER_KEY, WebSocketCodec::HandshakeInvalid },
+        { "wrong Connection", "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                              "Connection: keep-alive\r\nSec-WebSocket-Accept: " SERVER_KEY,
+          WebSocketCodec::HandshakeInvalid },
+        { "no accept", "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade",
+          WebSocketCodec::HandshakeInvalid },
+        { "wrong accept", "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                          "Sec-WebSocket-Accept: AAAAAAAAAAAAAAAAAAAAAAAAAAA=", WebSocketCodec::HandshakeInvalid },
+        { "unrequested extension", "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                                   "Connection: Upgrade\r\nSec-WebSocket-Accept: " SERVER_KEY "\r\n"
+                                   "Sec-WebSocket-Extensions: permessage-deflate",
+          WebSocketCodec::HandshakeInvalid },
+        { "unrequested subprotocol", "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+                                     "Connection: Upgrade\r\nSec-WebSocket-Accept: " SERVER_KEY "\r\n"
+                                     "Sec-WebSocket-Protocol: chat",
+          WebSocketCodec::HandshakeInvalid }
+    };
+    for(size_t i=0; i<sizeof(cases)/sizeof(cases[0]); i++) {
+        WebSocketCodec::Handshake result = WebSocketCodec::checkUpgradeResponse(cases[i].head, CLIENT_KEY, &sReason);
+        check(out, result == cases[i].expected,
+              QString("upgrade %1: got %2").arg(cases[i].sCase).arg(int(result)));
+    }
+
+    QByteArray request = WebSocketCodec::upgradeRequest(QUrl("ws://[::1]:8080/panel?x=1"), CLIENT_KEY);
+    check(out, request.startsWith("GET /panel?x=1 HTTP/1.1\r\nHost: [::1]:8080\r\n") &&
+               request.contains("\r\nSec-WebSocket-Key: " CLIENT_KEY "\r\n") &&
+               request.endsWith("\r\n\r\n"),
+          QString("upgrade request"));
+}
+
+
+// Every payload length class, unmasked back to the payload
+void
+checkClientFrames(QTextStream &out) {
+    int sizes[] = { 0, 1, 125, 126, 65535, 65536, 100000 };
+    for(size_t i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+        QByteArray payload(sizes[i], Qt::Uninitialized);
+        for(int j=0; j<payload.size(); j++)
+            payload[j] = char(j*7);
+        QByteArray frame = WebSocketCodec::encodeFrame(WebSocketCodec::BinaryFrame, payload);
+        QByteArray clear = frame;
+        WebSocketCodec::maskFrame(&frame, 0xA5C3F00Fu);
+        int lengthCode = uchar(frame.at(1)) & 0x7F;
+        int maskPos = lengthCode == 127 ? 10 : (lengthCode == 126 ? 4 : 2);
+        bool bOk = uchar(frame.at(0)) == (0x80 | WebSocketCodec::BinaryFrame) &&
+                   (uchar(frame.at(1)) & 0x80) &&
+                   frame.size() == maskPos+4+payload.size() &&
+                   qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(frame.constData()+maskPos)) == 0xA5C3F00Fu;
+        bOk = bOk && lengthCode == (sizes[i] < 126 ? sizes[i] : (sizes[i] < 65536 ? 126 : 127));
+        const uchar *pMask = reinterpret_cast<const uchar*>(frame.constData()+maskPos);
+        for(int j=0; bOk && j<payload.size(); j++)
+            bOk = char(frame.at(maskPos+4+j) ^ pMask[j & 3]) == payload.at(j);
+        check(out, bOk, QString("masked client frame of %1 bytes").arg(sizes[i]));
+        check(out, clear.mid(maskPos+4) == payload, QString("pre-encoded frame left in clear"));
+    }
+}
+
+
+void
+checkServerFrames(QTextStream &out) {
+    WebSocketCodec codec;
+
+    // Whole frames, then fed a byte at a time
+    codec.append(serverFrame(0x81, "hello"));
+    check(out, codec.next() == WebSocketCodec::TextMessage && codec.text() == QString("hello"),
+          QString("text frame"));
+    check(out, codec.next() == WebSocketCodec::NeedMoreData, QString("nothing left"));
+    QByteArray big(70000, 'x');
+    QByteArray bytes = serverFrame(0x82, QByteArray(300, 'b')) + serverFrame(0x82, big);
+    int nBinary = 0;
+    bool bInOrder = true;
+    for(int i=0; i<bytes.size(); i++) {
+        codec.append(bytes.mid(i, 1));
+        WebSocketCodec::Event event;
+        while((event = codec.next()) != WebSocketCodec::NeedMoreData) {
+            nBinary++;
+            bInOrder = bInOrder && event == WebSocketCodec::BinaryMessage &&
+                       codec.payload().size() == (nBinary == 1 ? 300 : 70000);
+        }
+    }
+    check(out, nBinary == 2 && bInOrder, QString("frames fed a byte at a time"));
+
+    // Fragments with a control frame in between, UTF-8 split across them
+    QByteArray e = QString::fromUtf8("\xc3\xa9").toUtf8();
+    codec.append(serverFrame(0x01, "caf" + e.left(1)));
+    codec.append(serverFrame(0x89, "p"));
+    codec.append(serverFrame(0x00, e.mid(1) + " au"));
+    codec.append(serverFrame(0x80, " lait"));
+    check(out, codec.next() == WebSocketCodec::Ping && codec.payload() == "p",
+          QString("ping between fragments"));
+    check(out, codec.next() == WebSocketCodec::TextMessage &&
+               codec.text() == QString::fromUtf8("caf\xc3\xa9 au lait"),
+          QString("fragmented text message"));
+    codec.append(serverFrame(0x8A, "q"));
+    check(out, codec.next() == WebSocketCodec::Pong && codec.payload() == "q", QString("pong"));
+    codec.append(serverFrame(0x81, QByteArray("\xef\xbb\xbfok")));
+    check(out, codec.next() == WebSocketCodec::TextMessage && codec.text().size() == 3,
+          QString("leading BOM kept"));
+    codec.append(serverFrame(0x88, closePayload(1000, "bye")));
+    check(out, codec.next() == WebSocketCodec::Close && codec.payload() == closePayload(1000, "bye"),
+          QString("close frame"));
+    codec.reset();
+    codec.append(serverFrame(0x88, QByteArray()));
+    check(out, codec.next() == WebSocketCodec::Close, QString("empty close frame"));
+
+    expectError(out, "RSV1 set", serverFrame(0xC1, "x"), WebSocketCodec::CloseProtocolError);
+    expectError(out, "RSV3 set", serverFrame(0x92, "x"), WebSocketCodec::CloseProtocolError);
+    expectError(out, "masked server frame", QByteArray("\x81\x81\x00\x00\x00\x00x", 7),
+                WebSocketCodec::CloseProtocolError);
+    expectError(out, "reserved opcode", serverFrame(0x83, "x"), WebSocketCodec::CloseProtocolError);
+    expectError(out, "reserved control opcode", serverFrame(0x8B, "x"), WebSocketCodec::CloseProtocolError);
+    expectError(out, "fragmented ping", serverFrame(0x09, "x"), WebSocketCodec::CloseProtocolError);
+    expectError(out, "long ping", serverFrame(0x89, QByteArray(126, 'p')), WebSocketCodec::CloseProtocolError);
+    expectError(out, "long close", serverFrame(0x88, closePayload(1000, QByteArray(124, 'r'))),
+                WebSocketCodec::CloseProtocolError);
+    expectError(out, "text inside a fragmented message",
+                serverFrame(0x01, "a") + serverFrame(0x81, "b"), WebSocketCodec::CloseProtocolError);
+    expectError(out, "binary inside a fragmented message",
+                serverFrame(0x02, "a") + serverFrame(0x02, "b"), WebSocketCodec::CloseProtocolError);
+    expectError(out, "continuation with nothing to continue",
+                serverFrame(0x80, "a"), WebSocketCodec::CloseProtocolError);
+    expectError(out, "continuation after a complete message",
+                serverFrame(0x01, "a") + serverFrame(0x80, "b") + serverFrame(0x80, "c"),
+                WebSocketCodec::CloseProtocolError);
+    expectError(out, "non-minimal 16 bit length", serverFrame(0x82, "abc", 126),
+                WebSocketCodec::CloseProtocolError);
+    expectError(out, "non-minimal 64 bit length", serverFrame(0x82, QByteArray(200, 'a'), 127),
+                WebSocketCodec::CloseProtocolError);
+    expectError(out, "64 bit length with the high bit set",
+                QByteArray("\x82\x7f\x80\x00\x00\x00\x00\x01\x00\x00", 10), WebSocketCodec::CloseProtocolError);
+    expectError(out, "oversized message",
+                QByteArray("\x82\x7f\x00\x00\x00\x00\x10\x00\x00\x00", 10), WebSocketCodec::CloseTooBig);
+    expectError(out, "invalid UTF-8", serverFrame(0x81, QByteArray("\xc3\x28")), WebSocketCodec::CloseInvalidData);
+    expectError(out, "overlong UTF-8", serverFrame(0x81, QByteArray("\xc0\xaf")), WebSocketCodec::CloseInvalidData);
+    expectError(out, "UTF-16 surrogate in UTF-8", serverFrame(0x81, QByteArray("\xed\xa0\x80")),
+                WebSocketCodec::CloseInvalidData);
+    expectError(out, "truncated UTF-8", serverFrame(0x81, QByteArray("ok\xe2\x82")), WebSocketCodec::CloseInvalidData);
+    expectError(out, "invalid UTF-8 across fragments",
+                serverFrame(0x01, "\xe2") + serverFrame(0x80, "(\xa1"), WebSocketCodec::CloseInvalidData);
+    expectError(out, "close with one byte", serverFrame(0x88, "\x03"), WebSocketCodec::CloseProtocolError);
+    expectError(out, "close code 1005", serverFrame(0x88, closePayload(1005)), WebSocketCodec::CloseProtocolError);
+    expectError(out, "close code 999", serverFrame(0x88, closePayload(999)), WebSocketCodec::CloseProtocolError);
+    expectError(out, "close reason not UTF-8", serverFrame(0x88, closePayload(1000, "\xff")),
+                WebSocketCodec::CloseInvalidData);
+}
+
+}
+
+
+int
+main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("Gabriele.Salvato");
+    QCoreApplication::setApplicationName("TRemoteWsCheck");
+    QCoreApplication::setApplicationVersion("1.0.0");
+
+    QTextStream out(stdout);
+    checkHandshake(out);
+    checkClientFrames(out);
+    checkServerFrames(out);
+    out << nChecks << " checks, " << nFailures << " failures" << endl;
+    return nFailures == 0 ? 0 : 1;
+}
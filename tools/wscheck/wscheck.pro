@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Conformance checks of the WebSocket client
+# codec: upgrade handshake, client framing and
+# the frames received from a server
+#
+#-------------------------------------------------
+
+
+QT += core
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = wscheck
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += main.cpp
+SOURCES += ../../websocketcodec.cpp
+
+HEADERS += ../../websocketcodec.h
@@ -0,0 +1,123 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+#include "tracer.h"
+
+
+#define TRACE_BUFFER_SIZE 65536 // Events kept: the oldest are overwritten
+
+
+namespace {
+
+struct TraceEvent {
+    const char *name;
+    const char *category;
+    qint64      tsNs;
+    quint64     id;
+    int         tid;
+    char        phase;
+};
+
+TraceEvent            ringBuffer[TRACE_BUFFER_SIZE];
+std::atomic<quint64>  writeIndex(0);
+std::atomic<int>      nextThreadId(1);
+QElapsedTimer         traceClock;
+
+int
+currentThreadId() {
+    static thread_local int tid = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+    return tid;
+}
+
+// Minimal JSON string escaping for names coming from the sources
+QString
+jsonString(const char *text) {
+    QString sText = QString::fromUtf8(text ? text : "");
+    sText.replace(QChar('\\'), QString("\\\\"));
+    sText.replace(QChar('"'), QString("\\\""));
+    return QString("\"%1\"").arg(sText);
+}
+
+}
+
+
+std::atomic<bool> Tracer::bEnabled(false);
+
+
+void
+Tracer::start() {
+    if(isEnabled())
+        return;
+    writeIndex.store(0, std::memory_order_relaxed);
+    traceClock.start();
+    bEnabled.store(true, std::memory_order_release);
+}
+
+
+void
+Tracer::stop() {
+    bEnabled.store(false, std::memory_order_release);
+}
+
+
+void
+Tracer::record(char phase, const char *name, const char *category, quint64 id) {
+    quint64 index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& event = ringBuffer[index % TRACE_BUFFER_SIZE];
+    event.name     = name;
+    event.category = category;
+    event.tsNs     = traceClock.nsecsElapsed();
+    event.id       = id;
+    event.tid      = currentThreadId();
+    event.phase    = phase;
+}
+
+
+// To be called after stop(): events still being written are not waited for
+bool
+Tracer::dump(const QString &sFileName) {
+    QFile file(sFileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+    quint64 last  = writeIndex.load(std::memory_order_acquire);
+    quint64 first = last > TRACE_BUFFER_SIZE ? last-TRACE_BUFFER_SIZE : 0;
+    qint64  pid   = QCoreApplication::applicationPid();
+    QTextStream out(&file);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for(quint64 i=first; i<last; i++) {
+        const TraceEvent& event = ringBuffer[i % TRACE_BUFFER_SIZE];
+        out << "{\"name\":" << jsonString(event.name)
+            << ",\"cat\":" << jsonString(event.category)
+            << ",\"ph\":\"" << event.phase << "\""
+            << ",\"ts\":" << QString::number(double(event.tsNs)/1000.0, 'f', 3)
+            << ",\"pid\":" << pid
+            << ",\"tid\":" << event.tid;
+        if(event.phase == AsyncBegin || event.phase == AsyncEnd)
+            out << ",\"id\":\"0x" << QString::number(event.id, 16) << "\"";
+        if(event.phase == Instant)
+            out << ",\"s\":\"t\"";
+        out << "}" << (i+1 < last ? ",\n" : "\n");
+    }
+    out << "]}\n";
+    return file.error() == QFile::NoError;
+}
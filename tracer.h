@@ -0,0 +1,102 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <atomic>
+
+
+// Records spans and instant events in a fixed size ring buffer and
+// dumps them in the Chrome trace-event JSON format (chrome://tracing,
+// ui.perfetto.dev). Names and categories must be string literals: only
+// their pointers are stored. When disabled every trace point costs a
+// single relaxed load.
+class Tracer
+{
+public:
+    enum Phase {
+        Begin      = 'B',
+        End        = 'E',
+        Instant    = 'i',
+        AsyncBegin = 'b',
+        AsyncEnd   = 'e'
+    };
+
+    static bool isEnabled() { return bEnabled.load(std::memory_order_relaxed); }
+    static void start();
+    static void stop();
+    static bool dump(const QString &sFileName);
+    static void record(char phase, const char *name, const char *category, quint64 id=0);
+
+private:
+    static std::atomic<bool> bEnabled;
+};
+
+
+class TraceSpan
+{
+public:
+    TraceSpan(const char *_name, const char *_category)
+        : name(Q_NULLPTR)
+        , category(_category)
+    {
+        if(Tracer::isEnabled()) {
+            name = _name;
+            Tracer::record(Tracer::Begin, name, category);
+        }
+    }
+    ~TraceSpan() {
+        if(name)
+            Tracer::record(Tracer::End, name, category);
+    }
+
+private:
+    const char *name;
+    const char *category;
+};
+
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b)  TRACE_CONCAT_(a, b)
+
+// Span lasting until the end of the enclosing scope
+#define TRACE_SPAN(name, category) \
+    TraceSpan TRACE_CONCAT(_traceSpan, __LINE__)(name, category)
+
+#define TRACE_INSTANT(name, category)                                       \
+    do {                                                                    \
+        if(Tracer::isEnabled())                                             \
+            Tracer::record(Tracer::Instant, name, category);                \
+    } while(0)
+
+// Spans that begin and end in different slots, matched by id
+#define TRACE_ASYNC_BEGIN(name, category, id)                               \
+    do {                                                                    \
+        if(Tracer::isEnabled())                                             \
+            Tracer::record(Tracer::AsyncBegin, name, category, id);         \
+    } while(0)
+
+#define TRACE_ASYNC_END(name, category, id)                                 \
+    do {                                                                    \
+        if(Tracer::isEnabled())                                             \
+            Tracer::record(Tracer::AsyncEnd, name, category, id);           \
+    } while(0)
+
+#endif // TRACER_H
@@ -0,0 +1,572 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#include <QSslSocket>
+#include <QTcpSocket>
+#include <QLocalSocket>
+#include <QtEndian>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+#include <QRandomGenerator>
+#endif
+
+#include "transport.h"
+#include "tlspolicy.h"
+
+
+#define DEFAULT_PORT     45454
+#define FRAME_HEADER     5          // Length and type
+#define MAX_FRAME_SIZE   (16*1024*1024)
+#define MAX_HANDSHAKE    8192       // Bytes of the HTTP upgrade response
+
+
+namespace {
+
+quint32
+randomWord() {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    return QRandomGenerator::system()->generate();
+#else
+    return (quint32(qrand()) << 16) ^ quint32(qrand());
+#endif
+}
+
+}
+
+
+Transport::Kind
+Transport::kindOf(const QUrl &url) {
+    if(url.scheme() == QString("tcp"))
+        return Tcp;
+    if(url.scheme() == QString("local"))
+        return Local;
+    return WebSocket;
+}
+
+
+Transport*
+Transport::create(const QUrl &url, const TlsPolicy *pTlsPolicy, QObject *parent) {
+    switch(kindOf(url)) {
+    case Tcp:       return new TcpTransport(parent);
+    case Local:     return new LocalTransport(parent);
+    case WebSocket: break;
+    }
+    return new WebSocketTransport(pTlsPolicy, parent);
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// WebSocketTransport
+////////////////////////////////////////////////////////////////////////
+
+WebSocketTransport::WebSocketTransport(const TlsPolicy *_pTlsPolicy, QObject *parent)
+    : Transport(parent)
+    , pTlsPolicy(_pTlsPolicy)
+    , bUpgraded(false)
+{
+    pSocket = new QSslSocket(this);
+    connect(pSocket, SIGNAL(connected()),
+            this, SLOT(onSocketConnected()));
+    connect(pSocket, SIGNAL(encrypted()),
+            this, SLOT(onEncrypted()));
+    connect(pSocket, SIGNAL(sslErrors(QList<QSslError>)),
+            this, SLOT(onSslErrors(QList<QSslError>)));
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    // TLS 1.3 tickets come after the handshake
+    connect(pSocket, SIGNAL(newSessionTicketReceived()),
+            this, SLOT(onSessionTicket()));
+#endif
+    connect(pSocket, SIGNAL(readyRead()),
+            this, SLOT(onReadyRead()));
+    connect(pSocket, SIGNAL(disconnected()),
+            this, SIGNAL(disconnected()));
+    connect(pSocket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SIGNAL(error(QAbstractSocket::SocketError)));
+}
+
+
+void
+WebSocketTransport::reset() {
+    bUpgraded = false;
+    handshakeKey.clear();
+    inBuffer.clear();
+    codec.reset();
+    pingClock.invalidate();
+    sError.clear();
+}
+
+
+void
+WebSocketTransport::open(const QUrl &_url) {
+    if(pSocket->state() != QAbstractSocket::UnconnectedState)
+        pSocket->abort();
+    reset();
+    url = _url;
+    if(url.scheme() == QString("wss")) {
+        if(pTlsPolicy)
+            pTlsPolicy->prepare(pSocket, url);
+        pSocket->connectToHostEncrypted(url.host(), quint16(url.port(443)));
+    }
+    else
+        pSocket->connectToHost(url.host(), quint16(url.port(80)));
+}
+
+
+void
+WebSocketTransport::abort() {
+    reset();
+    pSocket->abort();
+}
+
+
+void
+WebSocketTransport::fail(QAbstractSocket::SocketError socketError, const QString &sReason) {
+    pSocket->abort();
+    reset();
+    sError = sReason;
+    emit error(socketError);
+}
+
+
+// The HTTP upgrade starts once the TCP (and TLS for wss) link is up
+void
+WebSocketTransport::onSocketConnected() {
+    pSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    if(!pSocket->isEncrypted() && url.scheme() == QString("wss"))
+        return;// Waiting for encrypted()
+    char key[16];
+    for(int i=0; i<16; i+=4)
+        qToBigEndian(randomWord(), reinterpret_cast<uchar*>(key+i));
+    handshakeKey = QByteArray(key, 16).toBase64();
+    pSocket->write(WebSocketCodec::upgradeRequest(url, handshakeKey));
+}
+
+
+// An unpinned server is refused before anybody can talk to it
+void
+WebSocketTransport::onEncrypted() {
+    if(pTlsPolicy) {
+        if(!pTlsPolicy->isPeerPinned(pSocket->peerCertificate())) {
+            pTlsPolicy->forgetSession(url);
+            fail(QAbstractSocket::SslHandshakeFailedError, tr("Server certificate not pinned"));
+            return;
+        }
+        pTlsPolicy->sessionEstablished(pSocket, url);
+    }
+    onSocketConnected();
+}
+
+
+void
+WebSocketTransport::onSslErrors(const QList<QSslError> &errors) {
+    if(!pTlsPolicy)
+        return;
+    QSslCertificate certificate = pSocket->peerCertificate();
+    for(int i=0; certificate.isNull() && i<errors.count(); i++)
+        certificate = errors.at(i).certificate();
+    if(pTlsPolicy->canIgnore(certificate, errors))
+        pSocket->ignoreSslErrors();
+}
+
+
+void
+WebSocketTransport::onSessionTicket() {
+    if(pTlsPolicy && pSocket->isEncrypted())
+        pTlsPolicy->sessionEstablished(pSocket, url);
+}
+
+
+qint64
+WebSocketTransport::sendTextMessage(const QString &sMessage) {
+    QByteArray payload = sMessage.toUtf8();
+    if(!writeFrame(WebSocketCodec::TextFrame, payload))
+        return -1;
+    return payload.size();
+}
+
+
+// The whole frame but the mask, which must be new for every frame
+// sent (RFC 6455, 5.3): sending it is a copy and a XOR
+QByteArray
+WebSocketTransport::encodeText(const QString &sMessage) const {
+    return WebSocketCodec::encodeFrame(WebSocketCodec::TextFrame, sMessage.toUtf8());
+}
+
+
+bool
+WebSocketTransport::sendEncoded(const QByteArray &encoded) {
+    return writeMasked(encoded);
+}
+
+
+void
+WebSocketTransport::flush() {
+    pSocket->flush();
+}
+
+
+void
+WebSocketTransport::ping() {
+    if(writeFrame(WebSocketCodec::PingFrame, QByteArray()))
+        pingClock.start();
+}
+
+
+QString
+WebSocketTransport::errorString() const {
+    if(!sError.isEmpty())
+        return sError;
+    return pSocket->errorString();
+}
+
+
+QHostAddress
+WebSocketTransport::peerAddress() const {
+    return pSocket->peerAddress();
+}
+
+
+bool
+WebSocketTransport::writeFrame(WebSocketCodec::Opcode opcode, const QByteArray &payload) {
+    return writeMasked(WebSocketCodec::encodeFrame(opcode, payload));
+}
+
+
+// Client frames are always masked (RFC 6455, 5.3)
+bool
+WebSocketTransport::writeMasked(QByteArray frame) {
+    if(!bUpgraded)
+        return false;
+    WebSocketCodec::maskFrame(&frame, randomWord());
+    return pSocket->write(frame) == frame.size();
+}
+
+
+void
+WebSocketTransport::onReadyRead() {
+    if(bUpgraded) {
+        codec.append(pSocket->readAll());
+    }
+    else {
+        inBuffer.append(pSocket->readAll());
+        if(!readUpgradeResponse())
+            return;
+        emit connected();
+        // A receiver may have aborted the connection
+        if(!bUpgraded)
+            return;
+    }
+    readFrames();
+}
+
+
+// True once the server has switched protocol
+bool
+WebSocketTransport::readUpgradeResponse() {
+    int end = inBuffer.indexOf("\r\n\r\n");
+    if(end < 0) {
+        if(inBuffer.size() > MAX_HANDSHAKE)
+            fail(QAbstractSocket::UnknownSocketError, tr("Invalid WebSocket upgrade response"));
+        return false;
+    }
+    QString sReason;
+    switch(WebSocketCodec::checkUpgradeResponse(inBuffer.left(end), handshakeKey, &sReason)) {
+    case WebSocketCodec::HandshakeAccepted:
+        break;
+    case WebSocketCodec::HandshakeRefused:
+        fail(QAbstractSocket::ConnectionRefusedError, sReason);
+        return false;
+    case WebSocketCodec::HandshakeInvalid:
+        fail(QAbstractSocket::UnknownSocketError, sReason);
+        return false;
+    }
+    // Frames may follow in the same segment
+    codec.append(inBuffer.mid(end+4));
+    inBuffer.clear();
+    bUpgraded = true;
+    return true;
+}
+
+
+void
+WebSocketTransport::readFrames() {
+    for(;;) {
+        switch(codec.next()) {
+        case WebSocketCodec::NeedMoreData:
+            return;
+        case WebSocketCodec::TextMessage:
+            emit textMessageReceived(codec.text());
+            break;
+        case WebSocketCodec::BinaryMessage:
+            emit binaryMessageReceived(codec.payload());
+            break;
+        case WebSocketCodec::Ping:
+            writeFrame(WebSocketCodec::PongFrame, codec.payload());
+            break;
+        case WebSocketCodec::Pong:
+            emit pong(pingClock.isValid() ? quint64(pingClock.elapsed()) : 0, codec.payload());
+            pingClock.invalidate();
+            break;
+        case WebSocketCodec::Close:
+            // Echo the status code, then let the server close the link
+            writeFrame(WebSocketCodec::CloseFrame, codec.payload().left(2));
+            pSocket->disconnectFromHost();
+            codec.reset();
+            return;
+        case WebSocketCodec::ProtocolError: {
+            // Close with the reason before dropping the link (RFC 6455, 7.1.7)
+            uchar code[2];
+            qToBigEndian(quint16(codec.closeCode()), code);
+            writeFrame(WebSocketCodec::CloseFrame, QByteArray(reinterpret_cast<const char*>(code), 2));
+            pSocket->flush();
+            fail(QAbstractSocket::UnknownSocketError, codec.errorString());
+            return;
+        }
+        }
+        // A receiver may have aborted the connection
+        if(!bUpgraded)
+            return;
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// FramedTransport
+////////////////////////////////////////////////////////////////////////
+
+FramedTransport::FramedTransport(QObject *parent)
+    : Transport(parent)
+    , pDevice(Q_NULLPTR)
+{
+}
+
+
+void
+FramedTransport::attach(QIODevice *_pDevice) {
+    pDevice = _pDevice;
+    connect(pDevice, SIGNAL(readyRead()),
+            this, SLOT(onReadyRead()));
+}
+
+
+void
+FramedTransport::resetFraming() {
+    inBuffer.clear();
+    pingClock.invalidate();
+}
+
+
+bool
+FramedTransport::writeFrame(FrameType type, const QByteArray &payload) {
+    if(!pDevice->isOpen())
+        return false;
+    char header[FRAME_HEADER];
+    qToBigEndian(quint32(payload.size()), reinterpret_cast<uchar*>(header));
+    header[4] = char(type);
+    if(pDevice->write(header, FRAME_HEADER) != FRAME_HEADER)
+        return false;
+    return pDevice->write(payload) == payload.size();
+}
+
+
+qint64
+FramedTransport::sendTextMessage(const QString &sMessage) {
+    QByteArray payload = sMessage.toUtf8();
+    if(!writeFrame(TextFrame, payload))
+        return -1;
+    return payload.size();
+}
+
+
+QByteArray
+FramedTransport::encodeText(const QString &sMessage) const {
+    QByteArray payload = sMessage.toUtf8();
+    QByteArray frame(FRAME_HEADER, Qt::Uninitialized);
+    qToBigEndian(quint32(payload.size()), reinterpret_cast<uchar*>(frame.data()));
+    frame[4] = char(TextFrame);
+    return frame + payload;
+}
+
+
+bool
+FramedTransport::sendEncoded(const QByteArray &encoded) {
+    if(!pDevice->isOpen())
+        return false;
+    return pDevice->write(encoded) == encoded.size();
+}
+
+
+void
+FramedTransport::ping() {
+    if(writeFrame(PingFrame, QByteArray()))
+        pingClock.start();
+}
+
+
+void
+FramedTransport::onReadyRead() {
+    inBuffer.append(pDevice->readAll());
+    int pos = 0;
+    while(inBuffer.size()-pos >= FRAME_HEADER) {
+        const uchar *pHeader = reinterpret_cast<const uchar*>(inBuffer.constData()+pos);
+        quint32 length = qFromBigEndian<quint32>(pHeader);
+        if(length > MAX_FRAME_SIZE) {
+            inBuffer.clear();
+            abort();
+            emit error(QAbstractSocket::UnknownSocketError);
+            return;
+        }
+        if(quint32(inBuffer.size()-pos-FRAME_HEADER) < length)
+            break;
+        FrameType type = FrameType(pHeader[4]);
+        QByteArray payload = inBuffer.mid(pos+FRAME_HEADER, int(length));
+        pos += FRAME_HEADER + int(length);
+        switch(type) {
+        case TextFrame:
+            emit textMessageReceived(QString::fromUtf8(payload));
+            break;
+        case BinaryFrame:
+            emit binaryMessageReceived(payload);
+            break;
+        case PingFrame:
+            writeFrame(PongFrame, payload);
+            break;
+        case PongFrame:
+            emit pong(pingClock.isValid() ? quint64(pingClock.elapsed()) : 0, payload);
+            pingClock.invalidate();
+            break;
+        }
+        // A receiver may have aborted the connection
+        if(inBuffer.isEmpty())
+            return;
+    }
+    inBuffer.remove(0, pos);
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// TcpTransport
+////////////////////////////////////////////////////////////////////////
+
+TcpTransport::TcpTransport(QObject *parent)
+    : FramedTransport(parent)
+{
+    pSocket = new QTcpSocket(this);
+    attach(pSocket);
+    connect(pSocket, SIGNAL(connected()),
+            this, SLOT(onConnected()));
+    connect(pSocket, SIGNAL(disconnected()),
+            this, SIGNAL(disconnected()));
+    connect(pSocket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SIGNAL(error(QAbstractSocket::SocketError)));
+}
+
+
+void
+TcpTransport::open(const QUrl &url) {
+    resetFraming();
+    pSocket->connectToHost(url.host(), quint16(url.port(DEFAULT_PORT)));
+}
+
+
+// The option is applied to the native socket, which exists only
+// once connected: set before connectToHost() it is ignored
+void
+TcpTransport::onConnected() {
+    pSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    emit connected();
+}
+
+
+void
+TcpTransport::abort() {
+    resetFraming();
+    pSocket->abort();
+}
+
+
+void
+TcpTransport::flush() {
+    pSocket->flush();
+}
+
+
+QString
+TcpTransport::errorString() const {
+    return pSocket->errorString();
+}
+
+
+QHostAddress
+TcpTransport::peerAddress() const {
+    return pSocket->peerAddress();
+}
+
+
+////////////////////////////////////////////////////////////////////////
+// LocalTransport
+////////////////////////////////////////////////////////////////////////
+
+LocalTransport::LocalTransport(QObject *parent)
+    : FramedTransport(parent)
+{
+    pSocket = new QLocalSocket(this);
+    attach(pSocket);
+    connect(pSocket, SIGNAL(connected()),
+            this, SIGNAL(connected()));
+    connect(pSocket, SIGNAL(disconnected()),
+            this, SIGNAL(disconnected()));
+    connect(pSocket, SIGNAL(error(QLocalSocket::LocalSocketError)),
+            this, SLOT(onLocalSocketError()));
+}
+
+
+// local://name or local:///path/to/socket
+void
+LocalTransport::open(const QUrl &url) {
+    resetFraming();
+    QString sServerName = url.toString(QUrl::RemoveScheme);
+    if(sServerName.startsWith(QString("//")))
+        sServerName.remove(0, 2);
+    pSocket->connectToServer(sServerName);
+}
+
+
+void
+LocalTransport::abort() {
+    resetFraming();
+    pSocket->abort();
+}
+
+
+void
+LocalTransport::flush() {
+    pSocket->flush();
+}
+
+
+QString
+LocalTransport::errorString() const {
+    return pSocket->errorString();
+}
+
+
+// QLocalSocket::LocalSocketError mirrors QAbstractSocket::SocketError
+void
+LocalTransport::onLocalSocketError() {
+    emit error(QAbstractSocket::SocketError(int(pSocket->error())));
+}
@@ -0,0 +1,204 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <QObject>
+#include <QUrl>
+#include <QByteArray>
+#include <QHostAddress>
+#include <QAbstractSocket>
+#include <QElapsedTimer>
+#include <QSslError>
+
+#include "websocketcodec.h"
+
+QT_FORWARD_DECLARE_CLASS(QSslSocket)
+QT_FORWARD_DECLARE_CLASS(QTcpSocket)
+QT_FORWARD_DECLARE_CLASS(QLocalSocket)
+QT_FORWARD_DECLARE_CLASS(QIODevice)
+QT_FORWARD_DECLARE_CLASS(TlsPolicy)
+
+
+// Message oriented link to the Panel Server. The backend is chosen by
+// the URL scheme:
+//   ws://host:port, wss://host:port  WebSocket (TLS for wss)
+//   tcp://host:port                  length prefixed frames over TCP
+//   local://name                     length prefixed frames over a
+//                                    local (Unix domain) socket
+class Transport : public QObject
+{
+    Q_OBJECT
+public:
+    enum Kind { WebSocket, Tcp, Local };
+
+    static Kind       kindOf(const QUrl &url);
+    static Transport* create(const QUrl &url, const TlsPolicy *pTlsPolicy, QObject *parent=Q_NULLPTR);
+
+    explicit Transport(QObject *parent=Q_NULLPTR) : QObject(parent) {}
+    virtual Kind         kind() const = 0;
+    virtual void         open(const QUrl &url) = 0;
+    virtual void         abort() = 0;
+    virtual qint64       sendTextMessage(const QString &sMessage) = 0;
+    // A message encoded once can be sent on many transports of the
+    // same kind; nothing is written before flush()
+    virtual QByteArray   encodeText(const QString &sMessage) const = 0;
+    virtual bool         sendEncoded(const QByteArray &encoded) = 0;
+    virtual void         flush() = 0;
+    virtual void         ping() = 0;
+    virtual QString      errorString() const = 0;
+    virtual QHostAddress peerAddress() const { return QHostAddress(); }
+
+signals:
+    void connected();
+    void disconnected();
+    void error(QAbstractSocket::SocketError error);
+    void textMessageReceived(QString sMessage);
+    void binaryMessageReceived(QByteArray baMessage);
+    void pong(quint64 elapsedTime, QByteArray payload);
+};
+
+
+// RFC 6455 client over a socket of its own: unlike QWebSocket, whose
+// sslConfiguration() is only the one that was set, the QSslSocket
+// reports the certificate and the session ticket really negotiated.
+// The framing is done by WebSocketCodec (see tools/wscheck).
+class WebSocketTransport : public Transport
+{
+    Q_OBJECT
+public:
+    WebSocketTransport(const TlsPolicy *_pTlsPolicy, QObject *parent=Q_NULLPTR);
+
+    Kind         kind() const { return WebSocket; }
+    void         open(const QUrl &url);
+    void         abort();
+    qint64       sendTextMessage(const QString &sMessage);
+    QByteArray   encodeText(const QString &sMessage) const;
+    bool         sendEncoded(const QByteArray &encoded);
+    void         flush();
+    void         ping();
+    QString      errorString() const;
+    QHostAddress peerAddress() const;
+
+private slots:
+    void onSocketConnected();
+    void onEncrypted();
+    void onSslErrors(const QList<QSslError> &errors);
+    void onSessionTicket();
+    void onReadyRead();
+
+private:
+    void   reset();
+    void   fail(QAbstractSocket::SocketError error, const QString &sReason);
+    bool   readUpgradeResponse();
+    void   readFrames();
+    bool   writeFrame(WebSocketCodec::Opcode opcode, const QByteArray &payload);
+    bool   writeMasked(QByteArray frame);
+
+private:
+    const TlsPolicy *pTlsPolicy;
+    QSslSocket      *pSocket;
+    QUrl             url;
+    QByteArray       handshakeKey;
+    bool             bUpgraded;
+    QByteArray       inBuffer;    // Of the upgrade response
+    WebSocketCodec   codec;
+    QElapsedTimer    pingClock;
+    QString          sError;
+};
+
+
+// Each frame is a 4 bytes big endian payload length, a type byte
+// and the payload. Pings carry an opaque payload that the server
+// must echo back in a pong.
+class FramedTransport : public Transport
+{
+    Q_OBJECT
+public:
+    enum FrameType {
+        TextFrame   = 1,
+        BinaryFrame = 2,
+        PingFrame   = 9,
+        PongFrame   = 10
+    };
+
+    explicit FramedTransport(QObject *parent=Q_NULLPTR);
+    qint64     sendTextMessage(const QString &sMessage);
+    QByteArray encodeText(const QString &sMessage) const;
+    bool       sendEncoded(const QByteArray &encoded);
+    void       ping();
+
+protected:
+    void   attach(QIODevice *_pDevice);
+    void   resetFraming();
+
+protected slots:
+    void   onReadyRead();
+
+private:
+    bool   writeFrame(FrameType type, const QByteArray &payload);
+
+private:
+    QIODevice    *pDevice;
+    QByteArray    inBuffer;
+    QElapsedTimer pingClock;
+};
+
+
+class TcpTransport : public FramedTransport
+{
+    Q_OBJECT
+public:
+    explicit TcpTransport(QObject *parent=Q_NULLPTR);
+
+    Kind         kind() const { return Tcp; }
+    void         open(const QUrl &url);
+    void         abort();
+    void         flush();
+    QString      errorString() const;
+    QHostAddress peerAddress() const;
+
+private slots:
+    void onConnected();
+
+private:
+    QTcpSocket *pSocket;
+};
+
+
+class LocalTransport : public FramedTransport
+{
+    Q_OBJECT
+public:
+    explicit LocalTransport(QObject *parent=Q_NULLPTR);
+
+    Kind    kind() const { return Local; }
+    void    open(const QUrl &url);
+    void    abort();
+    void    flush();
+    QString errorString() const;
+
+private slots:
+    void onLocalSocketError();
+
+private:
+    QLocalSocket *pSocket;
+};
+
+#endif // TRANSPORT_H
@@ -1,455 +1,936 @@
-/*
- *
-Copyright (C) 2016  Gabriele Salvato
-
-This program is free software: you can redistribute it and/or modify
-it under the terms of the GNU General Public License as published by
-the Free Software Foundation, either version 3 of the License, or
-(at your option) any later version.
-
-This program is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-GNU General Public License for more details.
-
-You should have received a copy of the GNU General Public License
-along with this program.  If not, see <http://www.gnu.org/licenses/>.
-*
-*/
-
-#include <QDir>
-#include <QMessageBox>
-#include <QThread>
-#include <QNetworkInterface>
-#include <QUdpSocket>
-#include <QWebSocket>
-#include <QCloseEvent>
-#include <QSettings>
-
-#include "tremote.h"
-#include "ui_tremote.h"
-#include "utility.h"
-#include "serverdiscoverer.h"
-
-
-#define CONNECTION_TIME      3000// Not to be set too low for coping with slow networks
-#define NETWORK_CHECK_TIME   3000
-#define SERVER_PORT         45454
-
-
-
-TRemote::TRemote(QWidget *parent)
-  : QMainWindow(parent)
-  , pPanelServerSocket(Q_NULLPTR)
-  , ui(new Ui::TRemote)
-{
-  QString sFunctionName = QString(" TRemote::TRemote ");
-  Q_UNUSED(sFunctionName)
-
-  ui->setupUi(this);
-  ui->powerPercentageEdit->setToolTip("Enter a Value between 0.0 and 100.0");
-  ui->powerPercentageReadEdit->setToolTip("Readback Value");
-  ui->autoSearchButton->setToolTip("Start an Automatic Search");
-  ui->manualButton->setToolTip("Connect to the Specified Address");
-  ui->serverAddressEdit->setToolTip("Enter Server Address");
-  ui->applyButton->hide();
-  ui->groupBox->setDisabled(true);
-  ui->connectionGroupBox->setDisabled(true);
-
-  sNormalStyle = ui->powerPercentageEdit->styleSheet();
-  sErrorStyle  = "QLineEdit { background: rgb(255, 0, 0); selection-background-color: rgb(255, 255, 0); }";
-
-  QSettings settings;
-  restoreGeometry(settings.value("mainWindowGeometry").toByteArray());
-  // create docks, toolbars, etc...
-  restoreState(settings.value("mainWindowState").toByteArray());
-  QString sString = settings.value(QString("serverAddress"),QString("")).toString();
-  ui->serverAddressEdit->setText(sString);
-
-  QString sBaseDir    = QDir::homePath();
-  if(!sBaseDir.endsWith(QString("/"))) sBaseDir+= QString("/");
-  logFileName = QString("%1TRemote.txt").arg(sBaseDir);
-  logFile     = Q_NULLPTR;
-  PrepareLogFile();
-
-  // Creating a periodic Server Discovery Service
-  pServerDiscoverer = new ServerDiscoverer(logFile);
-  connect(pServerDiscoverer, SIGNAL(serverFound(QString)),
-          this, SLOT(onServerFound(QString)));
-
-  // This timer allow retrying connection attempts
-  connect(&connectionTimer, SIGNAL(timeout()),
-          this, SLOT(onConnectionTimerElapsed()));
-
-  // This timer allow periodic check of ready network
-  connect(&networkReadyTimer, SIGNAL(timeout()),
-          this, SLOT(onTimeToCheckNetwork()));
-
-  ui->statusBar->showMessage(tr("Waiting for a Network Connection"));
-  networkReadyTimer.start(NETWORK_CHECK_TIME);
-}
-
-
-TRemote::~TRemote() {
-  // All the housekeeping is done in "closeEvent()" manager
-  QString sFunctionName = QString("TRemote::~TRemote");
-  Q_UNUSED(sFunctionName)
-  delete ui;
-}
-
-
-bool
-TRemote::PrepareLogFile() {
-#if defined(LOG_MESG) || defined(LOG_VERBOSE)
-  QFileInfo checkFile(logFileName);
-  if(checkFile.exists() && checkFile.isFile()) {
-    QDir renamed;
-    renamed.remove(logFileName+QString(".bkp"));
-    renamed.rename(logFileName, logFileName+QString(".bkp"));
-  }
-  logFile = new QFile(logFileName);
-  if (!logFile->open(QIODevice::WriteOnly)) {
-    QMessageBox::information(this, tr("TRemote"),
-                             tr("Unable to open file %1: %2.")
-                             .arg(logFileName).arg(logFile->errorString()));
-    delete logFile;
-    logFile = NULL;
-  }
-#endif
-    return true;
-}
-
-
-bool
-TRemote::isConnectedToNetwork() {
-  QString sFunctionName = " TRemote::isConnectedToNetwork ";
-  Q_UNUSED(sFunctionName)
-  QList<QNetworkInterface> ifaces = QNetworkInterface::allInterfaces();
-  bool result = false;
-
-  for(int i=0; i<ifaces.count(); i++) {
-    QNetworkInterface iface = ifaces.at(i);
-    if(iface.flags().testFlag(QNetworkInterface::IsUp) &&
-       iface.flags().testFlag(QNetworkInterface::IsRunning) &&
-       iface.flags().testFlag(QNetworkInterface::CanBroadcast) &&
-      !iface.flags().testFlag(QNetworkInterface::IsLoopBack))
-    {
-      for(int j=0; j<iface.addressEntries().count(); j++) {
-        if(!result) result = true;
-      }
-    }
-  }
-#ifdef LOG_VERBOSE
-  logMessage(logFile,
-             sFunctionName,
-             result ? QString("true") : QString("false"));
-#endif
-  ui->connectionGroupBox->setEnabled(result);
-  return result;
-}
-
-
-void
-TRemote::closeEvent(QCloseEvent *event) {
-  Q_UNUSED(event)
-  QString sFunctionName = " TRemote::closeEvent ";
-  Q_UNUSED(sFunctionName)
-  QString sMessage;
-  Q_UNUSED(sMessage)
-  QSettings settings;
-  settings.setValue("mainWindowGeometry", saveGeometry());
-  settings.setValue("mainWindowState", saveState());
-  settings.setValue(QString("serverAddress"), ui->serverAddressEdit->text());
-}
-
-
-void
-TRemote::startServerDiscovery() {
-  QString sFunctionName = QString(" TRemote::startServerDiscovery ");
-  Q_UNUSED(sFunctionName)
-
-  // Is the network available ?
-  if(isConnectedToNetwork()) {// Yes. Start the Connection Attempts
-    networkReadyTimer.stop();
-    pServerDiscoverer->Discover();
-    connectionTime = int(CONNECTION_TIME * (1.0 + (double(qrand())/double(RAND_MAX))));
-    connectionTimer.start(connectionTime);
-    ui->statusBar->showMessage(tr("Waiting to be connected to the Server"));
-  }
-  else {// No. Wait until network become ready
-    ui->statusBar->showMessage(tr("Waiting for a Network Connection"));
-    networkReadyTimer.start(NETWORK_CHECK_TIME);
-#ifdef LOG_VERBOSE
-    logMessage(logFile,
-               sFunctionName,
-               QString(" waiting for network..."));
-#endif
-  }
-}
-
-
-// Network available retry check
-void
-TRemote::onTimeToCheckNetwork() {
-  QString sFunctionName = " TRemote::onTimeToCheckNetwork ";
-  Q_UNUSED(sFunctionName)
-  if(isConnectedToNetwork()) {
-    networkReadyTimer.stop();
-    pServerDiscoverer->Discover();
-    connectionTime = int(CONNECTION_TIME * (1.0 + double(qrand())/double(RAND_MAX)));
-    connectionTimer.start(connectionTime);
-    ui->statusBar->showMessage(tr("Waiting to be connected to the Server"));
-  }
-#ifdef LOG_VERBOSE
-  else {
-    logMessage(logFile,
-               sFunctionName,
-               QString("Waiting for network..."));
-  }
-#endif
-}
-
-
-void
-TRemote::onConnectionTimerElapsed() {
-  QString sFunctionName = " TRemote::onConnectionTimerElapsed ";
-  Q_UNUSED(sFunctionName)
-
-  if(!isConnectedToNetwork()) {
-    ui->statusBar->showMessage(tr("Waiting for a Network Connection"));
-    connectionTimer.stop();
-    networkReadyTimer.start(NETWORK_CHECK_TIME);
-#ifdef LOG_VERBOSE
-    logMessage(logFile,
-               sFunctionName,
-               QString("Waiting for network..."));
-#endif
-}
-else {
-#ifdef LOG_VERBOSE
-    logMessage(logFile,
-               sFunctionName,
-               QString("Connection time out... retrying"));
-#endif
-    pServerDiscoverer->Discover();
-  }
-}
-
-
-void
-TRemote::onServerFound(QString serverUrl) {
-    QString sFunctionName = " TRemote::onServerFound ";
-    Q_UNUSED(sFunctionName)
-
-    connectionTimer.stop();
-    ui->statusBar->showMessage(tr("Server Found at Address: %1").arg(serverUrl));
-
-    // We are ready to connect to the Remote Panel Server
-    pPanelServerSocket = new QWebSocket();
-    connect(pPanelServerSocket, SIGNAL(connected()),
-            this, SLOT(onPanelServerConnected()));
-    connect(pPanelServerSocket, SIGNAL(error(QAbstractSocket::SocketError)),
-            this, SLOT(onPanelServerSocketError(QAbstractSocket::SocketError)));
-    pPanelServerSocket->open(QUrl(serverUrl));
-
-}
-
-
-void
-TRemote::onPanelServerConnected() {
-  QString sFunctionName = " TRemote::onPanelServerConnected ";
-  Q_UNUSED(sFunctionName)
-
-  ui->groupBox->setEnabled(true);
-  connect(pPanelServerSocket, SIGNAL(disconnected()),
-          this, SLOT(onPanelServerDisconnected()));
-  connect(pPanelServerSocket, SIGNAL(textMessageReceived(QString)),
-          this, SLOT(onTextMessageReceived(QString)));
-  connect(pPanelServerSocket, SIGNAL(binaryMessageReceived(QByteArray)),
-          this, SLOT(onBinaryMessageReceived(QByteArray)));
-  ui->statusBar->showMessage(tr("Connected to Panel Server: %1").arg(pPanelServerSocket->peerAddress().toString()));
-  // Ask for the current status
-  QString sMessage;
-  sMessage = QString("<getStatus>1</getStatus>");
-  qint64 bytesSent = pPanelServerSocket->sendTextMessage(sMessage);
-  if(bytesSent != sMessage.length()) {
-    logMessage(logFile,
-               sFunctionName,
-               QString("Unable to ask the initial status"));
-  }
-}
-
-
-void
-TRemote::onPanelServerDisconnected() {
-  QString sFunctionName = " TRemote::onPanelServerDisconnected ";
-  Q_UNUSED(sFunctionName)
-#ifdef LOG_VERBOSE
-  logMessage(logFile,
-             sFunctionName,
-             QString("emitting panelClosed()"));
-#endif
-  if(pPanelServerSocket)
-      pPanelServerSocket->deleteLater();
-  pPanelServerSocket =Q_NULLPTR;
-  ui->groupBox->setDisabled(true);
-  startServerDiscovery();
-}
-
-
-void
-TRemote::onPanelServerSocketError(QAbstractSocket::SocketError error) {
-  QString sFunctionName = " TRemote::onPanelServerSocketError ";
-  logMessage(logFile,
-             sFunctionName,
-             QString("%1 %2 Error %3")
-             .arg(pPanelServerSocket->peerAddress().toString())
-             .arg(pPanelServerSocket->errorString())
-             .arg(error));
-
-  if(!disconnect(pPanelServerSocket, 0, 0, 0)) {
-#ifdef LOG_VERBOSE
-    logMessage(logFile,
-               sFunctionName,
-               QString("Unable to disconnect signals from Sever Socket"));
-#endif
-  }
-  if(pPanelServerSocket)
-    pPanelServerSocket->deleteLater();
-  pPanelServerSocket = Q_NULLPTR;
-  ui->groupBox->setDisabled(true);
-  startServerDiscovery();
-}
-
-
-void
-TRemote::onBinaryMessageReceived(QByteArray baMessage) {
-  QString sFunctionName = " TRemote::onBinaryMessageReceived ";
-  Q_UNUSED(sFunctionName)
-  logMessage(logFile,
-             sFunctionName,
-             QString("Received %1 bytes").arg(baMessage.size()));
-}
-
-
-void
-TRemote::onTextMessageReceived(QString sMessage) {
-  QString sFunctionName = " TRemote::onTextMessageReceived ";
-  Q_UNUSED(sFunctionName)
-  QString sToken;
-  bool ok;
-  QString sNoData = QString("NoData");
-
-  sToken = XML_Parse(sMessage, "setPercent");
-  if(sToken != sNoData) {
-    double pValue = sToken.toDouble(&ok);
-    if(ok && (pValue >= 0.0) && (pValue <= 100.0)) {
-      ui->powerPercentageEdit->setText(sToken);
-      ui->applyButton->hide();
-    }
-  }
-
-  sToken = XML_Parse(sMessage, "readPercent");
-  if(sToken != sNoData) {
-    ui->powerPercentageReadEdit->setText(sToken);
-  }
-
-  sToken = XML_Parse(sMessage, "noDAC");
-  if(sToken != sNoData) {
-    ui->powerPercentageReadEdit->setText(sToken);
-  }
-
-}
-
-
-void
-TRemote::on_powerPercentageEdit_textChanged(const QString &arg1) {
-  double pValue = arg1.toDouble();
-  if((pValue < 0.0) || (pValue > 100.0)) {
-    ui->powerPercentageEdit->setStyleSheet(sErrorStyle);
-    ui->applyButton->hide();
-    return;
-  }
-  ui->powerPercentageEdit->setStyleSheet(sNormalStyle);
-  ui->applyButton->show();
-}
-
-
-void
-TRemote::on_powerPercentageEdit_returnPressed() {
-  QString sFunctionName = " TRemote::on_powerPercentageEdit_returnPressed";
-  Q_UNUSED(sFunctionName)
-  double pValue = ui->powerPercentageEdit->text().toDouble();
-  if((pValue < 0.0) || (pValue > 100.0)) {
-    ui->powerPercentageEdit->setStyleSheet(sErrorStyle);
-    return;
-  }
-  QString sString = QString("%1").arg(pValue, 0, 'f', 1);
-  ui->powerPercentageEdit->setText(sString);
-  QString sMessage = QString("<setPercent>%1</setPercent>").arg(sString);
-  qint64 bytesSent = pPanelServerSocket->sendTextMessage(sMessage);
-  if(bytesSent != sMessage.length()) {
-    logMessage(logFile,
-               sFunctionName,
-               QString("Unable to ask the initial status"));
-  }
-  ui->applyButton->hide();
-  return;
-}
-
-
-void
-TRemote::on_applyButton_clicked() {
-  QString sFunctionName = " TRemote::on_applyButton_clicked";
-  Q_UNUSED(sFunctionName)
-  on_powerPercentageEdit_returnPressed();
-}
-
-
-void
-TRemote::on_serverAddressEdit_returnPressed() {
-    QString sFunctionName = " TRemote::on_serverAddressEdit_returnPressed";
-    Q_UNUSED(sFunctionName)
-    QString serverUrl = QString("ws://%1:%2").arg(ui->serverAddressEdit->text()).arg(SERVER_PORT);
-
-    connectionTimer.stop();
-    ui->connectionGroupBox->setDisabled(true);
-    ui->statusBar->showMessage(tr("Connection pending to: %1").arg(serverUrl));
-
-    // We are ready to connect to the Remote Panel Server
-    pPanelServerSocket = new QWebSocket();
-    connect(pPanelServerSocket, SIGNAL(connected()),
-            this, SLOT(onPanelServerConnected()));
-    connect(pPanelServerSocket, SIGNAL(error(QAbstractSocket::SocketError)),
-            this, SLOT(onPanelServerSocketError(QAbstractSocket::SocketError)));
-    pPanelServerSocket->open(QUrl(serverUrl));
-}
-
-
-void
-TRemote::on_autoSearchButton_clicked() {
-  QString sFunctionName = " TRemote::on_autoSearchButton_clicked";
-  Q_UNUSED(sFunctionName)
-  startServerDiscovery();
-  ui->connectionGroupBox->setDisabled(true);
-}
-
-
-void
-TRemote::on_manualButton_clicked() {
-    QString sFunctionName = " TRemote::on_manualButton_clicked";
-    Q_UNUSED(sFunctionName)
-    QString serverUrl = QString("ws://%1:%2").arg(ui->serverAddressEdit->text()).arg(SERVER_PORT);
-
-    connectionTimer.stop();
-    ui->connectionGroupBox->setDisabled(true);
-    ui->statusBar->showMessage(tr("Connection pending to: %1").arg(serverUrl));
-
-    // We are ready to connect to the Remote Panel Server
-    pPanelServerSocket = new QWebSocket();
-    connect(pPanelServerSocket, SIGNAL(connected()),
-            this, SLOT(onPanelServerConnected()));
-    connect(pPanelServerSocket, SIGNAL(error(QAbstractSocket::SocketError)),
-            this, SLOT(onPanelServerSocketError(QAbstractSocket::SocketError)));
-    pPanelServerSocket->open(QUrl(serverUrl));
-}
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <QDir>
+#include <QMessageBox>
+#include <QThread>
+#include <QCloseEvent>
+#include <QShowEvent>
+#include <QSettings>
+#include <QFileDialog>
+#include <QShortcut>
+#include <QMenu>
+#include <QMenuBar>
+#include <QAction>
+#include <QDateTime>
+#include <QtConcurrentRun>
+#include <QFutureWatcher>
+
+#include "tremote.h"
+#include "ui_tremote.h"
+#include "utility.h"
+#include "setpointramp.h"
+#include "commandtracker.h"
+#include "commandjournal.h"
+#include "clocksync.h"
+#include "groupbroadcaster.h"
+#include "tracer.h"
+#include "metrics.h"
+#include "allocstats.h"
+#include "readbackhistory.h"
+#include "stallwatchdog.h"
+#include "startupprofile.h"
+
+
+#define SERVER_PORT         45454
+#define METRICS_FILE_PERIOD  10000
+#define STATS_UPDATE_TIME    1000
+#define STATS_WINDOW         600 // Samples
+#define HISTORY_CAPACITY     400000 // Readbacks kept: over an hour at 100 Hz
+#define STALL_THRESHOLD      500 // ms without GUI event loop heartbeat
+#define JOURNAL_MAX_AGE      3600 // s a setpoint left pending is offered again
+
+
+
+TRemote::TRemote(QWidget *parent)
+  : QMainWindow(parent)
+  , pConnection(Q_NULLPTR)
+  , pSetpointRamp(Q_NULLPTR)
+  , pCommandTracker(Q_NULLPTR)
+  , pCommandJournal(Q_NULLPTR)
+  , pClockSync(Q_NULLPTR)
+  , pGroupBroadcaster(Q_NULLPTR)
+  , pMetricsExporter(Q_NULLPTR)
+  , pStallWatchdog(Q_NULLPTR)
+  , appliedSetpoint(0.0)
+  , bSetpointKnown(false)
+  , readbackHistory(HISTORY_CAPACITY)
+  , bHistoryDue(false)
+  , bFirstMessage(false)
+  , nConnections(0)
+  , startupStage(StageShow)
+  , bFirstReadback(true)
+  , ui(new Ui::TRemote)
+{
+  ui->setupUi(this);
+  ui->powerPercentageEdit->setToolTip("Enter a Value between 0.0 and 100.0");
+  ui->powerPercentageReadEdit->setToolTip("Readback Value");
+  ui->autoSearchButton->setToolTip("Start an Automatic Search");
+  ui->manualButton->setToolTip("Connect to the Specified Address");
+  ui->serverAddressEdit->setToolTip("Enter Server Address");
+  ui->profileButton->setToolTip("Run a Setpoint Profile from File");
+  ui->applyButton->hide();
+  ui->profileButton->setDisabled(true);
+  ui->connectionGroupBox->setDisabled(true);
+
+  sNormalStyle = ui->powerPercentageEdit->styleSheet();
+  sErrorStyle  = "QLineEdit { background: rgb(255, 0, 0); selection-background-color: rgb(255, 255, 0); }";
+
+  QSettings settings;
+  restoreGeometry(settings.value("mainWindowGeometry").toByteArray());
+  // create docks, toolbars, etc...
+  restoreState(settings.value("mainWindowState").toByteArray());
+  QString sString = settings.value(QString("serverAddress"),QString("")).toString();
+  ui->serverAddressEdit->setText(sString);
+
+  QString sBaseDir    = QDir::homePath();
+  if(!sBaseDir.endsWith(QString("/"))) sBaseDir+= QString("/");
+  logFileName = QString("%1TRemote.txt").arg(sBaseDir);
+  // Opened by PrepareLogFile() once the window is on screen: until
+  // then the messages go to the debug output
+  logFile     = new QFile(logFileName);
+  sJournalFileName = QString("%1TRemote.journal").arg(sBaseDir);
+  sHistoryFileName = QString("%1TRemote-history.csv").arg(sBaseDir);
+  historyPool.setMaxThreadCount(1);
+
+  // Tracing may be enabled at startup or toggled with Ctrl+Shift+T
+  traceFileName = QString("%1TRemote-trace.json").arg(sBaseDir);
+  if(qEnvironmentVariableIsSet("TREMOTE_TRACE") ||
+     settings.value(QString("trace"), false).toBool())
+  {
+    Tracer::start();
+  }
+  QShortcut* pTraceShortcut = new QShortcut(QKeySequence(tr("Ctrl+Shift+T")), this);
+  connect(pTraceShortcut, SIGNAL(activated()),
+          this, SLOT(onToggleTrace()));
+
+  // The connection manager owns the Panel Server socket and runs in
+  // a thread of its own, out of reach of the GUI load
+  qRegisterMetaType<ConnectionManager::State>("ConnectionManager::State");
+  pConnection = new ConnectionManager(logFile);
+  connect(pConnection, SIGNAL(stateChanged(ConnectionManager::State)),
+          this, SLOT(onConnectionStateChanged(ConnectionManager::State)));
+  connect(pConnection, SIGNAL(networkStatus(bool)),
+          this, SLOT(onNetworkStatus(bool)));
+  connect(pConnection, SIGNAL(connected()),
+          this, SLOT(onPanelServerConnected()));
+  connect(pConnection, SIGNAL(disconnected()),
+          this, SLOT(onPanelServerDisconnected()));
+  connect(pConnection, SIGNAL(failedOver(QString)),
+          this, SLOT(onPanelServerFailover(QString)));
+  // wss:// with cached TLS sessions, see TlsPolicy
+  pConnection->setSecure(qEnvironmentVariableIsSet("TREMOTE_TLS") ||
+                         settings.value(QString("tls"), false).toBool());
+  // A second discovered server may be kept connected as a hot standby
+  pConnection->setHotStandby(qEnvironmentVariableIsSet("TREMOTE_HOT_STANDBY") ||
+                             settings.value(QString("hotStandby"), false).toBool());
+  connect(pConnection, SIGNAL(textMessageReceived(QString)),
+          this, SLOT(onTextMessageReceived(QString)));
+  connect(pConnection, SIGNAL(binaryMessageReceived(QByteArray)),
+          this, SLOT(onBinaryMessageReceived(QByteArray)));
+  pConnection->moveToThread(&linkThread);
+  connect(&linkThread, SIGNAL(finished()),
+          pConnection, SLOT(deleteLater()));
+  linkThread.start(QThread::HighPriority);
+
+  // Setpoint profiles are timed and sent in their own thread
+  pSetpointRamp = new SetpointRamp(logFile, this);
+  connect(pSetpointRamp, SIGNAL(setpointDue(double,qint64)),
+          this, SLOT(onRampSetpointDue(double,qint64)),
+          Qt::DirectConnection);
+  connect(pSetpointRamp, SIGNAL(finished()),
+          this, SLOT(onRampFinished()));
+
+  // Outbound commands are sequence numbered and acknowledged
+  pCommandTracker = new CommandTracker(logFile, this);
+  connect(pCommandTracker, SIGNAL(retransmit(QString)),
+          this, SLOT(onCommandRetransmit(QString)));
+  connect(pCommandTracker, SIGNAL(commandLost(quint32,QString)),
+          this, SLOT(onCommandLost(quint32,QString)));
+
+  // Server timestamps are translated through the estimated clock offset
+  pClockSync = new ClockSync(logFile, this);
+  connect(pClockSync, SIGNAL(timeRequest(QString)),
+          this, SLOT(onTimeRequest(QString)));
+  pCommandTracker->setClockSync(pClockSync);
+
+  // The current setpoint may be applied to whole groups of servers
+  pGroupBroadcaster = new GroupBroadcaster(logFile, this);
+  connect(pGroupBroadcaster, SIGNAL(groupApplied(QString,int,int)),
+          this, SLOT(onGroupApplied(QString,int,int)));
+
+  // Running statistics of the readback and of the tracking error
+  int statsWindow = settings.value(QString("statsWindow"), STATS_WINDOW).toInt();
+  readbackStats.setWindowSize(statsWindow);
+  trackingErrorStats.setWindowSize(statsWindow);
+  connect(&statsTimer, SIGNAL(timeout()),
+          this, SLOT(onTimeToUpdateStats()));
+  statsTimer.start(STATS_UPDATE_TIME);
+
+  // Setpoints are journaled before being sent and replayed on reconnection
+  pCommandJournal = new CommandJournal(logFile, this);
+
+  ui->statusBar->showMessage(tr("Waiting for a Network Connection"));
+  StartupProfile::mark("construction");
+}
+
+
+TRemote::~TRemote() {
+  // All the housekeeping is done in "closeEvent()" manager.
+  // The ramp thread may be waiting for the link thread: it goes first
+  delete pSetpointRamp;
+  linkThread.quit();
+  linkThread.wait();
+  delete ui;
+}
+
+
+// The startup work not needed to draw the window is done only once it
+// is shown, one stage per event loop pass so that it stays responsive
+void
+TRemote::showEvent(QShowEvent *event) {
+  QMainWindow::showEvent(event);
+  if(startupStage == StageShow) {
+    startupStage = StageFiles;
+    QTimer::singleShot(0, this, SLOT(onStartupStage()));
+  }
+}
+
+
+void
+TRemote::onStartupStage() {
+  TRACE_SPAN("onStartupStage", "startup");
+  switch(startupStage) {
+  case StageFiles:
+    // The first paint is queued before this slot
+    StartupProfile::mark("window");
+    PrepareLogFile();
+    {
+      QSettings settings;
+      pCommandJournal->open(sJournalFileName,
+                            settings.value(QString("journalMaxAge"), JOURNAL_MAX_AGE).toInt());
+    }
+    // The readback history of the previous session is kept aside
+    {
+      QFileInfo checkFile(sHistoryFileName);
+      if(checkFile.exists() && checkFile.isFile()) {
+        QDir renamed;
+        renamed.remove(sHistoryFileName+QString(".bkp"));
+        renamed.rename(sHistoryFileName, sHistoryFileName+QString(".bkp"));
+      }
+    }
+    // A setpoint not applied by the previous session is never sent
+    // on its own: the operator has to confirm it with "Apply"
+    if(pCommandJournal->isRestored(QString("setPercent"))) {
+      QString sValue = pCommandJournal->restoredValue(QString("setPercent"));
+      ui->powerPercentageEdit->setText(sValue);
+      ui->statusBar->showMessage(tr("%1% was not applied on %2: press Apply to send it")
+                                 .arg(sValue)
+                                 .arg(QDateTime::fromMSecsSinceEpoch(pCommandJournal->restoredTime(QString("setPercent")))
+                                      .toString(Qt::SystemLocaleShortDate)));
+    }
+    StartupProfile::mark("files");
+    startupStage = StageNetwork;
+    break;
+
+  case StageNetwork:
+    // The network is checked at once: it is retried while not ready
+    pConnection->startDiscovery();
+    StartupProfile::mark("network_check");
+    startupStage = StageServices;
+    break;
+
+  case StageServices:
+    startServices();
+    StartupProfile::mark("services");
+    LOG_INFO(logFile, "Window ready: %1", StartupProfile::summary());
+    startupStage = StageDone;
+    break;
+
+  case StageShow:
+  case StageDone:
+    break;
+  }
+  if(startupStage != StageDone)
+    QTimer::singleShot(0, this, SLOT(onStartupStage()));
+}
+
+
+void
+TRemote::startServices() {
+  QSettings settings;
+
+  // Event loop stalls are logged with the stack of the GUI thread
+  int stallThreshold = settings.value(QString("stallThreshold"), STALL_THRESHOLD).toInt();
+  if(qEnvironmentVariableIsSet("TREMOTE_STALL_MS"))
+    stallThreshold = qgetenv("TREMOTE_STALL_MS").toInt();
+  if(stallThreshold > 0) {
+    pStallWatchdog = new StallWatchdog(logFile, this);
+    pStallWatchdog->start(stallThreshold);
+  }
+
+  pGroupBroadcaster->loadGroups();
+  QStringList groupNames = pGroupBroadcaster->groupNames();
+  if(!groupNames.isEmpty()) {
+    QMenu* pGroupMenu = ui->menuBar->addMenu(tr("&Groups"));
+    for(int i=0; i<groupNames.count(); i++)
+      pGroupMenu->addAction(tr("Apply Setpoint to %1").arg(groupNames.at(i)))->setData(groupNames.at(i));
+    connect(pGroupMenu, SIGNAL(triggered(QAction*)),
+            this, SLOT(onGroupActionTriggered(QAction*)));
+  }
+
+  // Counters and latencies may be exported over a local HTTP
+  // endpoint, a periodically rewritten file or both
+  quint16 metricsPort = quint16(settings.value(QString("metricsPort"), 0).toUInt());
+  if(qEnvironmentVariableIsSet("TREMOTE_METRICS_PORT"))
+    metricsPort = quint16(qgetenv("TREMOTE_METRICS_PORT").toUInt());
+  QString sMetricsFile = settings.value(QString("metricsFile"), QString()).toString();
+  if(qEnvironmentVariableIsSet("TREMOTE_METRICS_FILE"))
+    sMetricsFile = QString::fromLocal8Bit(qgetenv("TREMOTE_METRICS_FILE"));
+  if(metricsPort != 0 || !sMetricsFile.isEmpty()) {
+    pMetricsExporter = new MetricsExporter(logFile, this);
+    if(metricsPort != 0)
+      pMetricsExporter->listen(metricsPort);
+    if(!sMetricsFile.isEmpty())
+      pMetricsExporter->writeFilePeriodically(sMetricsFile, METRICS_FILE_PERIOD);
+  }
+}
+
+
+bool
+TRemote::PrepareLogFile() {
+#ifdef LOG_MESG
+  QFileInfo checkFile(logFileName);
+  if(checkFile.exists() && checkFile.isFile()) {
+    QDir renamed;
+    renamed.remove(logFileName+QString(".bkp"));
+    renamed.rename(logFileName, logFileName+QString(".bkp"));
+  }
+  // Runtime log level: -1=Off, 0=Errors ... 3=Debug
+  QSettings settings;
+  bool ok;
+  int level = qgetenv("TREMOTE_LOG_LEVEL").toInt(&ok);
+  if(!ok)
+    level = settings.value(QString("logLevel"), int(LogInfo)).toInt();
+  setLogLevel(level);
+
+  // The binary log replaces the text one when requested
+  if(settings.value(QString("binaryLog"), false).toBool() ||
+     qEnvironmentVariableIsSet("TREMOTE_BINARY_LOG"))
+  {
+    QString binaryLogFileName = logFileName;
+    binaryLogFileName.replace(QString(".txt"), QString(".tlog"));
+    QFileInfo checkBinaryFile(binaryLogFileName);
+    if(checkBinaryFile.exists() && checkBinaryFile.isFile()) {
+      QDir renamed;
+      renamed.remove(binaryLogFileName+QString(".bkp"));
+      renamed.rename(binaryLogFileName, binaryLogFileName+QString(".bkp"));
+    }
+    if(BinaryLog::open(binaryLogFileName))
+      return true;
+  }
+  // The components keep the pointer: on failure the file is left
+  // closed and the messages keep going to the debug output
+  if (!logFile->open(QIODevice::WriteOnly)) {
+    QMessageBox* pMessageBox = new QMessageBox(QMessageBox::Information,
+                                               tr("TRemote"),
+                                               tr("Unable to open file %1: %2.")
+                                               .arg(logFileName).arg(logFile->errorString()),
+                                               QMessageBox::Ok,
+                                               this);
+    pMessageBox->setAttribute(Qt::WA_DeleteOnClose);
+    pMessageBox->open();
+  }
+#endif
+    return true;
+}
+
+
+void
+TRemote::closeEvent(QCloseEvent *event) {
+  Q_UNUSED(event)
+  QString sMessage;
+  Q_UNUSED(sMessage)
+  QSettings settings;
+  settings.setValue("mainWindowGeometry", saveGeometry());
+  settings.setValue("mainWindowState", saveState());
+  settings.setValue(QString("serverAddress"), ui->serverAddressEdit->text());
+  if(Tracer::isEnabled()) {
+    Tracer::stop();
+    Tracer::dump(traceFileName);
+  }
+  if(AllocStats::isEnabled())
+    LOG_INFO(logFile, "Allocations: %1", AllocStats::summary());
+  saveHistory();
+  historyPool.waitForDone();
+}
+
+
+void
+TRemote::onNetworkStatus(bool bAvailable) {
+  ui->connectionGroupBox->setEnabled(bAvailable);
+  if(!bAvailable)
+    ui->statusBar->showMessage(tr("Waiting for a Network Connection"));
+}
+
+
+void
+TRemote::onConnectionStateChanged(ConnectionManager::State newState) {
+  switch(newState) {
+  case ConnectionManager::Idle:
+    ui->statusBar->showMessage(tr("Not Connected"));
+    ui->connectionGroupBox->setEnabled(true);
+    break;
+  case ConnectionManager::Discovering:
+    ui->statusBar->showMessage(tr("Waiting to be connected to the Server"));
+    break;
+  case ConnectionManager::Connecting:
+    ui->statusBar->showMessage(tr("Connection pending to: %1").arg(pConnection->serverUrl()));
+    ui->connectionGroupBox->setDisabled(true);
+    break;
+  case ConnectionManager::Connected: {
+    // local:// servers have no IP peer
+    QHostAddress peer = pConnection->peerAddress();
+    ui->statusBar->showMessage(tr("Connected to Panel Server: %1")
+                               .arg(peer.isNull() ? pConnection->serverUrl() : peer.toString()));
+    break;
+  }
+  case ConnectionManager::Draining:
+    ui->statusBar->showMessage(tr("Disconnecting from: %1").arg(pConnection->serverUrl()));
+    break;
+  }
+}
+
+
+void
+TRemote::onPanelServerConnected() {
+  StartupProfile::mark("connected");
+  ui->profileButton->setEnabled(true);
+  pCommandTracker->connectionRestored();
+  replayJournal();
+  pClockSync->start();
+  bFirstMessage = true;
+  nConnections++;
+  TRACE_ASYNC_BEGIN("getStatus", "message", nConnections);
+  // Ask for the current status
+  QString sMessage;
+  sMessage = QString("<getStatus>1</getStatus>");
+  qint64 bytesSent = pConnection->sendTextMessage(sMessage);
+  if(bytesSent != sMessage.length()) {
+    LOG_ERROR(logFile, "Unable to ask the initial status");
+  }
+  if(pConnection->serverUrl() != readbackHistory.server()) {
+    saveHistory();
+    readbackHistory.reset(pConnection->serverUrl());
+  }
+  bHistoryDue = true;
+}
+
+
+void
+TRemote::onPanelServerDisconnected() {
+  pSetpointRamp->stop();
+  pCommandTracker->connectionLost();
+  // The journal replays what the operator issued
+  heldCommands.clear();
+  pClockSync->stop();
+  ui->profileButton->setDisabled(true);
+}
+
+
+// The standby server has taken over: it must be driven to the
+// state the failed one was in
+void
+TRemote::onPanelServerFailover(QString sUrl) {
+  ui->statusBar->showMessage(tr("Switched to Panel Server: %1").arg(sUrl));
+  pCommandTracker->connectionLost();
+  pCommandTracker->connectionRestored();
+  replayJournal();
+  pClockSync->start();
+  if(!sCurrentSetpoint.isEmpty() &&
+     !pCommandJournal->isPending(QString("setPercent")) &&
+     !sendCommand(QString("setPercent"), sCurrentSetpoint))
+  {
+    LOG_ERROR(logFile, "Unable to re-apply the setpoint %1", sCurrentSetpoint);
+  }
+  bFirstMessage = true;
+  nConnections++;
+  TRACE_ASYNC_BEGIN("getStatus", "message", nConnections);
+  QString sMessage = QString("<getStatus>1</getStatus>");
+  if(pConnection->sendTextMessage(sMessage) != sMessage.length())
+    LOG_ERROR(logFile, "Unable to ask the status after the failover");
+  // The standby numbers its readbacks on its own
+  if(sUrl != readbackHistory.server()) {
+    saveHistory();
+    readbackHistory.reset(sUrl);
+  }
+  bHistoryDue = true;
+}
+
+
+// Readbacks measured while we were away are asked for as soon as the
+// first numbered readback tells which run of the server we are talking
+// to: the answer comes in binary chunks
+void
+TRemote::requestHistory() {
+  pendingBackfill.clear();
+  backfillClock.start();
+  QString sMessage = QString("<getHistory>%1</getHistory>").arg(readbackHistory.lastSeq());
+  if(pConnection->sendTextMessage(sMessage) != sMessage.length())
+    LOG_ERROR(logFile, "Unable to ask the readback history");
+}
+
+
+// The series of a server run is written out when it ends, away from
+// the GUI thread: the copy handed to the pool only shares the samples
+void
+TRemote::saveHistory() {
+  if(readbackHistory.isEmpty())
+    return;
+  LOG_INFO(logFile, "Saving %1 readbacks of %2 to %3",
+           readbackHistory.count(), readbackHistory.server(), sHistoryFileName);
+  QFutureWatcher<bool>* pWatcher = new QFutureWatcher<bool>(this);
+  connect(pWatcher, SIGNAL(finished()),
+          this, SLOT(onHistorySaved()));
+  pWatcher->setFuture(QtConcurrent::run(&historyPool, readbackHistory,
+                                        &ReadbackHistory::save, sHistoryFileName));
+}
+
+
+void
+TRemote::onHistorySaved() {
+  QFutureWatcher<bool>* pWatcher = static_cast<QFutureWatcher<bool>*>(sender());
+  if(!pWatcher->result())
+    LOG_ERROR(logFile, "Unable to save the readback history to %1", sHistoryFileName);
+  pWatcher->deleteLater();
+}
+
+
+void
+TRemote::onBinaryMessageReceived(const QByteArray &baMessage) {
+  TRACE_SPAN("onBinaryMessageReceived", "message");
+  ALLOC_REGION("binary_message");
+  if(HistoryCodec::isChunk(baMessage)) {
+    bool bLast;
+    if(!HistoryCodec::decode(baMessage, &pendingBackfill, &bLast)) {
+      LOG_WARNING(logFile, "Discarding a malformed history chunk of %1 bytes", baMessage.size());
+      pendingBackfill.clear();
+      return;
+    }
+    if(bLast) {
+      static MetricHistogram& backfillSeconds = Metrics::histogram("tremote_history_backfill_seconds",
+                                                                   "From the history request to the merge of the last chunk");
+      static MetricCounter& backfilledSamples = Metrics::counter("tremote_history_backfilled_samples_total",
+                                                                 "Readbacks recovered from the server history");
+      // The readbacks of the gap enter the statistics as one frame;
+      // not the tracking error: the setpoint of the time is unknown
+      QVector<double> addedValues;
+      int nAdded = readbackHistory.merge(pendingBackfill, &addedValues);
+      readbackStats.addBatch(addedValues.constData(), addedValues.count());
+      backfilledSamples.inc(quint64(nAdded));
+      if(backfillClock.isValid())
+        backfillSeconds.observe(backfillClock.nsecsElapsed());
+      LOG_INFO(logFile,
+               "Backfilled %1 readbacks in %2 ms",
+               nAdded,
+               backfillClock.isValid() ? backfillClock.elapsed() : qint64(-1));
+      backfillClock.invalidate();
+      pendingBackfill.clear();
+      pendingBackfill.squeeze();
+    }
+    return;
+  }
+  LOG_DEBUG(logFile, "Received %1 bytes", baMessage.size());
+}
+
+
+// Runs for every frame: the tags are looked up in place and nothing is
+// allocated unless the displayed values change or a command completes
+void
+TRemote::onTextMessageReceived(const QString &sMessage) {
+  TRACE_SPAN("onTextMessageReceived", "message");
+  ALLOC_REGION("text_message");
+  QStringRef sToken;
+  bool ok;
+
+  if(bFirstMessage) {
+    bFirstMessage = false;
+    TRACE_ASYNC_END("getStatus", "message", nConnections);
+    TRACE_INSTANT("first message", "message");
+  }
+
+  // Server time of the event, when the server provides it
+  qint64 serverNs = -1;
+  if(XML_Find(sMessage, "ts", &sToken))
+    serverNs = sToken.toLongLong(&ok);
+
+  if(XML_Find(sMessage, "timeResp", &sToken))
+    pClockSync->responseReceived(sToken.toString());
+
+  if(XML_Find(sMessage, "ack", &sToken)) {
+    quint32 seq = sToken.toUInt(&ok);
+    if(ok)
+      pCommandTracker->acknowledged(seq, serverNs);
+  }
+
+  if(XML_Find(sMessage, "setPercent", &sToken)) {
+    // Servers repeat it in every status: copied only when it changes
+    if(sToken != sSetpointReadback) {
+      sSetpointReadback = sToken.toString();
+      appliedSetpoint = sToken.toDouble(&bSetpointKnown);
+    }
+    pCommandTracker->readbackReceived(QStringLiteral("setPercent"), sSetpointReadback, serverNs);
+    pCommandJournal->committed(QStringLiteral("setPercent"), sSetpointReadback);
+    // A setpoint of the previous session awaiting confirmation is
+    // left in the field for the operator
+    if(bSetpointKnown && (appliedSetpoint >= 0.0) && (appliedSetpoint <= 100.0) &&
+       ui->powerPercentageEdit->text() != sSetpointReadback &&
+       !pCommandJournal->isRestored(QStringLiteral("setPercent")))
+    {
+      TRACE_SPAN("ui update", "ui");
+      ui->powerPercentageEdit->setText(sSetpointReadback);
+      ui->applyButton->hide();
+    }
+  }
+
+  // The ack or the readback may have freed the window
+  if(Q_UNLIKELY(!heldCommands.isEmpty()))
+    sendHeldCommands();
+
+  if(XML_Find(sMessage, "readPercent", &sToken)) {
+    double readValue = sToken.toDouble(&ok);
+    if(ok) {
+      readbackStats.add(readValue);
+      if(Q_UNLIKELY(bFirstReadback)) {
+        bFirstReadback = false;
+        StartupProfile::mark("first_readback");
+        LOG_INFO(logFile, "Startup profile: %1", StartupProfile::summary());
+      }
+      if(bSetpointKnown)
+        trackingErrorStats.add(readValue - appliedSetpoint);
+      // Servers keeping a history number their readbacks
+      QStringRef sSeq;
+      if(XML_Find(sMessage, "hseq", &sSeq)) {
+        HistorySample sample;
+        sample.seq      = sSeq.toUInt(&ok);
+        sample.serverNs = serverNs;
+        sample.value    = readValue;
+        if(ok) {
+          if(Q_UNLIKELY(readbackHistory.isNewRun(sample))) {
+            LOG_INFO(logFile, "Readback numbering restarted by %1", readbackHistory.server());
+            saveHistory();
+            readbackHistory.reset(readbackHistory.server());
+          }
+          if(Q_UNLIKELY(bHistoryDue)) {
+            bHistoryDue = false;
+            requestHistory();
+          }
+          readbackHistory.append(sample);
+        }
+      }
+    }
+    if(serverNs > 0 && pClockSync->isValid())
+      LOG_DEBUG(logFile, "readPercent %1 at local time %2 ns", readValue, pClockSync->toLocalNs(serverNs));
+    if(sToken != ui->powerPercentageReadEdit->text()) {
+      TRACE_SPAN("ui update", "ui");
+      ui->powerPercentageReadEdit->setText(sToken.toString());
+    }
+  }
+
+  if(XML_Find(sMessage, "noDAC", &sToken)) {
+    if(sToken != ui->powerPercentageReadEdit->text()) {
+      TRACE_SPAN("ui update", "ui");
+      ui->powerPercentageReadEdit->setText(sToken.toString());
+    }
+  }
+
+}
+
+
+void
+TRemote::on_powerPercentageEdit_textChanged(const QString &arg1) {
+  double pValue = arg1.toDouble();
+  if((pValue < 0.0) || (pValue > 100.0)) {
+    ui->powerPercentageEdit->setStyleSheet(sErrorStyle);
+    ui->applyButton->hide();
+    return;
+  }
+  ui->powerPercentageEdit->setStyleSheet(sNormalStyle);
+  ui->applyButton->show();
+}
+
+
+void
+TRemote::on_powerPercentageEdit_returnPressed() {
+  double pValue = ui->powerPercentageEdit->text().toDouble();
+  if((pValue < 0.0) || (pValue > 100.0)) {
+    ui->powerPercentageEdit->setStyleSheet(sErrorStyle);
+    return;
+  }
+  QString sString = QString("%1").arg(pValue, 0, 'f', 1);
+  ui->powerPercentageEdit->setText(sString);
+  // Setpoints are accepted even while disconnected: the journal
+  // replays them on reconnection
+  pCommandJournal->record(QString("setPercent"), sString);
+  if(pConnection->state() != ConnectionManager::Connected)
+    ui->statusBar->showMessage(tr("%1% will be applied when connected").arg(sString));
+  else if(!sendCommand(QString("setPercent"), sString)) {
+    LOG_ERROR(logFile, "Unable to send the new setpoint");
+  }
+  ui->applyButton->hide();
+  return;
+}
+
+
+void
+TRemote::on_applyButton_clicked() {
+  on_powerPercentageEdit_returnPressed();
+}
+
+
+void
+TRemote::on_serverAddressEdit_returnPressed() {
+  // A full URL selects the transport (tcp://, local://...)
+  QString serverUrl = ui->serverAddressEdit->text().trimmed();
+  if(!serverUrl.contains(QString("://"))) {
+    serverUrl = QString("%1://%2:%3")
+                .arg(pConnection->scheme())
+                .arg(serverUrl)
+                .arg(SERVER_PORT);
+  }
+  if(!pConnection->connectToServer(serverUrl))
+    ui->statusBar->showMessage(tr("Already connected to: %1").arg(pConnection->serverUrl()));
+}
+
+
+void
+TRemote::on_autoSearchButton_clicked() {
+  pConnection->startDiscovery();
+  ui->connectionGroupBox->setDisabled(true);
+}
+
+
+void
+TRemote::on_manualButton_clicked() {
+  on_serverAddressEdit_returnPressed();
+}
+
+
+void
+TRemote::on_profileButton_clicked() {
+  if(pSetpointRamp->isRunning()) {
+    pSetpointRamp->stop();
+    return;
+  }
+  QString sFileName = QFileDialog::getOpenFileName(this,
+                                                   tr("Open Setpoint Profile"),
+                                                   QDir::homePath(),
+                                                   tr("Profiles (*.txt *.prof);;All Files (*)"));
+  if(sFileName.isEmpty())
+    return;
+  QString sError;
+  if(!pSetpointRamp->loadProfile(sFileName, &sError)) {
+    ui->statusBar->showMessage(sError);
+    return;
+  }
+  sLastRampValue.clear();
+  ui->powerPercentageEdit->setDisabled(true);
+  ui->profileButton->setText(tr("Stop"));
+  ui->statusBar->showMessage(tr("Running Profile %1").arg(sFileName));
+  pSetpointRamp->start(ui->powerPercentageEdit->text().toDouble());
+}
+
+
+// Runs in the ramp thread: the tracker and the connection manager are
+// thread-safe, the widgets are updated by onRampSetpointSent()
+void
+TRemote::onRampSetpointDue(double dValue, qint64 scheduledNs) {
+  if(pConnection->state() != ConnectionManager::Connected)
+    return;
+  // Only changes of the transmitted value are worth a message
+  QString sString = QString("%1").arg(dValue, 0, 'f', 1);
+  if(sString == sLastRampValue)
+    return;
+  if(pCommandTracker->isWindowFull()) {
+    LOG_DEBUG(logFile, "Too many commands in flight: %1 not sent", sString);
+    return;
+  }
+  QString sMessage = pCommandTracker->track(QString("setPercent"), sString);
+  if(pConnection->sendTextMessage(sMessage) != sMessage.length()) {
+    LOG_WARNING(logFile, "Unable to send the profile setpoint");
+    return;
+  }
+  pSetpointRamp->recordSent(scheduledNs, pSetpointRamp->nowNs());
+  sLastRampValue = sString;
+  QMetaObject::invokeMethod(this, "onRampSetpointSent", Qt::QueuedConnection,
+                            Q_ARG(QString, sString));
+}
+
+
+void
+TRemote::onRampSetpointSent(QString sValue) {
+  sCurrentSetpoint = sValue;
+  ui->powerPercentageEdit->setText(sValue);
+  ui->applyButton->hide();
+}
+
+
+void
+TRemote::onRampFinished() {
+  ui->profileButton->setText(tr("Profile..."));
+  ui->powerPercentageEdit->setEnabled(true);
+  ui->applyButton->hide();
+  ui->statusBar->showMessage(tr("Profile Completed"));
+}
+
+
+// A command that finds the window full is held back, only the last
+// value of each channel, and sent by sendHeldCommands()
+bool
+TRemote::sendCommand(QString sTag, QString sValue) {
+  if(pConnection->state() != ConnectionManager::Connected)
+    return false;
+  if(sTag == QString("setPercent"))
+    sCurrentSetpoint = sValue;
+  if(pCommandTracker->isWindowFull()) {
+    LOG_DEBUG(logFile, "Too many commands in flight: %1 held back", sValue);
+    heldCommands.insert(sTag, sValue);
+    ui->statusBar->showMessage(tr("Server busy: %1 will be sent as soon as possible").arg(sValue));
+    return true;
+  }
+  QString sMessage = pCommandTracker->track(sTag, sValue);
+  qint64 bytesSent = pConnection->sendTextMessage(sMessage);
+  return bytesSent == sMessage.length();
+}
+
+
+void
+TRemote::sendHeldCommands() {
+  while(!heldCommands.isEmpty() && !pCommandTracker->isWindowFull()) {
+    QMap<QString, QString>::iterator it = heldCommands.begin();
+    QString sTag   = it.key();
+    QString sValue = it.value();
+    heldCommands.erase(it);
+    if(!sendCommand(sTag, sValue))
+      LOG_WARNING(logFile, "Unable to send the held back %1=%2", sTag, sValue);
+  }
+}
+
+
+// Sends the last value journaled in this session of every channel
+// not already being retransmitted by the command tracker
+void
+TRemote::replayJournal() {
+  pCommandJournal->replayStarted();
+  QMap<QString, QString> pending = pCommandJournal->pendingCommands();
+  QMap<QString, QString>::const_iterator it;
+  for(it=pending.constBegin(); it!=pending.constEnd(); ++it) {
+    if(pCommandTracker->isInFlight(it.key(), it.value()))
+      continue;
+    if(!sendCommand(it.key(), it.value()))
+      LOG_WARNING(logFile, "Unable to replay %1=%2", it.key(), it.value());
+  }
+}
+
+
+void
+TRemote::onCommandRetransmit(QString sMessage) {
+  qint64 bytesSent = pConnection->sendTextMessage(sMessage);
+  if(bytesSent != sMessage.length()) {
+    LOG_WARNING(logFile, "Unable to retransmit %1", sMessage);
+  }
+}
+
+
+void
+TRemote::onCommandLost(quint32 seq, QString sMessage) {
+  Q_UNUSED(sMessage)
+  ui->statusBar->showMessage(tr("Command #%1 not acknowledged by the Server").arg(seq));
+  sendHeldCommands();
+}
+
+
+void
+TRemote::onTimeRequest(QString sMessage) {
+  pConnection->sendTextMessage(sMessage);
+}
+
+
+void
+TRemote::onGroupActionTriggered(QAction *pAction) {
+  QString sGroup = pAction->data().toString();
+  double pValue = ui->powerPercentageEdit->text().toDouble();
+  if((pValue < 0.0) || (pValue > 100.0)) {
+    ui->powerPercentageEdit->setStyleSheet(sErrorStyle);
+    return;
+  }
+  QString sString = QString("%1").arg(pValue, 0, 'f', 1);
+  if(!pGroupBroadcaster->apply(sGroup, QString("setPercent"), sString))
+    ui->statusBar->showMessage(tr("No server of %1 is connected").arg(sGroup));
+}
+
+
+void
+TRemote::onGroupApplied(QString sGroup, int nAcked, int nMembers) {
+  ui->statusBar->showMessage(tr("%1: %2 of %3 servers acknowledged")
+                             .arg(sGroup)
+                             .arg(nAcked)
+                             .arg(nMembers));
+}
+
+
+void
+TRemote::onTimeToUpdateStats() {
+  if(readbackStats.count() == 0)
+    return;
+  ui->statsLabel->setText(tr("Read:  %1\nError: %2\n%3 samples")
+                          .arg(readbackStats.summary())
+                          .arg(trackingErrorStats.summary())
+                          .arg(readbackStats.count()));
+  static MetricGauge& readMean = Metrics::gauge("tremote_readback_mean",
+                                                "Mean readback over the statistics window");
+  static MetricGauge& readSd = Metrics::gauge("tremote_readback_stddev",
+                                              "Readback standard deviation over the statistics window");
+  static MetricGauge& errorMean = Metrics::gauge("tremote_tracking_error_mean",
+                                                 "Mean of readback minus applied setpoint");
+  static MetricGauge& errorSd = Metrics::gauge("tremote_tracking_error_stddev",
+                                               "Standard deviation of readback minus applied setpoint");
+  static MetricGauge& errorP95 = Metrics::gauge("tremote_tracking_error_p95",
+                                                "95th percentile of readback minus applied setpoint");
+  readMean.set(readbackStats.mean());
+  readSd.set(readbackStats.stdDev());
+  errorMean.set(trackingErrorStats.mean());
+  errorSd.set(trackingErrorStats.stdDev());
+  errorP95.set(trackingErrorStats.percentile(95.0));
+}
+
+
+void
+TRemote::onToggleTrace() {
+  if(!Tracer::isEnabled()) {
+    Tracer::start();
+    ui->statusBar->showMessage(tr("Tracing started"));
+    return;
+  }
+  Tracer::stop();
+  if(Tracer::dump(traceFileName))
+    ui->statusBar->showMessage(tr("Trace written to %1").arg(traceFileName));
+  else
+    LOG_ERROR(logFile, "Unable to write %1", traceFileName);
+}
@@ -1,89 +1,154 @@
-/*
- *
-Copyright (C) 2016  Gabriele Salvato
-
-This program is free software: you can redistribute it and/or modify
-it under the terms of the GNU General Public License as published by
-the Free Software Foundation, either version 3 of the License, or
-(at your option) any later version.
-
-This program is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-GNU General Public License for more details.
-
-You should have received a copy of the GNU General Public License
-along with this program.  If not, see <http://www.gnu.org/licenses/>.
-*
-*/
-
-#ifndef TREMOTE_H
-#define TREMOTE_H
-
-#include <QMainWindow>
-#include <QTimer>
-#include <QAbstractSocket>
-
-QT_FORWARD_DECLARE_CLASS(ServerDiscoverer)
-QT_FORWARD_DECLARE_CLASS(QFile)
-QT_FORWARD_DECLARE_CLASS(QWebSocket)
-
-namespace Ui {
-class TRemote;
-}
-
-class TRemote : public QMainWindow
-{
-  Q_OBJECT
-
-public:
-  explicit TRemote(QWidget *parent = 0);
-  ~TRemote();
-  void closeEvent(QCloseEvent *event);
-
-protected slots:
-  void onTimeToCheckNetwork();
-  void onConnectionTimerElapsed();
-  void onServerFound(QString serverUrl);
-  void onPanelServerConnected();
-  void onPanelServerDisconnected();
-  void onPanelServerSocketError(QAbstractSocket::SocketError error);
-  void onTextMessageReceived(QString sMessage);
-  void onBinaryMessageReceived(QByteArray baMessage);
-
-protected:
-  void            startServerDiscovery();
-  bool            isConnectedToNetwork();
-  bool            PrepareLogFile();
-
-protected:
-  ServerDiscoverer *pServerDiscoverer;
-  QWebSocket       *pPanelServerSocket;
-
-  QString           logFileName;
-  QFile*            logFile;
-
-  QTimer             networkReadyTimer;
-  QTimer             connectionTimer;
-  int                connectionTime;
-
-private slots:
-  void on_powerPercentageEdit_textChanged(const QString &arg1);
-
-  void on_powerPercentageEdit_returnPressed();
-
-  void on_applyButton_clicked();
-
-  void on_serverAddressEdit_returnPressed();
-
-  void on_autoSearchButton_clicked();
-
-  void on_manualButton_clicked();
-
-private:
-  Ui::TRemote *ui;
-  QString     sNormalStyle;
-  QString     sErrorStyle;
-};
-
-#endif // TREMOTE_H
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#ifndef TREMOTE_H
+#define TREMOTE_H
+
+#include <QMainWindow>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QAbstractSocket>
+#include <QThreadPool>
+#include <QThread>
+#include <QMap>
+
+#include "connectionmanager.h"
+#include "streamingstats.h"
+#include "readbackhistory.h"
+
+QT_FORWARD_DECLARE_CLASS(SetpointRamp)
+QT_FORWARD_DECLARE_CLASS(CommandTracker)
+QT_FORWARD_DECLARE_CLASS(CommandJournal)
+QT_FORWARD_DECLARE_CLASS(ClockSync)
+QT_FORWARD_DECLARE_CLASS(GroupBroadcaster)
+QT_FORWARD_DECLARE_CLASS(QAction)
+QT_FORWARD_DECLARE_CLASS(MetricsExporter)
+QT_FORWARD_DECLARE_CLASS(StallWatchdog)
+QT_FORWARD_DECLARE_CLASS(QFile)
+
+namespace Ui {
+class TRemote;
+}
+
+class TRemote : public QMainWindow
+{
+  Q_OBJECT
+
+public:
+  explicit TRemote(QWidget *parent = 0);
+  ~TRemote();
+  void closeEvent(QCloseEvent *event);
+
+protected slots:
+  void onConnectionStateChanged(ConnectionManager::State newState);
+  void onNetworkStatus(bool bAvailable);
+  void onPanelServerConnected();
+  void onPanelServerDisconnected();
+  void onPanelServerFailover(QString sUrl);
+  void onTextMessageReceived(const QString &sMessage);
+  void onBinaryMessageReceived(const QByteArray &baMessage);
+  void onRampSetpointDue(double dValue, qint64 scheduledNs);
+  void onRampSetpointSent(QString sValue);
+  void onRampFinished();
+  void onCommandRetransmit(QString sMessage);
+  void onCommandLost(quint32 seq, QString sMessage);
+  void onTimeRequest(QString sMessage);
+  void onGroupActionTriggered(QAction *pAction);
+  void onGroupApplied(QString sGroup, int nAcked, int nMembers);
+  void onTimeToUpdateStats();
+  void onToggleTrace();
+  void onStartupStage();
+  void onHistorySaved();
+
+protected:
+  void            showEvent(QShowEvent *event);
+  bool            PrepareLogFile();
+  void            startServices();
+  bool            sendCommand(QString sTag, QString sValue);
+  void            sendHeldCommands();
+  void            replayJournal();
+  void            requestHistory();
+  void            saveHistory();
+
+protected:
+  enum StartupStage {
+    StageShow,
+    StageFiles,
+    StageNetwork,
+    StageServices,
+    StageDone
+  };
+
+protected:
+  ConnectionManager *pConnection;
+  SetpointRamp      *pSetpointRamp;
+  CommandTracker    *pCommandTracker;
+  CommandJournal    *pCommandJournal;
+  ClockSync         *pClockSync;
+  GroupBroadcaster  *pGroupBroadcaster;
+  MetricsExporter   *pMetricsExporter;
+  StallWatchdog     *pStallWatchdog;
+  QString            sLastRampValue;
+  QString            sCurrentSetpoint;   // Re-applied on failover
+  QMap<QString, QString> heldCommands;   // Tag -> value, window full
+  double             appliedSetpoint;    // As read back from the server
+  bool               bSetpointKnown;
+  QString            sSetpointReadback;  // Last <setPercent> received
+  StreamingStats     readbackStats;
+  StreamingStats     trackingErrorStats; // Readback - applied setpoint
+  QTimer             statsTimer;
+  ReadbackHistory    readbackHistory;    // By the server sequence number
+  QVector<HistorySample> pendingBackfill; // Chunks until the last one
+  QElapsedTimer      backfillClock;
+  bool               bHistoryDue;        // Asked at the first numbered readback
+
+  QString            logFileName;
+  QFile*             logFile;
+  QString            traceFileName;
+  QString            sJournalFileName;
+  QString            sHistoryFileName;
+  QThreadPool        historyPool;        // One thread: saves in order
+  QThread            linkThread;         // Of the connection manager
+  bool               bFirstMessage;
+  quint64            nConnections;
+  StartupStage       startupStage;
+  bool               bFirstReadback;     // Ends the startup profile
+
+private slots:
+  void on_powerPercentageEdit_textChanged(const QString &arg1);
+
+  void on_powerPercentageEdit_returnPressed();
+
+  void on_applyButton_clicked();
+
+  void on_serverAddressEdit_returnPressed();
+
+  void on_autoSearchButton_clicked();
+
+  void on_manualButton_clicked();
+
+  void on_profileButton_clicked();
+
+private:
+  Ui::TRemote *ui;
+  QString     sNormalStyle;
+  QString     sErrorStyle;
+};
+
+#endif // TREMOTE_H
@@ -1,76 +1,225 @@
-/*
- *
-Copyright (C) 2016  Gabriele Salvato
-
-This program is free software: you can redistribute it and/or modify
-it under the terms of the GNU General Public License as published by
-the Free Software Foundation, either version 3 of the License, or
-(at your option) any later version.
-
-This program is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-GNU General Public License for more details.
-
-You should have received a copy of the GNU General Public License
-along with this program.  If not, see <http://www.gnu.org/licenses/>.
-*
-*/
-
-#include "utility.h"
-
-QString
-XML_Parse(QString input_string, QString token) {
-    // simple XML parser
-    //   XML_Parse("<score1>10</score1>","beam")   will return "10"
-    // returns "" on error
-    QString start_token, end_token, result = QString("NoData");
-    start_token = "<" + token + ">";
-    end_token = "</" + token + ">";
-
-    int start_pos=-1, end_pos=-1, len=0;
-
-    start_pos = input_string.indexOf(start_token);
-    end_pos   = input_string.indexOf(end_token);
-
-    if(start_pos < 0 || end_pos < 0) {
-        result = QString("NoData");
-    } else {
-        start_pos += start_token.length();
-        len = end_pos - start_pos;
-        if(len>0)
-            result = input_string.mid(start_pos, len);
-        else
-            result = "";
-    }
-
-    return result;
-}
-
-void
-logMessage(QFile *logFile, QString sFunctionName, QString sMessage) {
-    Q_UNUSED(sFunctionName)
-    Q_UNUSED(sMessage)
-
-    QDateTime dateTime;
-#ifdef LOG_MESG
-    QString sDebugMessage = dateTime.currentDateTime().toString() +
-                            sFunctionName +
-                            sMessage;
-    if(logFile) {
-        if(logFile->isOpen()) {
-            logFile->write(sDebugMessage.toUtf8().data());
-            logFile->write("\r\n");
-            logFile->flush();
-        }
-        else {
-            qDebug() << sDebugMessage;
-        }
-    }
-    else {
-        qDebug() << sDebugMessage;
-    }
-#endif
-}
-
-
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <qmath.h>
+#include <string.h>
+
+#include "utility.h"
+
+
+#define XML_MAX_TOKEN 64 // Longest tag name XML_Find() looks for
+
+
+// Default: errors, warnings and informative messages
+std::atomic<int> logLevelThreshold(LogInfo);
+std::atomic<int> timeScale(1);
+
+
+void
+setLogLevel(int level) {
+    logLevelThreshold.store(qBound(int(LogOff), level, int(LogDebug)),
+                            std::memory_order_relaxed);
+}
+
+
+void
+setTimeScale(int scale) {
+    timeScale.store(qMax(1, scale), std::memory_order_relaxed);
+}
+
+
+QString
+logLevelName(int level) {
+    switch(level) {
+    case LogOff:     return QString("Off");
+    case LogError:   return QString("Error");
+    case LogWarning: return QString("Warning");
+    case LogInfo:    return QString("Info");
+    case LogDebug:   return QString("Debug");
+    }
+    return QString("Level%1").arg(level);
+}
+
+
+QString
+XML_Parse(const QString &input_string, const QString &token) {
+    // simple XML parser
+    //   XML_Parse("<score1>10</score1>","beam")   will return "10"
+    // returns "" on error
+    QString start_token, end_token, result = QString("NoData");
+    start_token = "<" + token + ">";
+    end_token = "</" + token + ">";
+
+    int start_pos=-1, end_pos=-1, len=0;
+
+    start_pos = input_string.indexOf(start_token);
+    end_pos   = input_string.indexOf(end_token);
+
+    if(start_pos < 0 || end_pos < 0) {
+        result = QString("NoData");
+    } else {
+        start_pos += start_token.length();
+        len = end_pos - start_pos;
+        if(len>0)
+            result = input_string.mid(start_pos, len);
+        else
+            result = "";
+    }
+
+    return result;
+}
+
+
+// Same as XML_Parse() without any heap allocation: the tags are built
+// on the stack and *pValue refers to the characters of input_string.
+// Returns false when the token is missing ("NoData").
+bool
+XML_Find(const QString &input_string, const char *token, QStringRef *pValue) {
+    char start_token[XML_MAX_TOKEN+3], end_token[XML_MAX_TOKEN+4];
+    int tokenLength = int(qstrlen(token));
+    if(tokenLength > XML_MAX_TOKEN)
+        return false;
+    start_token[0] = '<';
+    memcpy(start_token+1, token, size_t(tokenLength));
+    start_token[tokenLength+1] = '>';
+    end_token[0] = '<';
+    end_token[1] = '/';
+    memcpy(end_token+2, token, size_t(tokenLength));
+    end_token[tokenLength+2] = '>';
+
+    int start_pos = input_string.indexOf(QLatin1String(start_token, tokenLength+2));
+    if(start_pos < 0)
+        return false;
+    start_pos += tokenLength+2;
+    int end_pos = input_string.indexOf(QLatin1String(end_token, tokenLength+3), start_pos);
+    if(end_pos < 0)
+        return false;
+    *pValue = QStringRef(&input_string, start_pos, end_pos-start_pos);
+    return true;
+}
+
+
+void
+logMessage(QFile *logFile, QString sFunctionName, QString sMessage) {
+    Q_UNUSED(sFunctionName)
+    Q_UNUSED(sMessage)
+
+    QDateTime dateTime;
+#ifdef LOG_MESG
+    if(BinaryLog::isOpen()) {
+        static const quint32 logSite =
+            BinaryLog::internSite(__FILE__, __LINE__, "logMessage", "%1%2", LogInfo);
+        BinaryLog::write(logSite, sFunctionName, sMessage);
+        return;
+    }
+    QString sDebugMessage = dateTime.currentDateTime().toString() +
+                            sFunctionName +
+                            sMessage;
+    if(logFile) {
+        // The connection, the ramp and the watchdog log from their threads
+        static QMutex fileMutex;
+        QMutexLocker locker(&fileMutex);
+        if(logFile->isOpen()) {
+            logFile->write(sDebugMessage.toUtf8().data());
+            logFile->write("\r\n");
+            logFile->flush();
+        }
+        else {
+            qDebug() << sDebugMessage;
+        }
+    }
+    else {
+        qDebug() << sDebugMessage;
+    }
+#endif
+}
+
+
+TimingStats::TimingStats() {
+    reset();
+}
+
+
+void
+TimingStats::reset() {
+    for(int i=0; i<nBuckets; i++)
+        bucket[i] = 0;
+    nSamples = 0;
+    minNs    = 0;
+    maxNs    = 0;
+    sumNs    = 0.0;
+    sumSqNs  = 0.0;
+}
+
+
+void
+TimingStats::add(qint64 valueNs) {
+    if(nSamples == 0) {
+        minNs = valueNs;
+        maxNs = valueNs;
+    }
+    else {
+        minNs = qMin(minNs, valueNs);
+        maxNs = qMax(maxNs, valueNs);
+    }
+    nSamples++;
+    sumNs   += double(valueNs);
+    sumSqNs += double(valueNs)*double(valueNs);
+    qint64 us = qAbs(valueNs) / 1000;
+    int i = 0;
+    while((i < nBuckets-1) && ((qint64(1) << i) <= us))
+        i++;
+    bucket[i]++;
+}
+
+
+QString
+TimingStats::summary() const {
+    if(nSamples == 0)
+        return QString("no samples");
+    double mean = sumNs / double(nSamples);
+    double var  = sumSqNs / double(nSamples) - mean*mean;
+    double sd   = var > 0.0 ? qSqrt(var) : 0.0;
+    // Percentiles are upper bounds of the histogram buckets
+    qint64 p50 = 0, p99 = 0;
+    quint64 cumulative = 0;
+    for(int i=0; i<nBuckets; i++) {
+        cumulative += bucket[i];
+        if(p50 == 0 && cumulative*2 >= nSamples)
+            p50 = qint64(1) << i;
+        if(p99 == 0 && cumulative*100 >= nSamples*99)
+            p99 = qint64(1) << i;
+    }
+    QString sSummary = QString("n=%1 mean=%2us sd=%3us min=%4us max=%5us p50<%6us p99<%7us")
+                       .arg(nSamples)
+                       .arg(mean/1000.0, 0, 'f', 1)
+                       .arg(sd/1000.0, 0, 'f', 1)
+                       .arg(double(minNs)/1000.0, 0, 'f', 1)
+                       .arg(double(maxNs)/1000.0, 0, 'f', 1)
+                       .arg(p50)
+                       .arg(p99);
+    for(int i=0; i<nBuckets; i++) {
+        if(bucket[i] == 0)
+            continue;
+        sSummary += QString(" [<%1us:%2]").arg(qint64(1) << i).arg(bucket[i]);
+    }
+    return sSummary;
+}
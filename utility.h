@@ -1,35 +1,143 @@
-/*
- *
-Copyright (C) 2016  Gabriele Salvato
-
-This program is free software: you can redistribute it and/or modify
-it under the terms of the GNU General Public License as published by
-the Free Software Foundation, either version 3 of the License, or
-(at your option) any later version.
-
-This program is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-GNU General Public License for more details.
-
-You should have received a copy of the GNU General Public License
-along with this program.  If not, see <http://www.gnu.org/licenses/>.
-*
-*/
-
-#ifndef UTILITY_H
-#define UTILITY_H
-
-#include <QString>
-#include <QFile>
-#include <QTextStream>
-#include <QDateTime>
-#include <QDebug>
-
-#define LOG_MESG
-#define LOG_VERBOSE
-
-QString XML_Parse(QString input_string, QString token);
-void logMessage(QFile *logFile, QString sFunctionName, QString sMessage);
-
-#endif // UTILITY_H
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#ifndef UTILITY_H
+#define UTILITY_H
+
+#include <QString>
+#include <QFile>
+#include <QTextStream>
+#include <QDateTime>
+#include <QDebug>
+#include <atomic>
+
+#include "binarylog.h"
+
+#define LOG_MESG
+
+// Messages above this level are not even compiled in (LogOff: none)
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL LogDebug
+#endif
+
+enum LogLevel {
+    LogOff     = -1,
+    LogError   = 0,
+    LogWarning = 1,
+    LogInfo    = 2,
+    LogDebug   = 3
+};
+
+extern std::atomic<int> logLevelThreshold;
+
+inline bool
+logLevelEnabled(int level) {
+    return level <= logLevelThreshold.load(std::memory_order_relaxed);
+}
+
+void    setLogLevel(int level);
+QString logLevelName(int level);
+
+// Protocol timer periods are divided by the time scale: 1 in the
+// application, larger in tools/soak to compress days of retries,
+// backoffs and heartbeats into minutes
+extern std::atomic<int> timeScale;
+
+inline int
+scaledMs(int msec) {
+    return qMax(1, msec/timeScale.load(std::memory_order_relaxed));
+}
+
+void    setTimeScale(int scale);
+
+QString XML_Parse(const QString &input_string, const QString &token);
+bool    XML_Find(const QString &input_string, const char *token, QStringRef *pValue);
+void logMessage(QFile *logFile, QString sFunctionName, QString sMessage);
+
+
+// QString("...%1...%2").arg(a).arg(b) with a variable number of arguments
+inline void
+logFormatArgs(QString &sMessage) {
+    Q_UNUSED(sMessage)
+}
+
+template<typename T, typename... Rest>
+inline void
+logFormatArgs(QString &sMessage, const T &first, const Rest&... rest) {
+    sMessage = sMessage.arg(first);
+    logFormatArgs(sMessage, rest...);
+}
+
+template<typename... Args>
+inline QString
+logFormat(const char *format, const Args&... args) {
+    QString sMessage = QString(format);
+    logFormatArgs(sMessage, args...);
+    return sMessage;
+}
+
+
+// Distribution of time intervals (jitters, latencies...)
+class TimingStats
+{
+public:
+    TimingStats();
+    void    reset();
+    void    add(qint64 valueNs);
+    quint64 count() const { return nSamples; }
+    QString summary() const;
+
+private:
+    enum { nBuckets = 24 }; // bucket i holds |value| < 2^i us
+    quint64 bucket[nBuckets];
+    quint64 nSamples;
+    qint64  minNs;
+    qint64  maxNs;
+    double  sumNs;
+    double  sumSqNs;
+};
+
+
+// The arguments are evaluated (and the message formatted) only when the
+// level is enabled: a disabled call site costs a single relaxed load.
+// In binary mode the file, line, function, level and format string are
+// stored once per call site and no text formatting is done at all.
+#define LOG_AT(level, logFile, format, ...)                                 \
+    do {                                                                    \
+        if((level) <= LOG_COMPILED_LEVEL && Q_UNLIKELY(logLevelEnabled(level))) { \
+            if(BinaryLog::isOpen()) {                                       \
+                static const quint32 _logSite =                             \
+                    BinaryLog::internSite(__FILE__, __LINE__, Q_FUNC_INFO,  \
+                                          format, level);                   \
+                BinaryLog::write(_logSite, ##__VA_ARGS__);                  \
+            }                                                               \
+            else {                                                          \
+                logMessage(logFile,                                         \
+                           QString(" %1 ").arg(Q_FUNC_INFO),                \
+                           logFormat(format, ##__VA_ARGS__));               \
+            }                                                               \
+        }                                                                   \
+    } while(0)
+
+#define LOG_ERROR(logFile, format, ...)   LOG_AT(LogError,   logFile, format, ##__VA_ARGS__)
+#define LOG_WARNING(logFile, format, ...) LOG_AT(LogWarning, logFile, format, ##__VA_ARGS__)
+#define LOG_INFO(logFile, format, ...)    LOG_AT(LogInfo,    logFile, format, ##__VA_ARGS__)
+#define LOG_DEBUG(logFile, format, ...)   LOG_AT(LogDebug,   logFile, format, ##__VA_ARGS__)
+
+#endif // UTILITY_H
@@ -0,0 +1,324 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include <QCryptographicHash>
+#include <QTextCodec>
+#include <QList>
+#include <QtEndian>
+#include <string.h>
+
+#include "websocketcodec.h"
+
+
+#define MAX_MESSAGE_SIZE    (16*1024*1024)
+#define MAX_CONTROL_PAYLOAD 125 // RFC 6455, 5.5
+#define UTF8_MIB            106
+#define WS_GUID             "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+
+namespace {
+
+// Overlong forms, surrogates and truncated sequences are all invalid.
+// A leading BOM is part of the text.
+bool
+decodeUtf8(const QByteArray &data, QString *pText) {
+    QTextCodec::ConverterState state(QTextCodec::IgnoreHeader);
+    *pText = QTextCodec::codecForMib(UTF8_MIB)->toUnicode(data.constData(), data.size(), &state);
+    return state.invalidChars == 0 && state.remainingChars == 0;
+}
+
+
+// Codes a peer may send (RFC 6455, 7.4)
+bool
+isValidCloseCode(int code) {
+    if(code >= 3000 && code <= 4999)
+        return true;
+    return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1011);
+}
+
+}
+
+
+QByteArray
+WebSocketCodec::upgradeRequest(const QUrl &url, const QByteArray &key) {
+    bool bSecure = url.scheme() == QString("wss");
+    QByteArray path = url.path(QUrl::FullyEncoded).toLatin1();
+    if(path.isEmpty())
+        path = "/";
+    if(url.hasQuery())
+        path += "?" + url.query(QUrl::FullyEncoded).toLatin1();
+    QByteArray host = url.host(QUrl::FullyEncoded).toLatin1();
+    if(host.contains(':'))
+        host = "[" + host + "]";// IPv6
+    return "GET " + path + " HTTP/1.1\r\n"
+           "Host: " + host + ":" + QByteArray::number(url.port(bSecure ? 443 : 80)) + "\r\n"
+           "Upgrade: websocket\r\n"
+           "Connection: Upgrade\r\n"
+           "Sec-WebSocket-Key: " + key + "\r\n"
+           "Sec-WebSocket-Version: 13\r\n"
+           "\r\n";
+}
+
+
+// head: the response up to, not including, the empty line (RFC 6455, 4.1)
+WebSocketCodec::Handshake
+WebSocketCodec::checkUpgradeResponse(const QByteArray &head, const QByteArray &key, QString *pReason) {
+    QList<QByteArray> lines = head.split('\n');
+    QList<QByteArray> status = lines.at(0).trimmed().split(' ');
+    if(status.count() < 2 || !status.at(0).startsWith("HTTP/1.1") || status.at(1) != "101") {
+        *pReason = QString("WebSocket upgrade refused: %1").arg(QString::fromLatin1(lines.at(0).trimmed()));
+        return HandshakeRefused;
+    }
+    bool bUpgrade = false, bConnection = false, bAccept = false;
+    QByteArray expected = QCryptographicHash::hash(key + WS_GUID, QCryptographicHash::Sha1).toBase64();
+    for(int i=1; i<lines.count(); i++) {
+        int colon = lines.at(i).indexOf(':');
+        if(colon < 0)
+            continue;
+        QByteArray name  = lines.at(i).left(colon).trimmed().toLower();
+        QByteArray value = lines.at(i).mid(colon+1).trimmed();
+        if(name == "upgrade") {
+            bUpgrade = value.toLower() == "websocket";
+        }
+        else if(name == "connection") {
+            QList<QByteArray> tokens = value.toLower().split(',');
+            for(int j=0; j<tokens.count(); j++)
+                bConnection = bConnection || tokens.at(j).trimmed() == "upgrade";
+        }
+        else if(name == "sec-websocket-accept") {
+            bAccept = value == expected;
+        }
+        else if(name == "sec-websocket-extensions" || name == "sec-websocket-protocol") {
+            // None was asked for
+            *pReason = QString("Unrequested %1 in the WebSocket upgrade").arg(QString::fromLatin1(name));
+            return HandshakeInvalid;
+        }
+    }
+    if(!bUpgrade)
+        *pReason = QString("Missing \"Upgrade: websocket\" in the WebSocket upgrade");
+    else if(!bConnection)
+        *pReason = QString("Missing \"Connection: Upgrade\" in the WebSocket upgrade");
+    else if(!bAccept)
+        *pReason = QString("Invalid Sec-WebSocket-Accept");
+    else
+        return HandshakeAccepted;
+    return HandshakeInvalid;
+}
+
+
+// Header with room for the mask, then the payload in clear: the mask
+// must be new for every frame sent (RFC 6455, 5.3)
+QByteArray
+WebSocketCodec::encodeFrame(Opcode opcode, const QByteArray &payload) {
+    uchar header[14];
+    int headerSize = 2;
+    quint64 length = quint64(payload.size());
+    header[0] = uchar(0x80 | opcode);
+    if(length < 126) {
+        header[1] = uchar(0x80 | length);
+    }
+    else if(length < 65536) {
+        header[1] = 0x80 | 126;
+        qToBigEndian(quint16(length), header+2);
+        headerSize += 2;
+    }
+    else {
+        header[1] = 0x80 | 127;
+        qToBigEndian(length, header+2);
+        headerSize += 8;
+    }
+    memset(header+headerSize, 0, 4);
+    headerSize += 4;
+    QByteArray frame(headerSize+payload.size(), Qt::Uninitialized);
+    memcpy(frame.data(), header, size_t(headerSize));
+    memcpy(frame.data()+headerSize, payload.constData(), size_t(payload.size()));
+    return frame;
+}
+
+
+// Fills in the mask of a frame made by encodeFrame() and applies it
+void
+WebSocketCodec::maskFrame(QByteArray *pFrame, quint32 maskKey) {
+    int lengthCode = uchar(pFrame->at(1)) & 0x7F;
+    int maskPos = lengthCode == 127 ? 10 : (lengthCode == 126 ? 4 : 2);
+    uchar *pData = reinterpret_cast<uchar*>(pFrame->data());// Detached here
+    uchar *pMask = pData+maskPos;
+    qToBigEndian(maskKey, pMask);
+    uchar *pPayload = pMask+4;
+    int length = pFrame->size()-maskPos-4;
+    for(int i=0; i<length; i++)
+        pPayload[i] ^= pMask[i & 3];
+}
+
+
+WebSocketCodec::WebSocketCodec()
+    : readPos(0)
+    , fragmentsOpcode(-1)
+    , errorCode(0)
+{
+}
+
+
+void
+WebSocketCodec::reset() {
+    inBuffer.clear();
+    readPos = 0;
+    fragments.clear();
+    fragmentsOpcode = -1;
+    message.clear();
+    sText.clear();
+    errorCode = 0;
+    sError.clear();
+}
+
+
+void
+WebSocketCodec::append(const QByteArray &data) {
+    if(readPos > 0) {
+        inBuffer.remove(0, readPos);
+        readPos = 0;
+    }
+    inBuffer.append(data);
+}
+
+
+WebSocketCodec::Event
+WebSocketCodec::fail(CloseCode code, const QString &sReason) {
+    errorCode = code;
+    sError    = sReason;
+    return ProtocolError;
+}
+
+
+WebSocketCodec::Event
+WebSocketCodec::deliver(Opcode opcode, const QByteArray &data) {
+    if(opcode == BinaryFrame) {
+        message = data;
+        return BinaryMessage;
+    }
+    if(!decodeUtf8(data, &sText))
+        return fail(CloseInvalidData, QString("Invalid UTF-8 in a text message"));
+    return TextMessage;
+}
+
+
+WebSocketCodec::Event
+WebSocketCodec::next() {
+    if(errorCode != 0)
+        return ProtocolError;
+    for(;;) {
+        int available = inBuffer.size()-readPos;
+        if(available < 2)
+            return NeedMoreData;
+        const uchar *pHeader = reinterpret_cast<const uchar*>(inBuffer.constData()+readPos);
+        bool bFinal = (pHeader[0] & 0x80) != 0;
+        Opcode opcode = Opcode(pHeader[0] & 0x0F);
+        if(pHeader[0] & 0x70)
+            return fail(CloseProtocolError, QString("Reserved bits set with no extension"));
+        if(pHeader[1] & 0x80)
+            return fail(CloseProtocolError, QString("Masked frame from the server"));
+        int headerSize = 2;
+        quint64 length = pHeader[1] & 0x7F;
+        if(length == 126) {
+            if(available < 4)
+                return NeedMoreData;
+            length = qFromBigEndian<quint16>(pHeader+2);
+            headerSize = 4;
+            if(length < 126)
+                return fail(CloseProtocolError, QString("Frame length not minimally encoded"));
+        }
+        else if(length == 127) {
+            if(available < 10)
+                return NeedMoreData;
+            length = qFromBigEndian<quint64>(pHeader+2);
+            headerSize = 10;
+            if(length < 65536 || (length >> 63))
+                return fail(CloseProtocolError, QString("Frame length not minimally encoded"));
+        }
+        switch(opcode) {
+        case TextFrame:
+        case BinaryFrame:
+            if(fragmentsOpcode >= 0)
+                return fail(CloseProtocolError, QString("New message inside a fragmented one"));
+            break;
+        case ContinuationFrame:
+            if(fragmentsOpcode < 0)
+                return fail(CloseProtocolError, QString("Continuation frame with no message to continue"));
+            break;
+        case CloseFrame:
+        case PingFrame:
+        case PongFrame:
+            if(!bFinal)
+                return fail(CloseProtocolError, QString("Fragmented control frame"));
+            if(length > MAX_CONTROL_PAYLOAD)
+                return fail(CloseProtocolError, QString("Control frame longer than %1 bytes").arg(MAX_CONTROL_PAYLOAD));
+            break;
+        default:
+            return fail(CloseProtocolError, QString("Unknown WebSocket opcode %1").arg(int(opcode)));
+        }
+        if(length > MAX_MESSAGE_SIZE || quint64(fragments.size())+length > MAX_MESSAGE_SIZE)
+            return fail(CloseTooBig, QString("WebSocket message too large"));
+        if(quint64(available-headerSize) < length)
+            return NeedMoreData;
+        QByteArray data = inBuffer.mid(readPos+headerSize, int(length));
+        readPos += headerSize + int(length);
+
+        switch(opcode) {
+        case TextFrame:
+        case BinaryFrame:
+            if(bFinal)
+                return deliver(opcode, data);
+            fragments = data;
+            fragmentsOpcode = opcode;
+            break;
+        case ContinuationFrame:
+            fragments.append(data);
+            if(bFinal) {
+                Opcode messageOpcode = Opcode(fragmentsOpcode);
+                data = fragments;
+                fragments.clear();
+                fragmentsOpcode = -1;
+                return deliver(messageOpcode, data);
+            }
+            break;
+        case PingFrame:
+            message = data;
+            return Ping;
+        case PongFrame:
+            message = data;
+            return Pong;
+        case CloseFrame:
+            // Empty, or a valid status code and an UTF-8 reason
+            if(data.size() == 1)
+                return fail(CloseProtocolError, QString("Close frame with a truncated status code"));
+            if(data.size() >= 2) {
+                int code = qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(data.constData()));
+                if(!isValidCloseCode(code))
+                    return fail(CloseProtocolError, QString("Invalid close code %1").arg(code));
+                QString sReason;
+                if(!decodeUtf8(data.mid(2), &sReason))
+                    return fail(CloseInvalidData, QString("Invalid UTF-8 in the close reason"));
+            }
+            message = data;
+            return Close;
+        default:
+            break;
+        }
+    }
+}
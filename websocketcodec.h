@@ -0,0 +1,95 @@
+/*
+ *
+Copyright (C) 2016  Gabriele Salvato
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#ifndef WEBSOCKETCODEC_H
+#define WEBSOCKETCODEC_H
+
+#include <QByteArray>
+#include <QString>
+#include <QUrl>
+
+
+// Client side of RFC 6455 without the socket: the upgrade handshake,
+// the masked frames sent and the frames received from the server.
+// Bytes are fed with append(); next() returns the events they complete,
+// in order, until it needs more data. Any protocol violation is final:
+// the link must then be closed with closeCode().
+class WebSocketCodec
+{
+public:
+    enum Opcode {
+        ContinuationFrame = 0x0,
+        TextFrame         = 0x1,
+        BinaryFrame       = 0x2,
+        CloseFrame        = 0x8,
+        PingFrame         = 0x9,
+        PongFrame         = 0xA
+    };
+    enum Event {
+        NeedMoreData,
+        TextMessage,
+        BinaryMessage,
+        Ping,
+        Pong,
+        Close,
+        ProtocolError
+    };
+    enum Handshake {
+        HandshakeAccepted,
+        HandshakeRefused,  // No "101 Switching Protocols"
+        HandshakeInvalid
+    };
+    enum CloseCode {
+        CloseNormal        = 1000,
+        CloseProtocolError = 1002,
+        CloseInvalidData   = 1007,
+        CloseTooBig        = 1009
+    };
+
+    static QByteArray upgradeRequest(const QUrl &url, const QByteArray &key);
+    static Handshake  checkUpgradeResponse(const QByteArray &head, const QByteArray &key,
+                                           QString *pReason);
+    static QByteArray encodeFrame(Opcode opcode, const QByteArray &payload);
+    static void       maskFrame(QByteArray *pFrame, quint32 maskKey);
+
+    WebSocketCodec();
+    void              reset();
+    void              append(const QByteArray &data);
+    Event             next();
+    const QByteArray& payload() const { return message; }
+    const QString&    text() const { return sText; }
+    int               closeCode() const { return errorCode; }
+    QString           errorString() const { return sError; }
+
+private:
+    Event  fail(CloseCode code, const QString &sReason);
+    Event  deliver(Opcode opcode, const QByteArray &data);
+
+private:
+    QByteArray inBuffer;
+    int        readPos;        // Start of the first frame not read
+    QByteArray fragments;      // Of a message split in many frames
+    int        fragmentsOpcode; // -1 when no message is split
+    QByteArray message;
+    QString    sText;
+    int        errorCode;
+    QString    sError;
+};
+
+#endif // WEBSOCKETCODEC_H